@@ -24,6 +24,8 @@
 #include <memory>
 #include <stdio.h>
 #include <array>
+#include <unordered_map>
+#include <vector>
 
 #include "bios.h"
 #include "dos_inc.h"
@@ -58,11 +60,23 @@ public:
 	imageDisk(const imageDisk&) = delete; // prevent copy
 	imageDisk& operator=(const imageDisk&) = delete; // prevent assignment
 
-	virtual ~imageDisk()
-	{
-		if (diskimg != nullptr)
-			fclose(diskimg);
-	}
+	virtual ~imageDisk();
+
+	// Sets the size of the block cache in KiB, 0 disables it. Read-only
+	// images are mapped into memory instead if use_mmap is set and the
+	// host supports it.
+	void SetCache(uint32_t size_kb, bool use_mmap);
+
+	// Writes all modified cache blocks back to the image file
+	void Flush();
+
+	struct CacheStats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t host_bytes_read = 0;
+		uint64_t host_bytes_written = 0;
+	};
+	const CacheStats &GetCacheStats() const { return cache_stats; }
 
 	bool hardDrive;
 	bool active;
@@ -73,8 +87,41 @@ public:
 	uint32_t sector_size;
 	uint32_t heads,cylinders,sectors;
 private:
+	// Sectors are cached in blocks of this size, aligned to the image
+	// start. Sequential misses read up to readahead_max blocks at once.
+	static constexpr uint32_t cache_block_size = 32 * 1024;
+	static constexpr uint32_t readahead_max = 4;
+
+	struct CacheBlock {
+		uint32_t index = UINT32_MAX;
+		uint32_t last_used = 0;
+		uint32_t valid_bytes = 0;
+		uint32_t dirty_start = 0;
+		uint32_t dirty_end = 0;
+		std::vector<uint8_t> data = {};
+	};
+
+	CacheBlock *GetCacheBlock(uint32_t index);
+	bool LoadCacheBlocks(uint32_t index);
+	void FlushCacheBlock(CacheBlock &block);
+	uint8_t CachedRead(uint32_t bytenum, uint8_t *data);
+	uint8_t CachedWrite(uint32_t bytenum, const uint8_t *data);
+	void ReleaseMapping();
+
 	uint32_t current_fpos;
 	enum { NONE,READ,WRITE } last_action;
+
+	std::vector<CacheBlock> cache = {};
+	std::unordered_map<uint32_t, CacheBlock *> cache_map = {};
+	uint32_t cache_tick = 0;
+	uint32_t last_miss = UINT32_MAX;
+	uint32_t readahead = 1;
+	bool write_checked = false;
+	bool read_only = false;
+	CacheStats cache_stats = {};
+
+	const uint8_t *mapped_image = nullptr;
+	size_t mapped_size = 0;
 };
 
 void updateDPT(void);
@@ -58,6 +58,8 @@ extern int64_t CPU_IODelayRemoved;
 extern bool CPU_CycleAutoAdjust;
 extern bool CPU_SkipCycleAutoAdjust;
 extern bool CPU_AllowSpeedMods;
+extern bool CPU_IdlePolling;
+extern bool CPU_GuestIdled;
 extern Bitu CPU_AutoDetermineMode;
 
 extern Bitu CPU_ArchitectureType;
@@ -129,6 +131,14 @@ void CPU_RET(bool use32,Bitu bytes,Bitu oldeip);
 void CPU_IRET(bool use32,Bitu oldeip);
 void CPU_HLT(Bitu oldeip);
 
+/* Host idle detection. CPU_Idle() skips the rest of the current cycle slice,
+   fast-forwarding emulated time to the next PIC event, and flags the tick as
+   idle so the host can sleep once it's ahead of real time. CPU_IdlePoll() is
+   called when the guest polls for input and finds none; with idle polling
+   enabled, a burst of such polls within one tick counts as idling. */
+void CPU_Idle();
+void CPU_IdlePoll();
+
 bool CPU_POPF(Bitu use32);
 bool CPU_PUSHF(Bitu use32);
 bool CPU_CLI(void);
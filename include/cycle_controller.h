@@ -0,0 +1,102 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_CYCLE_CONTROLLER_H
+#define DOSBOX_CYCLE_CONTROLLER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// What the main loop measured since the controller last consumed a window
+struct CycleSample {
+	int ticks_done = 0;      // host milliseconds spent emulating
+	int ticks_scheduled = 0; // emulated milliseconds run
+	int ticks_added = 0;     // milliseconds added by the latest clock update
+	int64_t io_delay_removed = 0; // cycles skipped by I/O delays and idling
+	int32_t percent_used = 100;   // the percentage given with cycles=auto/max
+};
+
+// Decides the number of cycles per millisecond when cycles are set to auto
+// or max. The main loop calls Update() whenever the host clock has moved on,
+// and clamps the result to the configured limits.
+class CycleController {
+public:
+	virtual ~CycleController() = default;
+
+	virtual const char *GetName() const noexcept = 0;
+
+	// Adjusts cycle_max in place. Returns true if the sample window was
+	// consumed, in which case the caller starts a new one.
+	virtual bool Update(const CycleSample &sample, int32_t &cycle_max) = 0;
+};
+
+// The ratio heuristic DOSBox has always used
+class LegacyCycleController final : public CycleController {
+public:
+	const char *GetName() const noexcept override { return "legacy"; }
+	bool Update(const CycleSample &sample, int32_t &cycle_max) override;
+};
+
+// Steers the share of host time spent emulating towards a target using an
+// incremental PID controller on the logarithm of the cycles. Working with
+// ratios keeps the response the same at 3000 and 300000 cycles.
+class PidCycleController final : public CycleController {
+public:
+	PidCycleController(int target_percent);
+
+	const char *GetName() const noexcept override { return "pid"; }
+	bool Update(const CycleSample &sample, int32_t &cycle_max) override;
+
+private:
+	double target = 0.0; // fraction of host time to spend emulating
+	double error = 0.0;
+	double prev_error = 0.0;
+};
+
+std::unique_ptr<CycleController> CYCLES_CreateController(const std::string &policy,
+                                                         int target_percent);
+
+// A time series of the controller's inputs and decisions for tuning
+class CycleTelemetry {
+public:
+	struct Entry {
+		int64_t time_ms = 0;
+		int32_t cycle_max = 0;
+		int ticks_done = 0;
+		int ticks_scheduled = 0;
+		int ticks_added = 0;
+		int64_t io_delay_removed = 0;
+	};
+
+	void Record(int64_t time_ms, int32_t cycle_max, const CycleSample &sample);
+	bool WriteCsv(const std::string &path) const;
+
+	const std::vector<Entry> &GetEntries() const noexcept { return entries; }
+	void Clear() noexcept { entries.clear(); }
+
+private:
+	// Over a day of samples at the PID controller's update rate
+	static constexpr size_t max_entries = 1 << 20;
+	std::vector<Entry> entries = {};
+};
+
+#endif
@@ -50,6 +50,16 @@ void DOSBOX_RunMachine();
 void DOSBOX_SetLoop(LoopHandler * handler);
 void DOSBOX_SetNormalLoop();
 
+// Percentage of time the emulation thread has slept because the guest was
+// idle or ahead of real time
+double DOSBOX_GetIdlePercentage();
+
+// Selects how cycles=auto and max adjust the cycles, and where the
+// controller's telemetry is written as CSV on shutdown (empty to disable)
+class CycleController;
+void DOSBOX_SetCycleController(std::unique_ptr<CycleController> controller,
+                               const char *telemetry_path);
+
 void DOSBOX_Init(void);
 
 class Config;
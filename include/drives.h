@@ -162,6 +162,16 @@ struct partTable {
 #endif
 //Forward
 class imageDisk;
+
+// Remembers where a file's last cluster chain lookup ended, so sequential
+// access continues the walk instead of restarting it from the first cluster
+struct FatClusterCursor {
+	uint32_t startCluster = 0;
+	uint32_t logicalCluster = 0;
+	uint32_t cluster = 0;
+	uint32_t chainGeneration = 0;
+};
+
 class fatDrive final : public DOS_Drive {
 public:
 	fatDrive(const char * sysFilename, uint32_t bytesector, uint32_t cylsector, uint32_t headscyl, uint32_t cylinders, uint32_t startSector, bool roflag);
@@ -189,13 +199,13 @@ public:
 public:
 	uint8_t readSector(uint32_t sectnum, void * data);
 	uint8_t writeSector(uint32_t sectnum, void * data);
-	uint32_t getAbsoluteSectFromBytePos(uint32_t startClustNum, uint32_t bytePos);
+	uint32_t getAbsoluteSectFromBytePos(uint32_t startClustNum, uint32_t bytePos, FatClusterCursor *cursor = nullptr);
 	uint32_t getSectorCount();
 	uint32_t getSectorSize(void);
 	uint32_t getClusterSize(void);
-	uint32_t getAbsoluteSectFromChain(uint32_t startClustNum, uint32_t logicalSector);
+	uint32_t getAbsoluteSectFromChain(uint32_t startClustNum, uint32_t logicalSector, FatClusterCursor *cursor = nullptr);
 	bool allocateCluster(uint32_t useCluster, uint32_t prevCluster);
-	uint32_t appendCluster(uint32_t startCluster);
+	uint32_t appendCluster(uint32_t startCluster, FatClusterCursor *cursor = nullptr);
 	void deleteClustChain(uint32_t startCluster, uint32_t bytePos);
 	uint32_t getFirstFreeClust(void);
 	bool directoryBrowse(uint32_t dirClustNumber, direntry *useEntry, int32_t entNum, int32_t start=0);
@@ -205,8 +215,14 @@ public:
 	uint32_t partSectOff;
 
 private:
+	uint8_t writeRawSector(uint32_t sectnum, void * data);
+	void fatSectorWritten(uint32_t sectnum);
+	uint8_t *getFatSector(uint32_t fatsectnum);
 	uint32_t getClusterValue(uint32_t clustNum);
 	void setClusterValue(uint32_t clustNum, uint32_t clustValue);
+	void markClusterFree(uint32_t clustNum, bool isFree);
+	void buildFreeClusterMap();
+	bool isCursorValid(const FatClusterCursor *cursor, uint32_t startClustNum) const;
 	uint32_t getClustFirstSect(uint32_t clustNum);
 	bool FindNextInternal(uint32_t dirClustNumber, DOS_DTA & dta, direntry *foundEntry);
 	bool getDirClustNum(char * dir, uint32_t * clustNum, bool parDir);
@@ -225,8 +241,28 @@ private:
 
 	uint32_t cwdDirCluster;
 
-	uint8_t fatSectBuffer[1024];
-	uint32_t curFatSect;
+	// Least recently used FAT sectors. Each entry holds two sectors so
+	// FAT12 entries that straddle a sector boundary can be read in one go.
+	static constexpr int fatCacheEntries = 32;
+	struct FatSectorCacheEntry {
+		uint32_t sector = UINT32_MAX;
+		uint32_t lastUsed = 0;
+		uint8_t data[1024] = {};
+	};
+	std::vector<FatSectorCacheEntry> fatSectorCache;
+	FatSectorCacheEntry *lastFatSector;
+	uint32_t fatCacheTick;
+
+	// Bumped whenever clusters are released or the FAT is written
+	// directly, either of which may break cursors
+	uint32_t chainGeneration;
+
+	// One bit per data cluster, set when the cluster is free. Built at
+	// mount and kept in sync by setClusterValue and direct FAT writes. No
+	// cluster below the hint is free.
+	std::vector<uint64_t> freeClusterMap;
+	uint32_t freeClusterCount;
+	uint32_t freeClusterHint;
 };
 
 class cdromDrive final : public localDrive
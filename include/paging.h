@@ -196,6 +196,11 @@ bool mem_unalignedwrited_checked(PhysPt address,uint32_t val);
 
 #if defined(USE_FULL_TLB)
 
+// A null handler in the full TLB stands for this one, which links the page
+// on first access. The TLB is then never filled in as a whole: untouched
+// entries stay zero and their memory is never made resident.
+extern PageHandler *const paging_init_page_handler;
+
 static inline HostPt get_tlb_read(PhysPt address) {
 	return paging.tlb.read[address>>12];
 }
@@ -203,10 +208,12 @@ static inline HostPt get_tlb_write(PhysPt address) {
 	return paging.tlb.write[address>>12];
 }
 static inline PageHandler* get_tlb_readhandler(PhysPt address) {
-	return paging.tlb.readhandler[address>>12];
+	PageHandler *handler = paging.tlb.readhandler[address >> 12];
+	return GCC_LIKELY(handler) ? handler : paging_init_page_handler;
 }
 static inline PageHandler* get_tlb_writehandler(PhysPt address) {
-	return paging.tlb.writehandler[address>>12];
+	PageHandler *handler = paging.tlb.writehandler[address >> 12];
+	return GCC_LIKELY(handler) ? handler : paging_init_page_handler;
 }
 
 /* Use these helper functions to access linear addresses in readX/writeX functions */
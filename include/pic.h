@@ -68,8 +68,16 @@ void PIC_DeActivateIRQ(uint8_t irq);
 void PIC_runIRQs();
 bool PIC_RunQueue();
 
+// Identifies a scheduled event, so it can be removed without searching
+// the queue. Handles of events that already ran or were removed are ignored.
+struct PIC_EventHandle {
+	uint32_t slot = 0;
+	uint32_t generation = 0;
+};
+
 //Delay in milliseconds
-void PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val = 0);
+PIC_EventHandle PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val = 0);
+void PIC_RemoveEvent(PIC_EventHandle handle);
 void PIC_RemoveEvents(PIC_EventHandler handler);
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, uint32_t val);
 
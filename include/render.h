@@ -78,6 +78,7 @@ struct Render_t {
 		ScalerLineHandler_t lineHandler = nullptr;
 		ScalerLineHandler_t linePalHandler = nullptr;
 		ScalerComplexHandler_t complexHandler = nullptr;
+		bool parallel = false;
 		uint32_t blocks = 0;
 		uint32_t lastBlock = 0;
 		int outPitch = 0;
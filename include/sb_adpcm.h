@@ -0,0 +1,52 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SB_ADPCM_H
+#define DOSBOX_SB_ADPCM_H
+
+#include <cstdint>
+
+// Creative's ADPCM formats played by the Sound Blaster DSP. Each encoded
+// byte expands to 4, 3 or 2 unsigned 8-bit samples respectively.
+enum class AdpcmFormat { TwoBit, ThreeBit, FourBit };
+
+constexpr uint32_t ADPCM_SamplesPerByte(const AdpcmFormat format)
+{
+	switch (format) {
+	case AdpcmFormat::TwoBit: return 4;
+	case AdpcmFormat::ThreeBit: return 3;
+	case AdpcmFormat::FourBit: return 2;
+	}
+	return 0;
+}
+
+// Carried across DMA chunks; a reference byte resets it
+struct AdpcmState {
+	uint8_t reference = 0;
+	uint16_t stepsize = 0;
+};
+
+// Decodes num_bytes of encoded data into out, which needs room for
+// num_bytes * ADPCM_SamplesPerByte(format) samples. Returns the number of
+// samples written.
+uint32_t ADPCM_Decode(AdpcmFormat format, AdpcmState &state, const uint8_t *in,
+                      uint32_t num_bytes, uint8_t *out);
+
+#endif
@@ -24,6 +24,7 @@
 #include <string>
 #include <string_view>
 #include <string.h>
+#include <vector>
 #include "SDL.h"
 #if C_OPENGL
 #include <SDL_opengl.h>
@@ -37,10 +38,10 @@
 // Texture buffer and presentation functions and type-defines
 using update_frame_buffer_f = void(const uint16_t *);
 using present_frame_f = bool();
-static void update_frame_texture([[maybe_unused]] const uint16_t *changedLines);
+static void update_frame_texture(const uint16_t *changedLines);
 static bool present_frame_texture();
 #if C_OPENGL
-static void update_frame_gl_pbo([[maybe_unused]] const uint16_t *changedLines);
+static void update_frame_gl_pbo(const uint16_t *changedLines);
 static void update_frame_gl_fb(const uint16_t *changedLines);
 static bool present_frame_gl();
 #endif
@@ -58,6 +59,7 @@ enum MouseControlType {
 enum SCREEN_TYPES	{
 	SCREEN_SURFACE,
 	SCREEN_TEXTURE,
+	SCREEN_NONE, // headless: no window, frames only kept for captures
 #if C_OPENGL
 	SCREEN_OPENGL
 #endif
@@ -217,6 +219,10 @@ struct SDL_Block {
 		SDL_Texture *texture = nullptr;
 		SDL_PixelFormat *pixelFormat = nullptr;
 	} texture = {};
+	struct {
+		std::vector<uint8_t> framebuf = {};
+		int pitch = 0;
+	} headless = {};
 	struct {
 		present_frame_f *present = present_frame_noop;
 		update_frame_buffer_f *update = update_frame_noop;
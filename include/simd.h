@@ -0,0 +1,84 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SIMD_H
+#define DOSBOX_SIMD_H
+
+/* Host SIMD support
+ *
+ * SSE2 is part of the x86-64 baseline and NEON is part of the AArch64
+ * baseline, so code for those can be compiled in unconditionally when the
+ * defines below are set.
+ *
+ * AVX2 is optional even on current x86-64 CPUs, so AVX2 code must live in
+ * functions marked with SIMD_TARGET_AVX2 and only be called after checking
+ * host_has_avx2() at runtime.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+        (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(HAS_SSE2) && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define HAS_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define HAS_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Returns true if the host CPU and operating system can run AVX2 code.
+inline bool host_has_avx2() noexcept
+{
+#if defined(HAS_AVX2) && defined(_MSC_VER) && !defined(__clang__)
+	static const bool has_avx2 = []() {
+		int regs[4] = {};
+		__cpuid(regs, 1);
+		constexpr int osxsave_bit = 1 << 27;
+		constexpr int avx_bit = 1 << 28;
+		if ((regs[2] & (osxsave_bit | avx_bit)) != (osxsave_bit | avx_bit))
+			return false;
+		// The OS must save the upper halves of the YMM registers
+		if ((_xgetbv(0) & 0x6) != 0x6)
+			return false;
+		__cpuidex(regs, 7, 0);
+		constexpr int avx2_bit = 1 << 5;
+		return (regs[1] & avx2_bit) != 0;
+	}();
+	return has_avx2;
+#elif defined(HAS_AVX2)
+	static const bool has_avx2 = __builtin_cpu_supports("avx2");
+	return has_avx2;
+#else
+	return false;
+#endif
+}
+
+#endif
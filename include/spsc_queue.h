@@ -0,0 +1,289 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SPSC_QUEUE_H
+#define DOSBOX_SPSC_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// A bounded queue between exactly one producer thread and one consumer
+// thread. Unlike RWQueue, items are passed through a ring without taking a
+// lock:
+//
+//  - The Try* functions never wait for the other side and never allocate,
+//    so they're safe to call from the emulation and audio threads. They
+//    only take the mutex, briefly, to wake the other side if it's asleep.
+//  - The Write and Read functions wait for room or items when the ring is
+//    full or empty, and return early once Stop() is called.
+//
+// Items are moved in and out, so buffers they own can be handed between the
+// threads without being reallocated.
+//
+template <typename T>
+class SpscQueue {
+public:
+	SpscQueue() = delete;
+	SpscQueue(const SpscQueue<T> &other) = delete;
+	SpscQueue<T> &operator=(const SpscQueue<T> &other) = delete;
+
+	SpscQueue(size_t queue_capacity);
+
+	size_t Size() const noexcept;
+	size_t MaxCapacity() const noexcept { return capacity; }
+	bool IsEmpty() const noexcept { return Size() == 0; }
+
+	// Producer side
+	bool TryEnqueue(T &&item);
+	size_t TryWrite(const T *items, size_t num_items);
+	size_t Write(const T *items, size_t num_items);
+
+	// Consumer side
+	bool TryDequeue(T &item);
+	size_t TryRead(T *items, size_t num_items);
+	size_t Read(T *items, size_t num_items);
+
+	// Wakes up and releases waiting threads, and makes later Write and
+	// Read calls return without waiting. Start() re-arms the queue.
+	void Stop();
+	void Start() noexcept { is_running = true; }
+	bool IsRunning() const noexcept { return is_running; }
+
+	// Discards the queued items; neither side may be using the queue
+	void Clear() noexcept;
+
+private:
+	static constexpr size_t RingSize(const size_t capacity) noexcept
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		return size;
+	}
+	size_t Wrap(const size_t index) const noexcept { return index & mask; }
+	size_t FreeRoom() const noexcept;
+	void WaitForRoom(size_t num_items);
+	void WaitForItems(size_t num_items);
+	void Notify(std::condition_variable &condition,
+	            const std::atomic<size_t> &num_wanted,
+	            size_t num_available);
+
+	std::vector<T> ring;
+	const size_t capacity;
+	const size_t mask;
+
+	// The positions only ever increase, and each side keeps the other's
+	// last seen position to avoid touching its cache line on every call
+	alignas(64) std::atomic<size_t> head = {0}; // written by the consumer
+	size_t cached_tail = 0;
+	alignas(64) std::atomic<size_t> tail = {0}; // written by the producer
+	size_t cached_head = 0;
+
+	alignas(64) std::mutex mutex = {};
+	std::condition_variable has_room = {};
+	std::condition_variable has_items = {};
+	// How much room or how many items a waiting side needs, or zero
+	std::atomic<size_t> producer_wants = {0};
+	std::atomic<size_t> consumer_wants = {0};
+	std::atomic_bool is_running = {true};
+};
+
+template <typename T>
+SpscQueue<T>::SpscQueue(const size_t queue_capacity)
+        : ring(RingSize(queue_capacity)),
+          capacity(queue_capacity),
+          mask(RingSize(queue_capacity) - 1)
+{
+	assert(capacity > 0);
+}
+
+template <typename T>
+size_t SpscQueue<T>::Size() const noexcept
+{
+	const auto current_tail = tail.load(std::memory_order_acquire);
+	const auto current_head = head.load(std::memory_order_acquire);
+	return current_tail - current_head;
+}
+
+template <typename T>
+bool SpscQueue<T>::TryEnqueue(T &&item)
+{
+	const auto current_tail = tail.load(std::memory_order_relaxed);
+	if (current_tail - cached_head >= capacity) {
+		cached_head = head.load(std::memory_order_acquire);
+		if (current_tail - cached_head >= capacity)
+			return false;
+	}
+	ring[Wrap(current_tail)] = std::move(item);
+	tail.store(current_tail + 1, std::memory_order_seq_cst);
+	Notify(has_items, consumer_wants, Size());
+	return true;
+}
+
+template <typename T>
+size_t SpscQueue<T>::TryWrite(const T *items, const size_t num_items)
+{
+	const auto current_tail = tail.load(std::memory_order_relaxed);
+	if (current_tail - cached_head + num_items > capacity)
+		cached_head = head.load(std::memory_order_acquire);
+	const auto num = std::min(num_items, capacity - (current_tail - cached_head));
+	if (num == 0)
+		return 0;
+
+	// Copy in up to two pieces, either side of the end of the ring
+	const auto start = Wrap(current_tail);
+	const auto first = std::min(num, ring.size() - start);
+	std::copy_n(items, first, ring.begin() + static_cast<ptrdiff_t>(start));
+	std::copy_n(items + first, num - first, ring.begin());
+
+	tail.store(current_tail + num, std::memory_order_seq_cst);
+	Notify(has_items, consumer_wants, Size());
+	return num;
+}
+
+template <typename T>
+size_t SpscQueue<T>::Write(const T *items, const size_t num_items)
+{
+	auto written = TryWrite(items, num_items);
+	while (written < num_items && is_running) {
+		WaitForRoom(num_items - written);
+		written += TryWrite(items + written, num_items - written);
+	}
+	return written;
+}
+
+template <typename T>
+bool SpscQueue<T>::TryDequeue(T &item)
+{
+	const auto current_head = head.load(std::memory_order_relaxed);
+	if (current_head == cached_tail) {
+		cached_tail = tail.load(std::memory_order_acquire);
+		if (current_head == cached_tail)
+			return false;
+	}
+	item = std::move(ring[Wrap(current_head)]);
+	head.store(current_head + 1, std::memory_order_seq_cst);
+	Notify(has_room, producer_wants, FreeRoom());
+	return true;
+}
+
+template <typename T>
+size_t SpscQueue<T>::TryRead(T *items, const size_t num_items)
+{
+	const auto current_head = head.load(std::memory_order_relaxed);
+	if (cached_tail - current_head < num_items)
+		cached_tail = tail.load(std::memory_order_acquire);
+	const auto num = std::min(num_items, cached_tail - current_head);
+	if (num == 0)
+		return 0;
+
+	const auto start = Wrap(current_head);
+	const auto first = std::min(num, ring.size() - start);
+	const auto ring_start = ring.begin() + static_cast<ptrdiff_t>(start);
+	std::copy_n(ring_start, first, items);
+	std::copy_n(ring.begin(), num - first, items + first);
+
+	head.store(current_head + num, std::memory_order_seq_cst);
+	Notify(has_room, producer_wants, FreeRoom());
+	return num;
+}
+
+template <typename T>
+size_t SpscQueue<T>::Read(T *items, const size_t num_items)
+{
+	auto read = TryRead(items, num_items);
+	while (read < num_items && is_running) {
+		WaitForItems(num_items - read);
+		read += TryRead(items + read, num_items - read);
+	}
+	return read;
+}
+
+template <typename T>
+size_t SpscQueue<T>::FreeRoom() const noexcept
+{
+	return capacity - Size();
+}
+
+// A waiting side publishes what it needs before checking the ring again, and
+// the other side checks for that after moving its position. With both done in
+// sequentially consistent order, either the waiter sees the new position or
+// the other side sees the request and wakes it up under the mutex. Waiting
+// for all of what's needed, rather than for any change, avoids waking up
+// after every small read or write.
+template <typename T>
+void SpscQueue<T>::WaitForRoom(const size_t num_items)
+{
+	const auto wanted = std::min(num_items, capacity);
+	std::unique_lock<std::mutex> lock(mutex);
+	producer_wants.store(wanted, std::memory_order_seq_cst);
+	has_room.wait(lock, [&] { return !is_running || FreeRoom() >= wanted; });
+	producer_wants.store(0, std::memory_order_relaxed);
+}
+
+template <typename T>
+void SpscQueue<T>::WaitForItems(const size_t num_items)
+{
+	const auto wanted = std::min(num_items, capacity);
+	std::unique_lock<std::mutex> lock(mutex);
+	consumer_wants.store(wanted, std::memory_order_seq_cst);
+	has_items.wait(lock, [&] { return !is_running || Size() >= wanted; });
+	consumer_wants.store(0, std::memory_order_relaxed);
+}
+
+template <typename T>
+void SpscQueue<T>::Notify(std::condition_variable &condition,
+                          const std::atomic<size_t> &num_wanted,
+                          const size_t num_available)
+{
+	const auto wanted = num_wanted.load(std::memory_order_seq_cst);
+	if (!wanted || num_available < wanted)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	condition.notify_one();
+}
+
+template <typename T>
+void SpscQueue<T>::Stop()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	is_running = false;
+	has_room.notify_all();
+	has_items.notify_all();
+}
+
+template <typename T>
+void SpscQueue<T>::Clear() noexcept
+{
+	const auto current_tail = tail.load();
+	while (head.load() != current_tail) {
+		ring[Wrap(head.load())] = T{};
+		head.store(head.load() + 1);
+	}
+	cached_head = current_tail;
+	cached_tail = current_tail;
+}
+
+#endif
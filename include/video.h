@@ -82,6 +82,10 @@ void GFX_UpdateMouseState();
 void GFX_LosingFocus();
 void GFX_RegenerateWindow(Section *sec);
 
+// True when output=none: nothing is presented and the render pipeline only
+// needs to produce frames that are being captured.
+bool GFX_IsHeadless();
+
 #if defined (REDUCE_JOYSTICK_POLLING)
 void MAPPER_UpdateJoysticks(void);
 #endif
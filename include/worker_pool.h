@@ -0,0 +1,68 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_WORKER_POOL_H
+#define DOSBOX_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run batches of independent jobs.
+//
+// Run() calls job(0) .. job(num_jobs - 1) spread across the workers and the
+// calling thread, and only returns once every job has finished. Jobs must
+// not call Run() on the same pool.
+class WorkerPool {
+public:
+	using job_f = std::function<void(int job_index)>;
+
+	// num_threads counts the calling thread, so a pool of one thread runs
+	// all jobs serially without starting any workers
+	explicit WorkerPool(int num_threads);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	void Run(int num_jobs, const job_f &job);
+	int NumThreads() const { return static_cast<int>(workers.size()) + 1; }
+
+private:
+	void WorkerLoop();
+	void RunJobs(const job_f &job, int jobs);
+
+	std::vector<std::thread> workers = {};
+	std::mutex mutex = {};
+	std::condition_variable has_work = {};
+	std::condition_variable work_done = {};
+
+	const job_f *current_job = nullptr;
+	int num_jobs = 0;
+	std::atomic<int> next_job = 0;
+	int busy_workers = 0;
+	uint64_t generation = 0;
+	bool is_stopping = false;
+};
+
+#endif
@@ -50,9 +50,8 @@
 #include "fpu.h"
 
 #define CACHE_MAXSIZE	(4096*3)
-#define CACHE_TOTAL		(1024*1024*8)
-#define CACHE_PAGES		(512)
-#define CACHE_BLOCKS	(64*1024)
+#define CACHE_PAGES_PER_MB	(64)
+#define CACHE_BLOCKS_PER_MB	(8*1024)
 #define CACHE_ALIGN		(16)
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
@@ -277,6 +276,15 @@ restart_core:
 	if (!chandler) {
 		return CPU_Core_Normal_Run();
 	}
+	/* Let the normal core run pages whose code is rewritten too often */
+	if (GCC_UNLIKELY(chandler->IsVolatile())) {
+		// manually save
+		fpu_saver = auto_dh_fpu();
+		Bits nc_retcode = CBRET_NONE;
+		if (cache_run_volatile_slice(chandler, nc_retcode))
+			return nc_retcode;
+		goto restart_core;
+	}
 	/* Find correct Dynamic Block to run */
 	CacheBlock * block=chandler->FindCacheBlock(ip_point&4095);
 	if (!block) {
@@ -451,8 +459,9 @@ void CPU_Core_Dyn_X86_Init(void) {
 	return;
 }
 
-void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache) {
+void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache, int cache_size_mb) {
 	/* Initialize code cache and dynamic blocks */
+	cache_set_size(cache_size_mb);
 	cache_init(enable_cache);
 }
 
@@ -51,9 +51,8 @@
 #include "pic.h"
 
 #define CACHE_MAXSIZE	(4096*2)
-#define CACHE_TOTAL		(1024*1024*8)
-#define CACHE_PAGES		(512)
-#define CACHE_BLOCKS	(128*1024)
+#define CACHE_PAGES_PER_MB	(64)
+#define CACHE_BLOCKS_PER_MB	(16*1024)
 #define CACHE_ALIGN		(16)
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
@@ -227,6 +226,15 @@ Bits CPU_Core_Dynrec_Run(void) {
 		// page doesn't contain code or is special
 		if (GCC_UNLIKELY(!chandler)) return CPU_Core_Normal_Run();
 
+		// the code in this page is rewritten too often to be worth
+		// translating, let the normal core run it for a while
+		if (GCC_UNLIKELY(chandler->IsVolatile())) {
+			Bits nc_retcode = CBRET_NONE;
+			if (cache_run_volatile_slice(chandler, nc_retcode))
+				return nc_retcode;
+			continue;
+		}
+
 		// find correct Dynamic Block to run
 		CacheBlock *block = chandler->FindCacheBlock(ip_point & 4095);
 		if (!block) {
@@ -353,8 +361,9 @@ Bits CPU_Core_Dynrec_Trap_Run(void) {
 void CPU_Core_Dynrec_Init(void) {
 }
 
-void CPU_Core_Dynrec_Cache_Init(bool enable_cache) {
+void CPU_Core_Dynrec_Cache_Init(bool enable_cache, int cache_size_mb) {
 	// Initialize code cache and dynamic blocks
+	cache_set_size(cache_size_mb);
 	cache_init(enable_cache);
 }
 
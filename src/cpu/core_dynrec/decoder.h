@@ -55,6 +55,12 @@ static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bit
 	// so the block linking knows the last executed block
 	gen_mov_direct_ptr(&cache.block.running,(Bitu)decode.block);
 
+#if DYN_CACHE_PROFILE
+	cache_profile_translated(decode.block, static_cast<PhysPt>(
+	        (codepage->GetPhysPage() << 12) | decode.page.index));
+	gen_add_direct_word(&decode.block->profile.hits, 1, true);
+#endif
+
 	// start with the cycles check
 	gen_mov_word_to_reg(FC_RETOP,&CPU_Cycles,true);
 	save_info_dynrec[used_save_info_dynrec].branch_pos=gen_create_branch_long_leqzero(FC_RETOP);
@@ -27,7 +27,9 @@
 #include "mapper.h"
 #include "setup.h"
 #include "programs.h"
+#include "cycle_controller.h"
 #include "paging.h"
+#include "pic.h"
 #include "lazyflags.h"
 #include "support.h"
 
@@ -59,6 +61,8 @@ int64_t CPU_IODelayRemoved = 0;
 CPU_Decoder * cpudecoder;
 bool CPU_CycleAutoAdjust = false;
 bool CPU_SkipCycleAutoAdjust = false;
+bool CPU_IdlePolling = false;
+bool CPU_GuestIdled = false;
 bool CPU_AllowSpeedMods = false;
 Bitu CPU_AutoDetermineMode = 0;
 
@@ -73,12 +77,12 @@ void CPU_Core_Normal_Init(void);
 void CPU_Core_Simple_Init(void);
 #if (C_DYNAMIC_X86)
 void CPU_Core_Dyn_X86_Init(void);
-void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache);
+void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache, int cache_size_mb);
 void CPU_Core_Dyn_X86_Cache_Close(void);
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu);
 #elif (C_DYNREC)
 void CPU_Core_Dynrec_Init(void);
-void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
+void CPU_Core_Dynrec_Cache_Init(bool enable_cache, int cache_size_mb);
 void CPU_Core_Dynrec_Cache_Close(void);
 #endif
 
@@ -1590,12 +1594,12 @@ void CPU_SET_CRX(Bitu cr,Bitu value) {
 				}
 #if (C_DYNAMIC_X86)
 				if (CPU_AutoDetermineMode&CPU_AUTODETERMINE_CORE) {
-					CPU_Core_Dyn_X86_Cache_Init(true);
+					CPU_Core_Dyn_X86_Cache_Init(true, 0); // configured size
 					cpudecoder=&CPU_Core_Dyn_X86_Run;
 				}
 #elif (C_DYNREC)
 				if (CPU_AutoDetermineMode&CPU_AUTODETERMINE_CORE) {
-					CPU_Core_Dynrec_Cache_Init(true);
+					CPU_Core_Dynrec_Cache_Init(true, 0); // configured size
 					cpudecoder=&CPU_Core_Dynrec_Run;
 				}
 #endif
@@ -2056,21 +2060,44 @@ bool CPU_CPUID(void) {
 	return true;
 }
 
+void CPU_Idle()
+{
+	// The skipped cycles don't count as used for the auto cycle adjustment
+	CPU_IODelayRemoved += CPU_Cycles;
+	CPU_Cycles = 0;
+	CPU_GuestIdled = true;
+}
+
+void CPU_IdlePoll()
+{
+	// Polls this many times within one tick are a busy-wait for input
+	constexpr int idle_poll_threshold = 16;
+	static uint32_t poll_tick = 0;
+	static int polls = 0;
+
+	if (!CPU_IdlePolling)
+		return;
+	if (poll_tick != PIC_Ticks) {
+		poll_tick = PIC_Ticks;
+		polls = 0;
+	}
+	if (++polls >= idle_poll_threshold)
+		CPU_Idle();
+}
+
 static Bits HLT_Decode(void) {
 	/* Once an interrupt occurs, it should change cpu core */
 	if (reg_eip!=cpu.hlt.eip || SegValue(cs) != cpu.hlt.cs) {
 		cpudecoder=cpu.hlt.old_decoder;
 	} else {
-		CPU_IODelayRemoved += CPU_Cycles;
-		CPU_Cycles=0;
+		CPU_Idle();
 	}
 	return 0;
 }
 
 void CPU_HLT(Bitu oldeip) {
 	reg_eip=oldeip;
-	CPU_IODelayRemoved += CPU_Cycles;
-	CPU_Cycles=0;
+	CPU_Idle();
 	cpu.hlt.cs=SegValue(cs);
 	cpu.hlt.eip=reg_eip;
 	cpu.hlt.old_decoder=cpudecoder;
@@ -2334,6 +2361,11 @@ public:
 
 		CPU_CycleUp=section->Get_int("cycleup");
 		CPU_CycleDown=section->Get_int("cycledown");
+		CPU_IdlePolling = section->Get_bool("idle_polling");
+		DOSBOX_SetCycleController(
+		        CYCLES_CreateController(section->Get_string("cycle_controller"),
+		                                section->Get_int("cycle_target")),
+		        section->Get_path("cycle_telemetry")->realpath.c_str());
 		std::string core(section->Get_string("core"));
 		cpudecoder=&CPU_Core_Normal_Run;
 		if (core == "normal") {
@@ -2364,9 +2396,11 @@ public:
 		}
 
 #if (C_DYNAMIC_X86)
-		CPU_Core_Dyn_X86_Cache_Init((core == "dynamic") || (core == "dynamic_nodhfpu"));
+		CPU_Core_Dyn_X86_Cache_Init((core == "dynamic") || (core == "dynamic_nodhfpu"),
+		                            section->Get_int("dynamic_cache"));
 #elif (C_DYNREC)
-		CPU_Core_Dynrec_Cache_Init( core == "dynamic" );
+		CPU_Core_Dynrec_Cache_Init(core == "dynamic",
+		                           section->Get_int("dynamic_cache"));
 #endif
 
 		CPU_ArchitectureType = CPU_ARCHTYPE_MIXED;
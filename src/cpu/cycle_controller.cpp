@@ -0,0 +1,188 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cycle_controller.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+
+#include "cross.h"
+
+bool LegacyCycleController::Update(const CycleSample &sample, int32_t &cycle_max)
+{
+	const auto ticks_added = sample.ticks_added;
+	const auto ticks_scheduled = sample.ticks_scheduled;
+	const auto ticks_done = std::max(sample.ticks_done, 1); // protect against div by zero
+
+	if (ticks_scheduled >= 250 || sample.ticks_done >= 250 ||
+	    (ticks_added > 15 && ticks_scheduled >= 5)) {
+		/* ratio we are aiming for is around 90% usage*/
+		int32_t ratio = (ticks_scheduled * (sample.percent_used * 90 * 1024 / 100 / 100)) /
+		                ticks_done;
+		int32_t new_cmax = cycle_max;
+		int64_t cproc = (int64_t)cycle_max * (int64_t)ticks_scheduled;
+		if (cproc > 0) {
+			/* ignore the cycles added due to the IO delay code in order
+			   to have smoother auto cycle adjustments */
+			const double ratioremoved = (double)sample.io_delay_removed /
+			                            (double)cproc;
+			if (ratioremoved < 1.0) {
+				double ratio_not_removed = 1 - ratioremoved;
+				ratio = (int32_t)((double)ratio * ratio_not_removed);
+
+				/* Don't allow very high ratio which can cause us to lock as we don't scale down
+				 * for very low ratios. High ratio might result because of timing resolution */
+				if (ticks_scheduled >= 250 && ticks_done < 10 && ratio > 16384)
+					ratio = 16384;
+
+				// Limit the ratio even more when the cycles are already way above the realmode default.
+				if (ticks_scheduled >= 250 && ticks_done < 10 && ratio > 5120 && cycle_max > 50000)
+					ratio = 5120;
+
+				// When downscaling multiple times in a row, ensure a minimum amount of downscaling
+				if (ticks_added > 15 && ticks_scheduled >= 5 && ticks_scheduled <= 20 && ratio > 800)
+					ratio = 800;
+
+				if (ratio <= 1024) {
+					// ratio_not_removed = 1.0; //enabling this restores the old formula
+					double r = (1.0 + ratio_not_removed) /(ratio_not_removed + 1024.0/(static_cast<double>(ratio)));
+					new_cmax = 1 + static_cast<int32_t>(cycle_max * r);
+				} else {
+					int64_t ratio_with_removed = (int64_t) ((((double)ratio - 1024.0) * ratio_not_removed) + 1024.0);
+					int64_t cmax_scaled = (int64_t)cycle_max * ratio_with_removed;
+					new_cmax = (int32_t)(1 + (cycle_max >> 1) + cmax_scaled / (int64_t)2048);
+				}
+			}
+		}
+
+		/* ratios below 1% are considered to be dropouts due to
+		   temporary load imbalance, the cycles adjusting is skipped */
+		if (ratio > 10) {
+			/* ratios below 12% along with a large time since the last update
+			   has taken place are most likely caused by heavy load through a
+			   different application, the cycles adjusting is skipped as well */
+			if ((ratio > 120) || (ticks_done < 700))
+				cycle_max = new_cmax;
+		}
+		return true;
+	}
+	if (ticks_added > 15) {
+		/* ticksAdded > 15 but ticksScheduled < 5, lower the cycles
+		   but do not reset the scheduled/done ticks to take them into
+		   account during the next auto cycle adjustment */
+		cycle_max /= 3;
+	}
+	return false;
+}
+
+// Measurement window; long enough for the millisecond host timer to give a
+// usable ratio, short enough to react within a few video frames
+constexpr int pid_window_ms = 100;
+
+// Gains tuned on a simulated host with 10% measurement noise, where they
+// settle within a dozen windows and halve the jitter of a single-step
+// ratio correction
+constexpr double pid_kp = 0.15;
+constexpr double pid_ki = 0.3;
+constexpr double pid_kd = 0.02;
+
+// Per-window limits on the change, as ratios of the current cycles
+const double pid_max_decrease = std::log(1.0 / 3.0);
+const double pid_max_increase = std::log(2.0);
+
+PidCycleController::PidCycleController(const int target_percent)
+        : target(target_percent / 100.0)
+{
+	assert(target_percent > 0 && target_percent <= 100);
+}
+
+bool PidCycleController::Update(const CycleSample &sample, int32_t &cycle_max)
+{
+	// Falling behind real time by more than a few milliseconds calls for
+	// a correction without waiting for a full window
+	const bool is_lagging = sample.ticks_added > 15 && sample.ticks_scheduled >= 5;
+	if (!is_lagging && sample.ticks_scheduled < pid_window_ms &&
+	    sample.ticks_done < pid_window_ms)
+		return false;
+	if (sample.ticks_scheduled <= 0)
+		return false;
+
+	// Cycles=max starts from zero and leaves the limits to the caller
+	const auto current_cycles = std::max(cycle_max, 1);
+
+	// Host time spent per emulated millisecond, projected to what it would
+	// be if the cycles skipped for I/O delays and idling had been run
+	const double host_per_emulated = std::max(sample.ticks_done, 1) /
+	                                 static_cast<double>(sample.ticks_scheduled);
+	const double cycles_run = static_cast<double>(current_cycles) *
+	                          sample.ticks_scheduled;
+	const double removed = std::clamp(sample.io_delay_removed / cycles_run, 0.0, 0.95);
+	const double usage = std::max(host_per_emulated / (1.0 - removed), 0.001);
+
+	const double setpoint = target * sample.percent_used / 100.0;
+	const double new_error = std::log(setpoint / usage);
+
+	// Incremental form: the cycles themselves carry the integral
+	const double delta = pid_kp * (new_error - error) + pid_ki * new_error +
+	                     pid_kd * (new_error - 2.0 * error + prev_error);
+	prev_error = error;
+	error = new_error;
+
+	const double step = std::clamp(delta, pid_max_decrease, pid_max_increase);
+	const double new_cycles = std::round(current_cycles * std::exp(step));
+	cycle_max = static_cast<int32_t>(std::clamp(new_cycles, 1.0, double{INT32_MAX}));
+	return true;
+}
+
+std::unique_ptr<CycleController> CYCLES_CreateController(const std::string &policy,
+                                                         const int target_percent)
+{
+	if (policy == "pid")
+		return std::make_unique<PidCycleController>(target_percent);
+	return std::make_unique<LegacyCycleController>();
+}
+
+void CycleTelemetry::Record(const int64_t time_ms,
+                            const int32_t cycle_max,
+                            const CycleSample &sample)
+{
+	if (entries.size() >= max_entries)
+		return;
+	entries.push_back({time_ms, cycle_max, sample.ticks_done,
+	                   sample.ticks_scheduled, sample.ticks_added,
+	                   sample.io_delay_removed});
+}
+
+bool CycleTelemetry::WriteCsv(const std::string &path) const
+{
+	FILE *file = fopen_wrap(path.c_str(), "w");
+	if (!file)
+		return false;
+	fprintf(file, "time_ms,cycle_max,ticks_done,ticks_scheduled,ticks_added,io_delay_removed\n");
+	for (const auto &e : entries)
+		fprintf(file, "%" PRId64 ",%d,%d,%d,%d,%" PRId64 "\n", e.time_ms,
+		        e.cycle_max, e.ticks_done, e.ticks_scheduled,
+		        e.ticks_added, e.io_delay_removed);
+	const bool written = !ferror(file);
+	return (fclose(file) == 0) && written;
+}
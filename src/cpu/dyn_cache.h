@@ -19,19 +19,28 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <algorithm>
 #include <cerrno>
 #include <cassert>
 #include <array>
 #include <new>
+#include <unordered_map>
+#include <vector>
 
 #include "mem_unaligned.h"
 #include "paging.h"
+#include "pic.h"
 #include "types.h"
 
 #if defined(HAVE_MMAP)
 #include <sys/mman.h>
 #endif
 
+// Per-block profiling is only wired into the recompiler core
+#if (C_DYNREC) && (C_DYNREC_PROFILE)
+#define DYN_CACHE_PROFILE 1
+#endif
+
 #if defined(HAVE_PTHREAD_WRITE_PROTECT_NP)
 #include <pthread.h>
 #endif
@@ -47,6 +56,31 @@
 
 class CodePageHandler;
 
+// Pages whose code is overwritten more than this many times within the
+// window are considered volatile: they are run by the normal core instead of
+// being translated over and over, until the cooldown expires. Both durations
+// are in emulated milliseconds (PIC_Ticks), not host time.
+constexpr uint32_t smc_window_ms = 1000;
+constexpr uint32_t smc_volatile_writes = 64;
+constexpr uint32_t smc_volatile_cooldown_ms = 5000;
+
+// how many cycles of a volatile page the normal core runs at a time
+constexpr int32_t smc_volatile_slice = 64;
+
+// self-modifying code statistics of a physical page, kept across the
+// releases and reuses of the page's CodePageHandler
+struct CodePageStats {
+	uint32_t window_start = 0;  // PIC_Ticks when the current window began
+	uint32_t window_writes = 0; // code overwrites in the current window
+	uint32_t volatile_until = 0; // PIC_Ticks when the page can be translated again
+	uint32_t times_volatile = 0;
+	uint64_t invalidating_writes = 0;
+	uint64_t interpreted_slices = 0;
+	uint64_t halted_slices = 0; // interpreted slices that ended in HLT or idle
+};
+
+static std::unordered_map<Bitu, CodePageStats> cache_page_stats = {};
+
 // basic cache block representation
 class CacheBlock {
 public:
@@ -98,6 +132,13 @@ public:
 	} link[2];                // maximum two links (conditional jumps)
 
 	CacheBlock *crossblock;
+
+#if DYN_CACHE_PROFILE
+	struct {
+		uint32_t hits; // incremented by the translated code on entry
+		PhysPt phys;   // physical address of the first guest instruction
+	} profile;
+#endif
 };
 
 static struct {
@@ -126,9 +167,43 @@ static uint8_t *cache_code_start_ptr = nullptr;
 static uint8_t *cache_code = nullptr;
 static uint8_t *cache_code_link_blocks = nullptr;
 
-static std::array<CacheBlock, CACHE_BLOCKS> cache_blocks = {};
+// code cache dimensions, sized from the [cpu] dynamic_cache setting before
+// the cache is first initialized
+constexpr size_t cache_default_mb = 8;
+
+static struct {
+	size_t total = cache_default_mb * 1024 * 1024; // bytes of code
+	size_t blocks = CACHE_BLOCKS_PER_MB * cache_default_mb;
+	size_t pages = CACHE_PAGES_PER_MB * cache_default_mb;
+} cache_size;
+
+// counters to help tuning the cache size, reported on shutdown
+static struct {
+	uint64_t fills = 0;         // times the cache filled up and restarted
+	uint64_t evictions = 0;     // blocks cleared to make room for new code
+	uint64_t invalidations = 0; // blocks cleared by self-modifying code
+} cache_stats;
+
+static std::vector<CacheBlock> cache_blocks = {};
 static CacheBlock link_blocks[2]; // default linking (specially marked)
 
+#if DYN_CACHE_PROFILE
+// execution profile of the guest code translated at a physical address,
+// accumulated over every translation of it
+struct CacheBlockProfile {
+	uint16_t cs = 0;
+	uint32_t eip = 0;
+	uint16_t size = 0;
+	uint64_t hits = 0;
+	uint32_t translations = 0;
+	uint32_t invalidations = 0;
+};
+
+static std::unordered_map<PhysPt, CacheBlockProfile> cache_profile = {};
+
+static void cache_profile_invalidated(const CacheBlock *block);
+#endif
+
 // the CodePageHandler class provides access to the contained
 // cache blocks and intercepts writes to the code for special treatment
 class CodePageHandler final : public PageHandler {
@@ -160,6 +235,32 @@ public:
 			delete [] invalidation_map;
 			invalidation_map = nullptr;
 		}
+		smc_stats = &cache_page_stats[phys_page];
+	}
+
+	// code in this page is rewritten too often to be worth translating
+	bool IsVolatile() const
+	{
+		return PIC_Ticks < smc_stats->volatile_until;
+	}
+
+	void CountInterpretedSlice() { smc_stats->interpreted_slices++; }
+	void CountHaltedSlice() { smc_stats->halted_slices++; }
+
+	// account a write that overwrote translated code, and mark the page
+	// volatile if that happens too often
+	void CountInvalidatingWrite()
+	{
+		auto &stats = *smc_stats;
+		stats.invalidating_writes++;
+		if (PIC_Ticks - stats.window_start >= smc_window_ms) {
+			stats.window_start = PIC_Ticks;
+			stats.window_writes = 0;
+		}
+		if (++stats.window_writes == smc_volatile_writes) {
+			stats.volatile_until = PIC_Ticks + smc_volatile_cooldown_ms;
+			stats.times_volatile++;
+		}
 	}
 
 	// clear out blocks that contain code which has been modified
@@ -169,6 +270,7 @@ public:
 		bool is_current_block = false; // if the current block is
 		                               // modified, it has to be exited
 		                               // as soon as possible
+		CountInvalidatingWrite();
 
 		uint32_t ip_point=SegPhys(cs)+reg_eip;
 		ip_point = (PAGING_GetPhysicalPage(ip_point) -
@@ -187,6 +289,10 @@ public:
 				// test if this block is in the range
 				if (start<=block->page.end && end>=block->page.start) {
 					if (ip_point<=block->page.end && ip_point>=block->page.start) is_current_block=true;
+					cache_stats.invalidations++;
+#if DYN_CACHE_PROFILE
+					cache_profile_invalidated(block);
+#endif
 					block->Clear(); // clear the block,
 					                // decrements the
 					                // write_map accordingly
@@ -466,6 +572,7 @@ public:
 				block=*++map;
 			CacheBlock * nextblock=block->hash.next;
 			block->page.handler=nullptr;			// no need, full clear
+			cache_stats.evictions++;
 			block->Clear();
 			block=nextblock;
 		}
@@ -495,6 +602,8 @@ public:
 		return GetHostReadPt(phys_page);
 	}
 
+	Bitu GetPhysPage() const { return phys_page; }
+
 public:
 	// the write map, there are write_map[i] cache blocks that cover
 	// the byte at address i
@@ -515,6 +624,7 @@ private:
 	                        // a page
 	HostPt hostmem = nullptr;
 	Bitu phys_page = 0;
+	CodePageStats *smc_stats = nullptr;
 };
 
 static inline void cache_add_unused_block(CacheBlock *block)
@@ -529,15 +639,83 @@ static CacheBlock *cache_getblock()
 	// get a free cache block and advance the free pointer
 	CacheBlock *ret = cache.block.free;
 	if (!ret)
-		E_Exit("Ran out of CacheBlocks");
+		E_Exit("Ran out of CacheBlocks, try a larger [cpu] dynamic_cache");
 	cache.block.free=ret->cache.next;
 	ret->cache.next=nullptr;
 	return ret;
 }
 
+#if DYN_CACHE_PROFILE
+static void cache_profile_translated(CacheBlock *block, const PhysPt phys)
+{
+	auto &entry = cache_profile[phys];
+	entry.cs = static_cast<uint16_t>(SegValue(cs));
+	entry.eip = reg_eip;
+	entry.translations++;
+	block->profile.hits = 0;
+	block->profile.phys = phys;
+}
+
+// fold the hits of a block that is about to be cleared into its profile
+static void cache_profile_flush(CacheBlock *block)
+{
+	auto &entry = cache_profile[block->profile.phys];
+	entry.hits += block->profile.hits;
+	entry.size = static_cast<uint16_t>(block->page.end - block->page.start + 1);
+	block->profile.hits = 0;
+}
+
+static void cache_profile_invalidated(const CacheBlock *block)
+{
+	// the part of a block that crosses into the next page is
+	// accounted to the block it belongs to
+	if (!block->hash.index && block->crossblock)
+		block = block->crossblock;
+	cache_profile[block->profile.phys].invalidations++;
+}
+
+static void cache_profile_report()
+{
+	for (auto &block : cache_blocks)
+		if (block.page.handler && block.hash.index)
+			cache_profile_flush(&block);
+	if (cache_profile.empty())
+		return;
+
+	using profile_t = std::pair<PhysPt, CacheBlockProfile>;
+	std::vector<profile_t> sorted(cache_profile.begin(), cache_profile.end());
+
+	constexpr size_t max_lines = 32;
+	auto report = [&](const char *title, auto compare) {
+		const auto num_lines = std::min(sorted.size(), max_lines);
+		std::partial_sort(sorted.begin(), sorted.begin() + num_lines,
+		                  sorted.end(), compare);
+		LOG_MSG("DYNREC: %s", title);
+		LOG_MSG("DYNREC:   CS:IP range          phys      hits          translated  invalidated");
+		for (size_t i = 0; i < num_lines; ++i) {
+			const auto &p = sorted[i].second;
+			LOG_MSG("DYNREC:   %04x:%08x-%08x %08x %-13" PRIu64 " %-11u %u",
+			        p.cs, p.eip, p.eip + p.size - 1, sorted[i].first,
+			        p.hits, p.translations, p.invalidations);
+		}
+	};
+	report("hottest blocks", [](const profile_t &a, const profile_t &b) {
+		return a.second.hits > b.second.hits;
+	});
+	report("blocks with most self-modifying code churn",
+	       [](const profile_t &a, const profile_t &b) {
+		       return a.second.invalidations > b.second.invalidations;
+	       });
+}
+#endif
+
 void CacheBlock::Clear()
 {
 	Bitu ind;
+#if DYN_CACHE_PROFILE
+	if (hash.index)
+		cache_profile_flush(this);
+#endif
 	// check if this is not a cross page block
 	if (hash.index) for (ind=0;ind<2;ind++) {
 		CacheBlock * fromlink=link[ind].from;
@@ -590,8 +768,10 @@ static CacheBlock *cache_openblock()
 	// check for enough space in this block
 	Bitu size=block->cache.size;
 	CacheBlock *nextblock = block->cache.next;
-	if (block->page.handler)
+	if (block->page.handler) {
+		cache_stats.evictions++;
 		block->Clear();
+	}
 	// block size must be at least CACHE_MAXSIZE
 	while (size<CACHE_MAXSIZE) {
 		if (!nextblock)
@@ -599,8 +779,10 @@ static CacheBlock *cache_openblock()
 		// merge blocks
 		size+=nextblock->cache.size;
 		CacheBlock *tempblock = nextblock->cache.next;
-		if (nextblock->page.handler)
+		if (nextblock->page.handler) {
+			cache_stats.evictions++;
 			nextblock->Clear();
+		}
 		// block is free now
 		cache_add_unused_block(nextblock);
 		nextblock=tempblock;
@@ -653,12 +835,13 @@ static void cache_closeblock()
 #if (C_DYNAMIC_X86)
 	const bool cache_is_full = !block->cache.next;
 #elif (C_DYNREC)
-	const uint8_t *limit = (cache_code_start_ptr + CACHE_TOTAL - CACHE_MAXSIZE);
+	const uint8_t *limit = (cache_code_start_ptr + cache_size.total - CACHE_MAXSIZE);
 	const bool cache_is_full = (!block->cache.next ||
 	                            (block->cache.next->cache.start > limit));
 #endif
 	if (cache_is_full) {
 		// DEBUG_LOG_MSG("Cache full; restarting");
+		cache_stats.fills++;
 		cache.block.active=cache.block.first;
 	} else {
 		cache.block.active=block->cache.next;
@@ -736,7 +919,10 @@ static void cache_block_before_close();
 static void cache_block_closing(const uint8_t *block_start, Bitu block_size);
 #endif
 
-static constexpr size_t cache_code_size = CACHE_TOTAL + CACHE_MAXSIZE + host_pagesize - 1 + host_pagesize;
+static size_t cache_code_size()
+{
+	return cache_size.total + CACHE_MAXSIZE + host_pagesize - 1 + host_pagesize;
+}
 constexpr bool is_64bit_platform = sizeof(void *) == 8;
 
 static inline void dyn_mem_adjust(void *&ptr, size_t &size)
@@ -815,14 +1001,92 @@ static inline void dyn_cache_invalidate([[maybe_unused]] void *ptr,
 
 static bool cache_initialized = false;
 
+#ifndef NDEBUG
+// list the pages that were run by the normal core because of their
+// self-modifying code
+static void cache_smc_report()
+{
+	using stats_t = std::pair<Bitu, CodePageStats>;
+	std::vector<stats_t> pages = {};
+	for (const auto &page : cache_page_stats)
+		if (page.second.times_volatile)
+			pages.emplace_back(page);
+	if (pages.empty())
+		return;
+	std::sort(pages.begin(), pages.end(), [](const stats_t &a, const stats_t &b) {
+		return a.second.invalidating_writes > b.second.invalidating_writes;
+	});
+	DEBUG_LOG_MSG("DYNCACHE: %zu pages were run interpreted due to self-modifying code",
+	              pages.size());
+	constexpr size_t max_lines = 16;
+	for (size_t i = 0; i < std::min(pages.size(), max_lines); ++i) {
+		const auto &p = pages[i].second;
+		DEBUG_LOG_MSG("DYNCACHE:   page %05x: %" PRIu64 " code writes, volatile %u times, "
+		              "%" PRIu64 " interpreted slices (%" PRIu64 " halted)",
+		              static_cast<uint32_t>(pages[i].first), p.invalidating_writes,
+		              p.times_volatile, p.interpreted_slices, p.halted_slices);
+	}
+}
+#endif
+
+// Runs a slice of a volatile page on the normal core. Returns true if the
+// dynamic core should return ret to its caller, or false to carry on with
+// the cycles left.
+static bool cache_run_volatile_slice(CodePageHandler *chandler, Bits &ret)
+{
+	chandler->CountInterpretedSlice();
+	const auto old_cycles = CPU_Cycles;
+	const auto slice = std::clamp(old_cycles, 1, smc_volatile_slice);
+	const auto old_decoder = cpudecoder;
+	const auto was_idle = CPU_GuestIdled;
+	CPU_GuestIdled = false;
+
+	CPU_Cycles = slice;
+	ret = CPU_Core_Normal_Run();
+
+	const auto idled = CPU_GuestIdled;
+	CPU_GuestIdled = idled || was_idle;
+
+	// A HLT or idle poll skips the rest of the budget, as CPU_Idle() does
+	// on any other page, and leaves HLT_Decode waiting for the interrupt
+	if (idled) {
+		chandler->CountHaltedSlice();
+		if (old_cycles > slice)
+			CPU_IODelayRemoved += old_cycles - slice;
+		return true;
+	}
+	if (ret || cpudecoder != old_decoder) {
+		CPU_CycleLeft += old_cycles - slice;
+		return true;
+	}
+	CPU_Cycles = old_cycles - (slice - CPU_Cycles);
+
+	// give the PIC a chance to run its events and advance the ticks the
+	// cooldown waits on
+	return CPU_Cycles <= 0;
+}
+
+// Sizes the code cache and the block and page pools; only takes effect
+// before the cache is first initialized. Zero keeps the current size.
+static void cache_set_size(const int size_mb)
+{
+	if (cache_initialized || size_mb <= 0)
+		return;
+	const auto mb = static_cast<size_t>(size_mb);
+	cache_size.total = mb * 1024 * 1024;
+	cache_size.blocks = CACHE_BLOCKS_PER_MB * mb;
+	cache_size.pages = CACHE_PAGES_PER_MB * mb;
+}
+
 static void cache_init(bool enable) {
 	if (enable) {
 		// see if cache is already initialized
 		if (cache_initialized) return;
 		cache_initialized = true;
+		cache_blocks.resize(cache_size.blocks);
 		cache.block.free=&cache_blocks[0];
 		// initialize the cache blocks
-		for (int i=0;i<CACHE_BLOCKS-1;i++) {
+		for (size_t i = 0; i < cache_size.blocks - 1; i++) {
 			cache_blocks[i].link[0].to = (CacheBlock *)1;
 			cache_blocks[i].link[1].to = (CacheBlock *)1;
 			cache_blocks[i].cache.next = &cache_blocks[i + 1];
@@ -832,11 +1096,11 @@ static void cache_init(bool enable) {
 #if defined (WIN32)
 			LPVOID lp_vmem = nullptr;
 			if (CPU_AllowSpeedMods) {
-				lp_vmem = VirtualAlloc(nullptr, cache_code_size,
+				lp_vmem = VirtualAlloc(nullptr, cache_code_size(),
 				                       MEM_COMMIT,
 				                       PAGE_EXECUTE_READWRITE); // all operations allowed
 			} else {
-				lp_vmem = VirtualAlloc(nullptr, cache_code_size,
+				lp_vmem = VirtualAlloc(nullptr, cache_code_size(),
 				                       MEM_COMMIT | MEM_RESERVE,
 				                       PAGE_READWRITE); // needs on-going management
 			}
@@ -848,12 +1112,12 @@ static void cache_init(bool enable) {
 #if defined(HAVE_MAP_JIT)
 			map_flags |= MAP_JIT;
 #endif
-			cache_code_start_ptr=static_cast<uint8_t *>(mmap(nullptr, cache_code_size, prot_flags, map_flags, -1, 0));
+			cache_code_start_ptr=static_cast<uint8_t *>(mmap(nullptr, cache_code_size(), prot_flags, map_flags, -1, 0));
 			if (cache_code_start_ptr == MAP_FAILED) {
 				E_Exit("Allocating dynamic core cache memory failed with errno %d", errno);
 			}
 #else
-			cache_code_start_ptr=static_cast<uint8_t *>(malloc(cache_code_size));
+			cache_code_start_ptr=static_cast<uint8_t *>(malloc(cache_code_size()));
 			if (!cache_code_start_ptr) {
 				E_Exit("Allocating dynamic core cache memory failed");
 			}
@@ -869,7 +1133,7 @@ static void cache_init(bool enable) {
 			cache.block.first=block;
 			cache.block.active=block;
 			block->cache.start=&cache_code[0];
-			block->cache.size=CACHE_TOTAL;
+			block->cache.size = cache_size.total;
 			block->cache.next = nullptr; // last block in the list
 		}
 		// setup the default blocks for block linkage returns
@@ -900,7 +1164,7 @@ static void cache_init(bool enable) {
 		cache.last_page=nullptr;
 		cache.used_pages=nullptr;
 		// setup the code pages
-		for (int i=0;i<CACHE_PAGES;i++) {
+		for (size_t i = 0; i < cache_size.pages; i++) {
 			CodePageHandler *newpage = new CodePageHandler();
 			newpage->next=cache.free_pages;
 			cache.free_pages=newpage;
@@ -909,6 +1173,19 @@ static void cache_init(bool enable) {
 }
 
 static void cache_close(void) {
+#if DYN_CACHE_PROFILE
+	if (cache_initialized)
+		cache_profile_report();
+#endif
+	if (cache_initialized) {
+		DEBUG_LOG_MSG("DYNCACHE: %zu MB code cache: %" PRIu64 " fills, %" PRIu64
+		              " block evictions, %" PRIu64 " block invalidations",
+		              cache_size.total / (1024 * 1024), cache_stats.fills,
+		              cache_stats.evictions, cache_stats.invalidations);
+	}
+#ifndef NDEBUG
+	cache_smc_report();
+#endif
 /*	for (;;) {
 		if (cache.used_pages) {
 			CodePageHandler * cpage=cache.used_pages;
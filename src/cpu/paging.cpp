@@ -667,34 +667,33 @@ bool PAGING_ForcePageInit(Bitu lin_addr) {
 }
 
 #if defined(USE_FULL_TLB)
+PageHandler *const paging_init_page_handler = &init_page_handler;
+
+// Every entry that was linked is on the links list, and the others are
+// still zero, which stands for the init page handler. Resetting the TLB
+// therefore only has to clear the linked entries.
+static inline void unlink_tlb_entry(const Bitu lin_page)
+{
+	paging.tlb.read[lin_page] = nullptr;
+	paging.tlb.write[lin_page] = nullptr;
+	paging.tlb.readhandler[lin_page] = nullptr;
+	paging.tlb.writehandler[lin_page] = nullptr;
+}
+
 void PAGING_InitTLB(void) {
-	for (auto i=0;i<TLB_SIZE;i++) {
-		paging.tlb.read[i]=nullptr;
-		paging.tlb.write[i]=nullptr;
-		paging.tlb.readhandler[i]=&init_page_handler;
-		paging.tlb.writehandler[i]=&init_page_handler;
-	}
-	paging.links.used=0;
+	PAGING_ClearTLB();
 }
 
 void PAGING_ClearTLB(void) {
 	uint32_t * entries=&paging.links.entries[0];
-	for (;paging.links.used>0;paging.links.used--) {
-		const auto page=*entries++;
-		paging.tlb.read[page]=nullptr;
-		paging.tlb.write[page]=nullptr;
-		paging.tlb.readhandler[page]=&init_page_handler;
-		paging.tlb.writehandler[page]=&init_page_handler;
-	}
+	for (;paging.links.used>0;paging.links.used--)
+		unlink_tlb_entry(*entries++);
 	paging.links.used=0;
 }
 
 void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
 	for (;pages>0;pages--) {
-		paging.tlb.read[lin_page]=nullptr;
-		paging.tlb.write[lin_page]=nullptr;
-		paging.tlb.readhandler[lin_page]=&init_page_handler;
-		paging.tlb.writehandler[lin_page]=&init_page_handler;
+		unlink_tlb_entry(lin_page);
 		lin_page++;
 	}
 }
@@ -702,10 +701,7 @@ void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
 void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
 	if (lin_page<LINK_START) {
 		paging.firstmb[lin_page]=phys_page;
-		paging.tlb.read[lin_page]=nullptr;
-		paging.tlb.write[lin_page]=nullptr;
-		paging.tlb.readhandler[lin_page]=&init_page_handler;
-		paging.tlb.writehandler[lin_page]=&init_page_handler;
+		unlink_tlb_entry(lin_page);
 	} else {
 		PAGING_LinkPage(lin_page,phys_page);
 	}
@@ -246,6 +246,11 @@ private:
 
 	private:
 		std::ifstream   *file;
+
+		// Data reads are served from a mapping of the whole file when
+		// the host supports it; audio decoding keeps using the stream
+		const uint8_t   *mapped_data = nullptr;
+		size_t          mapped_size = 0;
 	};
 
 	class AudioFile final : public TrackFile {
@@ -330,6 +335,8 @@ private:
 	                 const uint16_t sectorSize,
 	                 const bool mode2);
 	std::vector<Track>::iterator GetTrack(const uint32_t sector);
+	uint32_t ReadSectorRun(uint8_t *buffer, const bool raw,
+	                       const uint32_t sector, const uint32_t num);
 	void CDAudioCallBack(uint16_t desired_frames);
 
 	// Private functions for cue sheet processing
@@ -346,6 +353,8 @@ private:
 	// member variables
 	std::vector<Track>   tracks;
 	std::vector<uint8_t> readBuffer;
+	std::vector<uint8_t> rawBuffer;
+	size_t               lastTrackIndex = 0;
 	std::string          mcn;
 	static int           refCount;
 };
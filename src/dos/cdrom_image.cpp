@@ -41,6 +41,13 @@
 #include <cstring>
 #endif
 
+#if defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "drives.h"
 #include "fs_utils.h"
 #include "setup.h"
@@ -102,10 +109,35 @@ CDROM_Interface_Image::BinaryFile::BinaryFile(const char *filename, bool &error)
 	file = new ifstream(filename, ios::in | ios::binary);
 	// If new fails, an exception is generated and scope leaves this constructor
 	error = file->fail();
+
+#if defined(HAVE_MMAP)
+	if (error)
+		return;
+	const int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		const auto size = static_cast<size_t>(st.st_size);
+		void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED) {
+			mapped_data = static_cast<const uint8_t *>(map);
+			mapped_size = size;
+		}
+	}
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+#endif
 }
 
 CDROM_Interface_Image::BinaryFile::~BinaryFile()
 {
+#if defined(HAVE_MMAP)
+	if (mapped_data)
+		munmap(const_cast<uint8_t *>(mapped_data), mapped_size);
+	mapped_data = nullptr;
+#endif
+
 	// Guard: only cleanup if needed
 	if (file == nullptr)
 		return;
@@ -127,6 +159,13 @@ bool CDROM_Interface_Image::BinaryFile::read(uint8_t *buffer,
 	if (adjusted_bytes == 0) // no work to do!
 		return true;
 
+	if (mapped_data) {
+		if (offset + adjusted_bytes > mapped_size)
+			return false;
+		memcpy(buffer, mapped_data + offset, adjusted_bytes);
+		return true;
+	}
+
 	// Reposition if needed
 	if (!seek(offset))
 		return false;
@@ -864,21 +903,21 @@ bool CDROM_Interface_Image::ReadSectors(PhysPt buffer,
 	if (readBuffer.size() < requested_bytes)
 		readBuffer.resize(requested_bytes);
 
-	// Setup state-tracking variables to be used in the read-loop
+	// Read runs of sectors until we have enough or fail
 	bool success = true; //Gobliiins reads 0 sectors
-	uint32_t bytes_read = 0;
-	uint32_t current_sector = sector;
-	uint8_t* buffer_position = readBuffer.data();
-
-	// Read until we have enough or fail
-	while (bytes_read < requested_bytes) {
-		success = ReadSector(buffer_position, raw, current_sector);
-		if (!success)
+	uint32_t sectors_read = 0;
+	while (sectors_read < num) {
+		const uint32_t run = ReadSectorRun(readBuffer.data() + sectors_read * sectorSize,
+		                                   raw, sector + sectors_read,
+		                                   num - sectors_read);
+		if (run == 0) {
+			success = false;
 			break;
-		current_sector++;
-		bytes_read += sectorSize;
-		buffer_position += sectorSize;
+		}
+		sectors_read += run;
 	}
+	const uint32_t bytes_read = sectors_read * sectorSize;
+
 	// Write only the successfully read bytes
 	MEM_BlockWrite(buffer, readBuffer.data(), bytes_read);
 #ifdef DEBUG
@@ -910,18 +949,20 @@ track_iter CDROM_Interface_Image::GetTrack(const uint32_t sector)
 	/**
 	 *  Walk the tracks checking if the desired sector falls inside of a given
 	 *  track's range, which starts at the end of the prior track and goes to
-	 *  the current track's (start + length).
+	 *  the current track's (start + length). Consecutive reads nearly always
+	 *  land in the same track, so check the previous result first.
 	 */
-	track_iter track = tracks.begin();
-	uint32_t lower_bound = track->start;
-	while (track != tracks.end()) {
-		const uint32_t upper_bound = track->start + track->length;
-		if (lower_bound <= sector && sector < upper_bound) {
-			break;
-		}
-		++track;
-		lower_bound = upper_bound;
+	auto track_contains = [&](const size_t i) {
+		const uint32_t lower_bound = (i == 0) ? tracks[0].start
+		                                      : tracks[i - 1].start + tracks[i - 1].length;
+		return lower_bound <= sector && sector < tracks[i].start + tracks[i].length;
+	};
+	if (lastTrackIndex >= tracks.size() || !track_contains(lastTrackIndex)) {
+		lastTrackIndex = 0;
+		while (lastTrackIndex < tracks.size() && !track_contains(lastTrackIndex))
+			++lastTrackIndex;
 	}
+	track_iter track = tracks.begin() + static_cast<ptrdiff_t>(lastTrackIndex);
 #ifdef DEBUG
 	if (track != tracks.end() && track->number != 1) {
 		if (sector < track->start) {
@@ -979,16 +1020,62 @@ bool CDROM_Interface_Image::ReadSector(uint8_t *buffer, const bool raw, const ui
 	return track->file->read(buffer, offset, length);
 }
 
+// Reads up to num sectors that follow each other within the track holding
+// the first one, and returns how many were read. Cooked sectors from raw
+// images are picked out of a single read of the surrounding frames.
+uint32_t CDROM_Interface_Image::ReadSectorRun(uint8_t *buffer,
+                                              const bool raw,
+                                              const uint32_t sector,
+                                              const uint32_t num)
+{
+	track_const_iter track = GetTrack(sector);
+	if (track == tracks.end() || track->file == nullptr)
+		return 0;
+
+	// Pregap sectors don't have a place in the track's file
+	if (sector < track->start)
+		return ReadSector(buffer, raw, sector) ? 1 : 0;
+
+	if (track->sectorSize != BYTES_PER_RAW_REDBOOK_FRAME && raw)
+		return 0;
+
+	const uint32_t length = (raw ? BYTES_PER_RAW_REDBOOK_FRAME : BYTES_PER_COOKED_REDBOOK_FRAME);
+	uint32_t offset = track->skip + (sector - track->start) * track->sectorSize;
+	if (track->sectorSize == BYTES_PER_RAW_REDBOOK_FRAME && !track->mode2 && !raw)
+		offset += 16;
+	if (track->mode2 && !raw)
+		offset += 24;
+
+	const uint32_t count = std::min(num, track->start + track->length - sector);
+	const uint32_t stride = static_cast<uint32_t>(track->sectorSize);
+
+	// Sectors stored back to back go straight into the buffer
+	if (stride == length)
+		return track->file->read(buffer, offset, count * length) ? count : 0;
+
+	const uint32_t span = (count - 1) * stride + length;
+	if (rawBuffer.size() < span)
+		rawBuffer.resize(span);
+	if (!track->file->read(rawBuffer.data(), offset, span))
+		return 0;
+	for (uint32_t i = 0; i < count; ++i)
+		memcpy(buffer + i * length, rawBuffer.data() + i * stride, length);
+	return count;
+}
+
 bool CDROM_Interface_Image::ReadSectorsHost(void *buffer, bool raw, unsigned long sector, unsigned long num)
 {
 	unsigned int sectorSize = raw ? BYTES_PER_RAW_REDBOOK_FRAME : BYTES_PER_COOKED_REDBOOK_FRAME;
-	bool success = true; //Gobliiins reads 0 sectors
-	for(unsigned long i = 0; i < num; i++) {
-		success = ReadSector((uint8_t*)buffer + (i * (Bitu)sectorSize), raw, sector + i);
-		if (!success) break;
+	unsigned long sectors_read = 0;
+	while (sectors_read < num) {
+		const uint32_t run = ReadSectorRun(static_cast<uint8_t *>(buffer) + sectors_read * sectorSize,
+		                                   raw, check_cast<uint32_t>(sector + sectors_read),
+		                                   check_cast<uint32_t>(num - sectors_read));
+		if (run == 0)
+			return false;
+		sectors_read += run;
 	}
-
-	return success;
+	return true; //Gobliiins reads 0 sectors
 }
 
 void CDROM_Interface_Image::CDAudioCallBack(uint16_t desired_track_frames)
@@ -1386,6 +1386,12 @@ static Bitu DOS_27Handler(void) {
 	return CBRET_NONE;
 }
 
+static Bitu DOS_28Handler(void) {
+	// DOS idle interrupt, called by programs while waiting for input
+	CPU_IdlePoll();
+	return CBRET_NONE;
+}
+
 static uint16_t DOS_SectorAccess(const bool read)
 {
 	auto drive = static_cast<fatDrive *>(Drives[reg_al]);
@@ -1527,7 +1533,7 @@ public:
 		callback[4].Install(DOS_27Handler,CB_IRET,"DOS Int 27");
 		callback[4].Set_RealVec(0x27);
 
-		callback[5].Install(NULL,CB_IRET,"DOS Int 28");
+		callback[5].Install(DOS_28Handler,CB_IRET,"DOS Int 28");
 		callback[5].Set_RealVec(0x28);
 
 		callback[6].Install(NULL,CB_INT29,"CON Output Int 29");
@@ -18,11 +18,17 @@
 
 #include "drives.h"
 
+#include <algorithm>
+#include <cassert>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #include "bios_disk.h"
 #include "bios.h"
 #include "cross.h"
@@ -59,12 +65,31 @@ public:
 	/* Record of where in the directory structure this file is located */
 	uint32_t dirCluster;
 	uint32_t dirIndex;
+	FatClusterCursor chainCursor;
 
 	bool loadedSector;
 	fatDrive *myDrive;
 };
 
 
+static uint32_t lowest_set_bit(uint64_t word) {
+	assert(word != 0);
+#if defined(HAVE_BUILTIN_CTZLL)
+	return static_cast<uint32_t>(__builtin_ctzll(word));
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long bit = 0;
+	_BitScanForward64(&bit, word);
+	return bit;
+#else
+	uint32_t bit = 0;
+	while (!(word & 1)) {
+		word >>= 1;
+		++bit;
+	}
+	return bit;
+#endif
+}
+
 /* IN - char * filename: Name in regular filename format, e.g. bob.txt */
 /* OUT - char * filearray: Name in DOS directory format, eleven char, e.g. bob     txt */
 static void convToDirFile(char *filename, char *filearray) {
@@ -95,6 +120,7 @@ fatFile::fatFile(const char* /*name*/,
 	  sectorBuffer{0},
 	  dirCluster(0),
 	  dirIndex(0),
+	  chainCursor(),
 	  loadedSector(false),
 	  myDrive(useDrive)
 {
@@ -117,7 +143,7 @@ bool fatFile::Read(uint8_t * data, uint16_t *size) {
 	}
 
 	if (!loadedSector) {
-		currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+		currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainCursor);
 		if(currentSector == 0) {
 			/* EOC reached before EOF */
 			*size = 0;
@@ -139,7 +165,7 @@ bool fatFile::Read(uint8_t * data, uint16_t *size) {
 		data[sizecount++] = sectorBuffer[curSectOff++];
 		seekpos++;
 		if(curSectOff >= myDrive->getSectorSize()) {
-			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainCursor);
 			if(currentSector == 0) {
 				/* EOC reached before EOF */
 				//LOG_MSG("EOC reached before EOF, seekpos %d, filelen %d", seekpos, filelength);
@@ -190,7 +216,7 @@ bool fatFile::Write(uint8_t * data, uint16_t *size) {
 		}
 		filelength = ((filelength - 1) / clustSize + 1) * clustSize;
 		while(filelength < seekpos) {
-			if(myDrive->appendCluster(firstCluster) == 0) goto finalizeWrite; // out of space
+			if(myDrive->appendCluster(firstCluster, &chainCursor) == 0) goto finalizeWrite; // out of space
 			filelength += clustSize;
 		}
 		if(filelength > seekpos) filelength = seekpos;
@@ -204,17 +230,17 @@ bool fatFile::Write(uint8_t * data, uint16_t *size) {
 				firstCluster = myDrive->getFirstFreeClust();
 				if(firstCluster == 0) goto finalizeWrite; // out of space
 				myDrive->allocateCluster(firstCluster, 0);
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainCursor);
 				myDrive->readSector(currentSector, sectorBuffer);
 				loadedSector = true;
 			}
 			if (!loadedSector) {
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainCursor);
 				if(currentSector == 0) {
 					/* EOC reached before EOF - try to increase file allocation */
-					myDrive->appendCluster(firstCluster);
+					myDrive->appendCluster(firstCluster, &chainCursor);
 					/* Try getting sector again */
-					currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+					currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainCursor);
 					if(currentSector == 0) {
 						/* No can do. lets give up and go home.  We must be out of room */
 						goto finalizeWrite;
@@ -231,7 +257,7 @@ bool fatFile::Write(uint8_t * data, uint16_t *size) {
 		if(curSectOff >= myDrive->getSectorSize()) {
 			if(loadedSector) myDrive->writeSector(currentSector, sectorBuffer);
 
-			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainCursor);
 			if(currentSector == 0) loadedSector = false;
 			else {
 				curSectOff = 0;
@@ -272,7 +298,7 @@ bool fatFile::Seek(uint32_t *pos, uint32_t type) {
 
 	if(seekto<0) seekto = 0;
 	seekpos = (uint32_t)seekto;
-	currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+	currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainCursor);
 	if (currentSector == 0) {
 		/* not within file size, thus no sector is available */
 		loadedSector = false;
@@ -288,6 +314,7 @@ bool fatFile::Seek(uint32_t *pos, uint32_t type) {
 bool fatFile::Close() {
 	/* Flush buffer */
 	if (loadedSector) myDrive->writeSector(currentSector, sectorBuffer);
+	if (myDrive->loadedDisk) myDrive->loadedDisk->Flush();
 
 	return false;
 }
@@ -304,6 +331,34 @@ uint32_t fatDrive::getClustFirstSect(uint32_t clustNum) {
 	return ((clustNum - 2) * bootbuffer.sectorspercluster) + firstDataSector;
 }
 
+uint8_t *fatDrive::getFatSector(uint32_t fatsectnum) {
+	++fatCacheTick;
+	if (lastFatSector->sector == fatsectnum) {
+		lastFatSector->lastUsed = fatCacheTick;
+		return lastFatSector->data;
+	}
+
+	FatSectorCacheEntry *victim = &fatSectorCache[0];
+	for (auto &entry : fatSectorCache) {
+		if (entry.sector == fatsectnum) {
+			entry.lastUsed = fatCacheTick;
+			lastFatSector = &entry;
+			return entry.data;
+		}
+		if (entry.lastUsed < victim->lastUsed)
+			victim = &entry;
+	}
+
+	/* Load two sectors at once for FAT12 */
+	readSector(fatsectnum, &victim->data[0]);
+	if (fattype==FAT12)
+		readSector(fatsectnum+1, &victim->data[512]);
+	victim->sector = fatsectnum;
+	victim->lastUsed = fatCacheTick;
+	lastFatSector = victim;
+	return victim->data;
+}
+
 uint32_t fatDrive::getClusterValue(uint32_t clustNum) {
 	uint32_t fatoffset=0;
 	uint32_t fatsectnum;
@@ -324,13 +379,7 @@ uint32_t fatDrive::getClusterValue(uint32_t clustNum) {
 	fatsectnum = bootbuffer.reservedsectors + (fatoffset / bootbuffer.bytespersector) + partSectOff;
 	fatentoff = fatoffset % bootbuffer.bytespersector;
 
-	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
-		readSector(fatsectnum, &fatSectBuffer[0]);
-		if (fattype==FAT12)
-			readSector(fatsectnum+1, &fatSectBuffer[512]);
-		curFatSect = fatsectnum;
-	}
+	uint8_t *fatSectBuffer = getFatSector(fatsectnum);
 
 	switch(fattype) {
 		case FAT12:
@@ -371,13 +420,7 @@ void fatDrive::setClusterValue(uint32_t clustNum, uint32_t clustValue) {
 	fatsectnum = bootbuffer.reservedsectors + (fatoffset / bootbuffer.bytespersector) + partSectOff;
 	fatentoff = fatoffset % bootbuffer.bytespersector;
 
-	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
-		readSector(fatsectnum, &fatSectBuffer[0]);
-		if (fattype==FAT12)
-			readSector(fatsectnum+1, &fatSectBuffer[512]);
-		curFatSect = fatsectnum;
-	}
+	uint8_t *fatSectBuffer = getFatSector(fatsectnum);
 
 	switch(fattype) {
 		case FAT12: {
@@ -404,10 +447,51 @@ void fatDrive::setClusterValue(uint32_t clustNum, uint32_t clustValue) {
 			break;
 	}
 	for(int fc=0;fc<bootbuffer.fatcopies;fc++) {
-		writeSector(fatsectnum + (fc * bootbuffer.sectorsperfat), &fatSectBuffer[0]);
+		writeRawSector(fatsectnum + (fc * bootbuffer.sectorsperfat), &fatSectBuffer[0]);
 		if (fattype==FAT12) {
 			if (fatentoff>=511)
-				writeSector(fatsectnum+1+(fc * bootbuffer.sectorsperfat), &fatSectBuffer[512]);
+				writeRawSector(fatsectnum+1+(fc * bootbuffer.sectorsperfat), &fatSectBuffer[512]);
+		}
+	}
+
+	if (clustNum >= 2 && clustNum - 2 < CountOfClusters)
+		markClusterFree(clustNum, clustValue == 0);
+
+	/* FAT12 cache entries overlap their neighbours by one sector */
+	if (fattype == FAT12) {
+		for (auto &entry : fatSectorCache) {
+			if (entry.sector == fatsectnum - 1)
+				memcpy(&entry.data[512], &fatSectBuffer[0], 512);
+			else if (entry.sector == fatsectnum + 1)
+				memcpy(&entry.data[0], &fatSectBuffer[512], 512);
+		}
+	}
+}
+
+void fatDrive::markClusterFree(uint32_t clustNum, bool isFree) {
+	const uint32_t index = clustNum - 2;
+	uint64_t &word = freeClusterMap[index / 64];
+	const uint64_t bit = uint64_t(1) << (index % 64);
+	if (((word & bit) != 0) == isFree)
+		return;
+	if (isFree) {
+		word |= bit;
+		++freeClusterCount;
+		freeClusterHint = std::min(freeClusterHint, index);
+	} else {
+		word &= ~bit;
+		--freeClusterCount;
+	}
+}
+
+void fatDrive::buildFreeClusterMap() {
+	freeClusterMap.assign((CountOfClusters + 63) / 64, 0);
+	freeClusterCount = 0;
+	freeClusterHint = 0;
+	for (uint32_t i = 0; i < CountOfClusters; i++) {
+		if (!getClusterValue(i + 2)) {
+			freeClusterMap[i / 64] |= uint64_t(1) << (i % 64);
+			++freeClusterCount;
 		}
 	}
 }
@@ -541,6 +625,14 @@ uint8_t fatDrive::readSector(uint32_t sectnum, void * data) {
 }
 
 uint8_t fatDrive::writeSector(uint32_t sectnum, void * data) {
+	const uint8_t result = writeRawSector(sectnum, data);
+	fatSectorWritten(sectnum);
+	return result;
+}
+
+/* Writes a sector without updating the FAT caches, which the FAT code keeps
+ * in sync itself */
+uint8_t fatDrive::writeRawSector(uint32_t sectnum, void * data) {
 	// Guard
 	if (!loadedDisk) {
 		return 0;
@@ -557,6 +649,50 @@ uint8_t fatDrive::writeSector(uint32_t sectnum, void * data) {
 	return loadedDisk->Write_Sector(head, cylinder, sector, data);
 }
 
+/* A sector of the first FAT was written directly, e.g. through INT 26h:
+ * drop its cached copies and the chain positions that may have gone through
+ * it, and refresh the free bits of the clusters it holds */
+void fatDrive::fatSectorWritten(uint32_t sectnum) {
+	const uint32_t fatStart = bootbuffer.reservedsectors + partSectOff;
+	if (sectnum < fatStart || sectnum >= fatStart + bootbuffer.sectorsperfat)
+		return;
+
+	for (auto &entry : fatSectorCache) {
+		/* FAT12 entries also hold the sector after their own */
+		if (entry.sector == sectnum || (fattype == FAT12 && entry.sector + 1 == sectnum))
+			entry.sector = UINT32_MAX;
+	}
+	++chainGeneration;
+
+	/* Clusters whose entries overlap the sector; FAT12 entries can
+	 * straddle its edges */
+	const uint32_t firstByte = (sectnum - fatStart) * bootbuffer.bytespersector;
+	const uint32_t endByte = firstByte + bootbuffer.bytespersector;
+	uint32_t firstClust = 0;
+	uint32_t endClust = 0;
+	switch(fattype) {
+		case FAT12:
+			firstClust = firstByte * 2 / 3;
+			endClust = endByte * 2 / 3 + 1;
+			break;
+		case FAT16:
+			firstClust = firstByte / 2;
+			endClust = endByte / 2;
+			break;
+		case FAT32:
+			firstClust = firstByte / 4;
+			endClust = endByte / 4;
+			break;
+	}
+	firstClust = std::max(firstClust, 2u);
+	endClust = std::min(endClust, CountOfClusters + 2);
+	for (uint32_t clustNum = firstClust; clustNum < endClust; clustNum++)
+		markClusterFree(clustNum, getClusterValue(clustNum) == 0);
+
+	/* Clusters may have been freed anywhere in the sector */
+	freeClusterHint = 0;
+}
+
 uint32_t fatDrive::getSectorCount()
 {
 	if (bootbuffer.totalsectorcount != 0)
@@ -574,17 +710,29 @@ uint32_t fatDrive::getClusterSize(void) {
 	return bootbuffer.sectorspercluster * bootbuffer.bytespersector;
 }
 
-uint32_t fatDrive::getAbsoluteSectFromBytePos(uint32_t startClustNum, uint32_t bytePos) {
-	return  getAbsoluteSectFromChain(startClustNum, bytePos / bootbuffer.bytespersector);
+bool fatDrive::isCursorValid(const FatClusterCursor *cursor, uint32_t startClustNum) const {
+	return cursor && cursor->startCluster == startClustNum && cursor->cluster != 0 &&
+	       cursor->chainGeneration == chainGeneration;
 }
 
-uint32_t fatDrive::getAbsoluteSectFromChain(uint32_t startClustNum, uint32_t logicalSector) {
-	int32_t skipClust = logicalSector / bootbuffer.sectorspercluster;
+uint32_t fatDrive::getAbsoluteSectFromBytePos(uint32_t startClustNum, uint32_t bytePos, FatClusterCursor *cursor) {
+	return  getAbsoluteSectFromChain(startClustNum, bytePos / bootbuffer.bytespersector, cursor);
+}
+
+uint32_t fatDrive::getAbsoluteSectFromChain(uint32_t startClustNum, uint32_t logicalSector, FatClusterCursor *cursor) {
+	const uint32_t logicalClust = logicalSector / bootbuffer.sectorspercluster;
+	int32_t skipClust = logicalClust;
 	uint32_t sectClust = logicalSector % bootbuffer.sectorspercluster;
 
 	uint32_t currentClust = startClustNum;
 	uint32_t testvalue;
 
+	/* Continue from where the previous lookup ended if it's not further along */
+	if (isCursorValid(cursor, startClustNum) && cursor->logicalCluster <= logicalClust) {
+		currentClust = cursor->cluster;
+		skipClust = logicalClust - cursor->logicalCluster;
+	}
+
 	while(skipClust!=0) {
 		bool isEOF = false;
 		testvalue = getClusterValue(currentClust);
@@ -611,6 +759,12 @@ uint32_t fatDrive::getAbsoluteSectFromChain(uint32_t startClustNum, uint32_t log
 		--skipClust;
 	}
 
+	if (cursor) {
+		cursor->startCluster = startClustNum;
+		cursor->logicalCluster = logicalClust;
+		cursor->cluster = currentClust;
+		cursor->chainGeneration = chainGeneration;
+	}
 	return (getClustFirstSect(currentClust) + sectClust);
 }
 
@@ -622,6 +776,7 @@ void fatDrive::deleteClustChain(uint32_t startCluster, uint32_t bytePos) {
 	uint32_t testvalue;
 	uint32_t currentClust = startCluster;
 	bool isEOF = false;
+	++chainGeneration;
 	while(!isEOF) {
 		testvalue = getClusterValue(currentClust);
 		if(testvalue == 0) {
@@ -662,11 +817,18 @@ void fatDrive::deleteClustChain(uint32_t startCluster, uint32_t bytePos) {
 	}
 }
 
-uint32_t fatDrive::appendCluster(uint32_t startCluster) {
+uint32_t fatDrive::appendCluster(uint32_t startCluster, FatClusterCursor *cursor) {
 	uint32_t testvalue;
 	uint32_t currentClust = startCluster;
+	uint32_t logicalClust = 0;
 	bool isEOF = false;
-	
+
+	/* The cursor usually already sits at the end of the chain */
+	if (isCursorValid(cursor, startCluster)) {
+		currentClust = cursor->cluster;
+		logicalClust = cursor->logicalCluster;
+	}
+
 	while(!isEOF) {
 		testvalue = getClusterValue(currentClust);
 		switch(fattype) {
@@ -682,6 +844,7 @@ uint32_t fatDrive::appendCluster(uint32_t startCluster) {
 		}
 		if(isEOF) break;
 		currentClust = testvalue;
+		++logicalClust;
 	}
 
 	uint32_t newClust = getFirstFreeClust();
@@ -692,6 +855,12 @@ uint32_t fatDrive::appendCluster(uint32_t startCluster) {
 
 	zeroOutCluster(newClust);
 
+	if (cursor) {
+		cursor->startCluster = startCluster;
+		cursor->logicalCluster = logicalClust + 1;
+		cursor->cluster = newClust;
+		cursor->chainGeneration = chainGeneration;
+	}
 	return newClust;
 }
 
@@ -741,8 +910,13 @@ fatDrive::fatDrive(const char *sysFilename,
 	  firstDataSector(0),
 	  firstRootDirSect(0),
 	  cwdDirCluster(0),
-	  fatSectBuffer{0},
-	  curFatSect(0)
+	  fatSectorCache(fatCacheEntries),
+	  lastFatSector(&fatSectorCache[0]),
+	  fatCacheTick(0),
+	  chainGeneration(0),
+	  freeClusterMap(),
+	  freeClusterCount(0),
+	  freeClusterHint(0)
 {
 	FILE *diskfile;
 	uint32_t filesize;
@@ -920,8 +1094,7 @@ fatDrive::fatDrive(const char *sysFilename,
 	/* There is no cluster 0, this means we are in the root directory */
 	cwdDirCluster = 0;
 
-	memset(fatSectBuffer,0,1024);
-	curFatSect = 0xffffffff;
+	buildFreeClusterMap();
 
 	safe_strcpy(info, "fatDrive ");
 	safe_strcat(info, sysFilename);
@@ -935,7 +1108,6 @@ bool fatDrive::AllocationInfo(uint16_t *_bytes_sector, uint8_t *_sectors_cluster
 
 	uint32_t hs, cy, sect,sectsize;
 	uint32_t countFree = 0;
-	uint32_t i;
 
 	loadedDisk->Get_Geometry(&hs, &cy, &sect, &sectsize);
 	*_bytes_sector = (uint16_t)sectsize;
@@ -948,11 +1120,7 @@ bool fatDrive::AllocationInfo(uint16_t *_bytes_sector, uint8_t *_sectors_cluster
 		*_total_clusters = 65535;
 	}
 
-	for (i=0; i<CountOfClusters; i++) {
-		if (!getClusterValue(i + 2)) {
-			countFree++;
-		}
-	}
+	countFree = freeClusterCount;
 
 	if (countFree<65536) {
 		*_free_clusters = (uint16_t)countFree;
@@ -964,12 +1132,20 @@ bool fatDrive::AllocationInfo(uint16_t *_bytes_sector, uint8_t *_sectors_cluster
 }
 
 uint32_t fatDrive::getFirstFreeClust(void) {
-	uint32_t i;
-	for(i=0;i<CountOfClusters;i++) {
-		if(!getClusterValue(i+2)) return (i+2);
+	/* Every cluster below the hint is in use, so scan the map from there */
+	for (uint32_t w = freeClusterHint / 64; w < freeClusterMap.size(); w++) {
+		const uint64_t word = freeClusterMap[w];
+		if (word == 0)
+			continue;
+		const uint32_t index = w * 64 + lowest_set_bit(word);
+		if (index >= CountOfClusters)
+			break;
+		freeClusterHint = index;
+		return index + 2;
 	}
 
 	/* No free cluster found */
+	freeClusterHint = CountOfClusters;
 	return 0;
 }
 
@@ -33,6 +33,7 @@
 
 #include "debug.h"
 #include "cpu.h"
+#include "cycle_controller.h"
 #include "video.h"
 #include "pic.h"
 #include "cpu.h"
@@ -136,8 +137,19 @@ static int ticksAdded;
 int ticksDone;
 int ticksScheduled;
 bool ticksLocked;
+static bool unthrottled = false;
 void increaseticks();
 
+// Host time spent sleeping in increaseticks() versus running
+static struct {
+	int64_t start_us = 0;
+	int64_t slept_us = 0;
+} idle_stats;
+
+static std::unique_ptr<CycleController> cycle_controller = {};
+static CycleTelemetry cycle_telemetry = {};
+static std::string cycle_telemetry_path = {};
+
 bool mono_cga=false;
 
 void Null_Init([[maybe_unused]] Section *sec) {
@@ -162,6 +174,7 @@ static Bitu Normal_Loop() {
 			if (!GFX_Events())
 				return 0;
 			if (ticksRemain > 0) {
+				CPU_GuestIdled = false;
 				TIMER_AddTick();
 				ticksRemain--;
 			} else {increaseticks();return 0;}
@@ -169,8 +182,21 @@ static Bitu Normal_Loop() {
 	}
 }
 
+// Auto cycles would keep adjusting against the unlocked clock, so fast
+// forward runs at a fixed share of the last auto-adjusted cycles
+static void disable_auto_cycles()
+{
+	CPU_CycleAutoAdjust = false;
+	CPU_CycleMax /= 3;
+	if (CPU_CycleMax<1000) CPU_CycleMax=1000;
+}
+
 void increaseticks() { //Make it return ticksRemain and set it in the function above to remove the global variable.
 	if (GCC_UNLIKELY(ticksLocked)) { // For Fast Forward Mode
+		// The CPU setup and cycles=auto's switch to protected mode can
+		// turn auto cycles on after an unthrottled start
+		if (unthrottled && CPU_CycleAutoAdjust)
+			disable_auto_cycles();
 		ticksRemain=5;
 		/* Reset any auto cycle guessing for this frame */
 		ticksLast = GetTicks();
@@ -185,8 +211,18 @@ void increaseticks() { //Make it return ticksRemain and set it in the function a
 	if (ticksNew <= ticksLast) { //lower should not be possible, only equal.
 		ticksAdded = 0;
 
-		constexpr auto duration = std::chrono::microseconds(100);
-		std::this_thread::sleep_for(duration);
+		// If the guest idled through the last tick, block until the
+		// next one is due rather than polling the clock
+		const auto sleep_start_us = GetTicksUs();
+		if (CPU_GuestIdled) {
+			const auto next_tick = system_start_time +
+			                       std::chrono::milliseconds(ticksLast + 1);
+			std::this_thread::sleep_until(next_tick);
+		} else {
+			constexpr auto duration = std::chrono::microseconds(100);
+			std::this_thread::sleep_for(duration);
+		}
+		idle_stats.slept_us += GetTicksUs() - sleep_start_us;
 
 		const auto timeslept = GetTicksSince(ticksNew);
 
@@ -218,85 +254,31 @@ void increaseticks() { //Make it return ticksRemain and set it in the function a
 	// Is the system in auto cycle mode guessing ? If not just exit. (It can be temporary disabled)
 	if (!CPU_CycleAutoAdjust || CPU_SkipCycleAutoAdjust) return;
 
-	if (ticksScheduled >= 250 || ticksDone >= 250 || (ticksAdded > 15 && ticksScheduled >= 5) ) {
-		if(ticksDone < 1) ticksDone = 1; // Protect against div by zero
-		/* ratio we are aiming for is around 90% usage*/
-		int32_t ratio = (ticksScheduled * (CPU_CyclePercUsed*90*1024/100/100)) / ticksDone;
-		int32_t new_cmax = CPU_CycleMax;
-		int64_t cproc = (int64_t)CPU_CycleMax * (int64_t)ticksScheduled;
-		double ratioremoved = 0.0; //increase scope for logging
-		if (cproc > 0) {
-			/* ignore the cycles added due to the IO delay code in order
-			   to have smoother auto cycle adjustments */
-			ratioremoved = (double) CPU_IODelayRemoved / (double) cproc;
-			if (ratioremoved < 1.0) {
-				double ratio_not_removed = 1 - ratioremoved;
-				ratio = (int32_t)((double)ratio * ratio_not_removed);
-
-				/* Don't allow very high ratio which can cause us to lock as we don't scale down
-				 * for very low ratios. High ratio might result because of timing resolution */
-				if (ticksScheduled >= 250 && ticksDone < 10 && ratio > 16384)
-					ratio = 16384;
-
-				// Limit the ratio even more when the cycles are already way above the realmode default.
-				if (ticksScheduled >= 250 && ticksDone < 10 && ratio > 5120 && CPU_CycleMax > 50000)
-					ratio = 5120;
-
-				// When downscaling multiple times in a row, ensure a minimum amount of downscaling
-				if (ticksAdded > 15 && ticksScheduled >= 5 && ticksScheduled <= 20 && ratio > 800)
-					ratio = 800;
-
-				if (ratio <= 1024) {
-					// ratio_not_removed = 1.0; //enabling this restores the old formula
-					double r = (1.0 + ratio_not_removed) /(ratio_not_removed + 1024.0/(static_cast<double>(ratio)));
-					new_cmax = 1 + static_cast<int32_t>(CPU_CycleMax * r);
-				} else {
-					int64_t ratio_with_removed = (int64_t) ((((double)ratio - 1024.0) * ratio_not_removed) + 1024.0);
-					int64_t cmax_scaled = (int64_t)CPU_CycleMax * ratio_with_removed;
-					new_cmax = (int32_t)(1 + (CPU_CycleMax >> 1) + cmax_scaled / (int64_t)2048);
-				}
-			}
-		}
+	const CycleSample sample = {ticksDone, ticksScheduled, ticksAdded,
+	                            CPU_IODelayRemoved, CPU_CyclePercUsed};
+	auto new_cmax = CPU_CycleMax;
+	if (!cycle_controller)
+		cycle_controller = std::make_unique<LegacyCycleController>();
+	const bool window_done = cycle_controller->Update(sample, new_cmax);
 
+	if (window_done || new_cmax != CPU_CycleMax) {
 		if (new_cmax < CPU_CYCLES_LOWER_LIMIT)
 			new_cmax = CPU_CYCLES_LOWER_LIMIT;
-		/*
-		LOG(LOG_MISC,LOG_ERROR)("cyclelog: current %06d   cmax %06d   ratio  %05d  done %03d   sched %03d Add %d rr %4.2f",
-			CPU_CycleMax,
-			new_cmax,
-			ratio,
-			ticksDone,
-			ticksScheduled,
-			ticksAdded,
-			ratioremoved);
-		*/
-
-		/* ratios below 1% are considered to be dropouts due to
-		   temporary load imbalance, the cycles adjusting is skipped */
-		if (ratio > 10) {
-			/* ratios below 12% along with a large time since the last update
-			   has taken place are most likely caused by heavy load through a
-			   different application, the cycles adjusting is skipped as well */
-			if ((ratio > 120) || (ticksDone < 700)) {
-				CPU_CycleMax = new_cmax;
-				if (CPU_CycleLimit > 0) {
-					if (CPU_CycleMax > CPU_CycleLimit) CPU_CycleMax = CPU_CycleLimit;
-				} else if (CPU_CycleMax > 2000000) CPU_CycleMax = 2000000; //Hardcoded limit, if no limit was specified.
-			}
-		}
+		if (CPU_CycleLimit > 0) {
+			if (new_cmax > CPU_CycleLimit) new_cmax = CPU_CycleLimit;
+		} else if (new_cmax > 2000000) new_cmax = 2000000; //Hardcoded limit, if no limit was specified.
+		CPU_CycleMax = new_cmax;
+	}
+
+	if (window_done) {
+		if (!cycle_telemetry_path.empty())
+			cycle_telemetry.Record(ticksNew, CPU_CycleMax, sample);
 
 		//Reset cycleguessing parameters.
 		CPU_IODelayRemoved = 0;
 		ticksDone = 0;
 		ticksScheduled = 0;
-	} else if (ticksAdded > 15) {
-		/* ticksAdded > 15 but ticksScheduled < 5, lower the cycles
-		   but do not reset the scheduled/done ticks to take them into
-		   account during the next auto cycle adjustment */
-		CPU_CycleMax /= 3;
-		if (CPU_CycleMax < CPU_CYCLES_LOWER_LIMIT)
-			CPU_CycleMax = CPU_CYCLES_LOWER_LIMIT;
-	} //if (ticksScheduled >= 250 || ticksDone >= 250 || (ticksAdded > 15 && ticksScheduled >= 5) )
+	}
 }
 
 void DOSBOX_SetLoop(LoopHandler * handler) {
@@ -307,6 +289,38 @@ void DOSBOX_SetNormalLoop() {
 	loop=Normal_Loop;
 }
 
+double DOSBOX_GetIdlePercentage()
+{
+	const auto elapsed_us = GetTicksUs() - idle_stats.start_us;
+	if (elapsed_us <= 0)
+		return 0.0;
+	return 100.0 * static_cast<double>(idle_stats.slept_us) /
+	       static_cast<double>(elapsed_us);
+}
+
+void DOSBOX_SetCycleController(std::unique_ptr<CycleController> controller,
+                               const char *telemetry_path)
+{
+	cycle_controller = std::move(controller);
+	cycle_telemetry_path = telemetry_path;
+}
+
+static void DOSBOX_ShutDown([[maybe_unused]] Section *sec)
+{
+	DEBUG_LOG_MSG("DOSBOX: Host was idle for %.1f%% of the run",
+	              DOSBOX_GetIdlePercentage());
+
+	if (cycle_telemetry_path.empty())
+		return;
+	if (cycle_telemetry.WriteCsv(cycle_telemetry_path))
+		LOG_MSG("DOSBOX: Wrote %zu cycle adjustments to %s",
+		        cycle_telemetry.GetEntries().size(),
+		        cycle_telemetry_path.c_str());
+	else
+		LOG_WARNING("DOSBOX: Failed writing cycle telemetry to %s",
+		            cycle_telemetry_path.c_str());
+}
+
 void DOSBOX_RunMachine()
 {
 	while ((*loop)() == 0 && !shutdown_requested)
@@ -315,14 +329,15 @@ void DOSBOX_RunMachine()
 
 static void DOSBOX_UnlockSpeed( bool pressed ) {
 	static bool autoadjust = false;
+	// unthrottled runs are fast forwarded for good
+	if (unthrottled)
+		return;
 	if (pressed) {
 		LOG_MSG("Fast Forward ON");
 		ticksLocked = true;
 		if (CPU_CycleAutoAdjust) {
 			autoadjust = true;
-			CPU_CycleAutoAdjust = false;
-			CPU_CycleMax /= 3;
-			if (CPU_CycleMax<1000) CPU_CycleMax=1000;
+			disable_auto_cycles();
 		}
 	} else {
 		LOG_MSG("Fast Forward OFF");
@@ -340,8 +355,16 @@ static void DOSBOX_RealInit(Section * sec) {
 	ticksRemain=0;
 	ticksLast=GetTicks();
 	ticksLocked = false;
+	unthrottled = section->Get_bool("unthrottled");
+	if (unthrottled) {
+		LOG_MSG("DOSBOX: Running unthrottled");
+		ticksLocked = true;
+	}
+	idle_stats.start_us = GetTicksUs();
+	idle_stats.slept_us = 0;
 	DOSBOX_SetLoop(&Normal_Loop);
 	MSG_Init(section);
+	section->AddDestroyFunction(&DOSBOX_ShutDown);
 
 	MAPPER_AddHandler(DOSBOX_UnlockSpeed, SDL_SCANCODE_F12, MMOD2,
 	                  "speedlock", "Speedlock");
@@ -449,6 +472,14 @@ void DOSBOX_Init() {
 	pstring->Set_help(
 	        "Directory where things like wave, midi, screenshot get captured.");
 
+	pint = secprop->Add_int("capture_threads", when_idle, 1);
+	pint->SetMinMax(1, 64);
+	pint->Set_help(
+	        "Number of threads used to compress captured video (1 by default).\n"
+	        "Higher values split each frame into bands that are compressed in parallel,\n"
+	        "which helps when recording high resolutions. The recordings stay playable\n"
+	        "by any ZMBV decoder.");
+
 #if C_DEBUG
 	LOG_StartUp();
 #endif
@@ -500,6 +531,12 @@ void DOSBOX_Init() {
 	        "to be affected by this. Please file a bug with the project if you find a\n"
 	        "game that fails when this is set to true so we will list them here.");
 
+	Pbool = secprop->Add_bool("unthrottled", only_at_start, false);
+	Pbool->Set_help(
+	        "Run the emulation as fast as the host allows, like a permanent fast\n"
+	        "forward, until the guest exits. Meant for batch jobs together with\n"
+	        "output=none; games will run too fast to be playable.");
+
 	secprop->AddInitFunction(&CALLBACK_Init);
 	secprop->AddInitFunction(&PIC_Init);//done
 	secprop->AddInitFunction(&PROGRAMS_Init);
@@ -539,6 +576,13 @@ void DOSBOX_Init() {
 	pint->SetMinMax(0, 10);
 	pint->Set_help("How many frames DOSBox skips before drawing one.");
 
+	pint = secprop->Add_int("scaler_threads", always, 1);
+	pint->SetMinMax(1, 64);
+	pint->Set_help("Number of threads used to render the advmame, advinterp, hq, 2xsai,\n"
+	               "super2xsai and supereagle scalers (1 by default). With more than\n"
+	               "one, each frame's changed lines are scaled in parallel once the\n"
+	               "frame is complete. The output is the same either way.");
+
 	Pbool = secprop->Add_bool("aspect", always, true);
 	Pbool->Set_help("Scales the vertical resolution to produce a 4:3 display aspect\n"
 	                "ratio, matching that of the original standard-definition monitors\n"
@@ -607,6 +651,14 @@ void DOSBOX_Init() {
 	Pstring->Set_help("CPU Core used in emulation. auto will switch to dynamic if available and\n"
 		"appropriate.");
 
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+	Pint = secprop->Add_int("dynamic_cache", only_at_start, 8);
+	Pint->SetMinMax(2, 128);
+	Pint->Set_help("Size of the dynamic core's code cache in MB (8 by default).\n"
+	               "The pools of translated blocks and code pages grow with it.\n"
+	               "Larger values help titles that run a lot of different code.");
+#endif
+
 	const char* cputype_values[] = { "auto", "386", "386_slow", "486_slow", "pentium_slow", "386_prefetch", 0};
 	Pstring = secprop->Add_string("cputype", always, "auto");
 	Pstring->Set_values(cputype_values);
@@ -641,6 +693,31 @@ void DOSBOX_Init() {
 	Pint->SetMinMax(1,1000000);
 	Pint->Set_help("Setting it lower than 100 will be a percentage.");
 
+	const char *cycle_controllers[] = {"legacy", "pid", 0};
+	Pstring = secprop->Add_string("cycle_controller", always, "legacy");
+	Pstring->Set_values(cycle_controllers);
+	Pstring->Set_help(
+	        "How cycles=auto and max adjust the cycles to the host's speed:\n"
+	        "  legacy:  The ratio heuristic of earlier versions (default).\n"
+	        "  pid:     A feedback controller steering the host CPU usage towards\n"
+	        "           cycle_target. Reacts more smoothly to changing host load.");
+
+	Pint = secprop->Add_int("cycle_target", always, 90);
+	Pint->SetMinMax(10, 100);
+	Pint->Set_help("Percentage of host CPU time the pid cycle controller aims to use (90 by default).\n"
+	               "It's scaled by the percentage given with cycles=auto or max.");
+
+	Pstring = secprop->Add_path("cycle_telemetry", always, "");
+	Pstring->Set_help("Record the cycle controller's measurements and decisions, and write\n"
+	                  "them as CSV to this file on exit (disabled by default).");
+
+	Pbool = secprop->Add_bool("idle_polling", always, false);
+	Pbool->Set_help(
+	        "Let the host sleep when a program busy-waits for input through\n"
+	        "INT 16h, INT 28h, or the keyboard controller (disabled by default).\n"
+	        "Halted CPUs and the BIOS keyboard wait always let the host sleep.\n"
+	        "Programs that time themselves by counting polls may run differently.");
+
 #if C_FPU
 	secprop->AddInitFunction(&FPU_Init);
 #endif
@@ -1039,6 +1116,17 @@ const char *filter_on_or_off[] = {"on", "off", 0};
 	               "If set to 0, the country code corresponding to the\n"
 	               "selected keyboard layout will be used.");
 
+	pint = secprop->Add_int("disk_cache", when_idle, 2048);
+	pint->SetMinMax(0, 262144);
+	pint->Set_help("Size in KiB of the block cache used by each mounted disk image (2048 by default).\n"
+	               "Sequential reads are served ahead of time and writes are collected\n"
+	               "in the cache until the blocks are evicted or the image is closed.\n"
+	               "Set to 0 to access the image file directly, one sector at a time.");
+
+	Pbool = secprop->Add_bool("disk_mmap", when_idle, true);
+	Pbool->Set_help("Map read-only disk images into memory instead of caching them\n"
+	                "(only on hosts that support it, and when disk_cache is not 0).");
+
 	secprop->AddInitFunction(&DOS_KeyboardLayout_Init,true);
 	Pstring = secprop->Add_string("keyboardlayout", when_idle,  "auto");
 	Pstring->Set_help("Language code of the keyboard layout (or none).");
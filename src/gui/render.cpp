@@ -24,6 +24,7 @@
 #include <cstring>
 #include <fstream>
 #include <functional>
+#include <memory>
 #include <regex>
 #include <sstream>
 #include <unordered_map>
@@ -41,12 +42,18 @@
 #include "shell.h"
 #include "string_utils.h"
 #include "vga.h"
+#include "worker_pool.h"
 
 #include "render_scalers.h"
 
 Render_t render;
 ScalerLineHandler_t RENDER_DrawLine;
 
+#if RENDER_USE_ADVANCED_SCALERS>1
+// Renders the complex scalers' changed lines in parallel, if enabled
+static std::unique_ptr<WorkerPool> scaler_workers = {};
+#endif
+
 static void RENDER_CallBack( GFX_CallBackFunctions_t function );
 
 static void Check_Palette(void) {
@@ -107,24 +114,18 @@ static void RENDER_EmptyLineHandler(const void *)
 {}
 
 static void RENDER_StartLineHandler(const void * s) {
-	if (s) {
-		const Bitu *src = (Bitu*)s;
-		Bitu *cache = (Bitu*)(render.scale.cacheRead);
-		for (Bits x=render.src.start;x>0;) {
-			const auto src_ptr = reinterpret_cast<const uint8_t *>(src);
-			const auto src_val = read_unaligned_size_t(src_ptr);
-			if (GCC_UNLIKELY(src_val != cache[0])) {
-				if (!GFX_StartUpdate(render.scale.outWrite, render.scale.outPitch)) {
-					RENDER_DrawLine = RENDER_EmptyLineHandler;
-					return;
-				}
-				render.scale.outWrite += render.scale.outPitch * Scaler_ChangedLines[0];
-				RENDER_DrawLine = render.scale.lineHandler;
-				RENDER_DrawLine( s );
-				return;
-			}
-			x--; src++; cache++;
+	// Most lines of a typical frame are unchanged, so compare the whole
+	// line up front; memcmp is vectorised by every C library we target
+	const auto line_bytes = static_cast<size_t>(render.src.start) * sizeof(Bitu);
+	if (s && GCC_UNLIKELY(memcmp(s, render.scale.cacheRead, line_bytes) != 0)) {
+		if (!GFX_StartUpdate(render.scale.outWrite, render.scale.outPitch)) {
+			RENDER_DrawLine = RENDER_EmptyLineHandler;
+			return;
 		}
+		render.scale.outWrite += render.scale.outPitch * Scaler_ChangedLines[0];
+		RENDER_DrawLine = render.scale.lineHandler;
+		RENDER_DrawLine( s );
+		return;
 	}
 	render.scale.cacheRead += render.scale.cachePitch;
 	Scaler_ChangedLines[0] += Scaler_Aspect[ render.scale.inLine ];
@@ -161,6 +162,11 @@ bool RENDER_StartUpdate(void) {
 		return false;
 	if (GCC_UNLIKELY(!render.active))
 		return false;
+	// Without an output, only frames being captured need to be rendered.
+	// The source cache keeps the last rendered lines, so the compare
+	// still works out which lines changed in the meantime.
+	if (GFX_IsHeadless() && !(CaptureState & (CAPTURE_IMAGE | CAPTURE_VIDEO)))
+		return false;
 	if (GCC_UNLIKELY(render.frameskip.count<render.frameskip.max)) {
 		render.frameskip.count++;
 		return false;
@@ -206,6 +212,9 @@ bool RENDER_StartUpdate(void) {
 
 static void RENDER_Halt( void ) {
 	RENDER_DrawLine = RENDER_EmptyLineHandler;
+#if RENDER_USE_ADVANCED_SCALERS>1
+	Scaler_ClearQueuedLines();
+#endif
 	GFX_EndUpdate( 0 );
 	render.updating=false;
 	render.active=false;
@@ -233,6 +242,9 @@ void RENDER_EndUpdate( bool abort ) {
 		                 pitch, flags, static_cast<float>(fps), (uint8_t *)&scalerSourceCache,
 		                 (uint8_t *)&render.pal.rgb);
 	}
+#if RENDER_USE_ADVANCED_SCALERS>1
+	Scaler_RenderQueuedLines(scaler_workers.get());
+#endif
 	if ( render.scale.outWrite ) {
 		GFX_EndUpdate( abort? NULL : Scaler_ChangedLines );
 		render.frameskip.hadSkip[render.frameskip.index] = 0;
@@ -303,7 +315,10 @@ static void RENDER_Reset( void ) {
 	Bitu maxsize_current_input = SCALER_MAXLINE_WIDTH/width;
 	if (render.scale.size > maxsize_current_input) render.scale.size = maxsize_current_input;
 
-	if ((dblh && dblw) || (render.scale.forced && !dblh && !dblw)) {
+	if (GFX_IsHeadless()) {
+		// Captures are taken from the unscaled source cache
+		simpleBlock = &ScaleNormal1x;
+	} else if ((dblh && dblw) || (render.scale.forced && !dblh && !dblw)) {
 		/* Initialize always working defaults */
 		if (render.scale.size == 2)
 			simpleBlock = &ScaleNormal2x;
@@ -546,6 +561,9 @@ forcenormal:
 	memset(render.pal.modified, 0, sizeof(render.pal.modified));
 	//Finish this frame using a copy only handler
 	RENDER_DrawLine = RENDER_FinishLineHandler;
+#if RENDER_USE_ADVANCED_SCALERS>1
+	Scaler_ClearQueuedLines();
+#endif
 	render.scale.outWrite = 0;
 	/* Signal the next frame to first reinit the cache */
 	render.scale.clearCache = true;
@@ -839,6 +857,16 @@ void RENDER_Init(Section *sec)
 	render.aspect=section->Get_bool("aspect");
 	render.frameskip.max=section->Get_int("frameskip");
 	render.frameskip.count=0;
+#if RENDER_USE_ADVANCED_SCALERS>1
+	// Queued lines are rendered at the end of the frame with whichever pool
+	// exists by then, so it's safe to swap the pool out mid-frame
+	const auto scaler_threads = section->Get_int("scaler_threads");
+	if (scaler_threads <= 1)
+		scaler_workers.reset();
+	else if (!scaler_workers || scaler_workers->NumThreads() != scaler_threads)
+		scaler_workers = std::make_unique<WorkerPool>(scaler_threads);
+	render.scale.parallel = (scaler_workers != nullptr);
+#endif
 	VGA_SetMonoPalette(section->Get_string("monochrome_palette"));
 	std::string cline;
 	std::string scaler;
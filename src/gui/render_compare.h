@@ -0,0 +1,82 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_RENDER_COMPARE_H
+#define DOSBOX_RENDER_COMPARE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mem_unaligned.h"
+#include "simd.h"
+
+// Source lines are compared against the scaler's source cache in blocks of
+// this many bytes. It's a multiple of the machine word, so skipping whole
+// blocks keeps the scalers' word-sized steps aligned to the line start.
+constexpr size_t RENDER_COMPARE_BLOCK = 16;
+
+#if defined(HAS_AVX2)
+SIMD_TARGET_AVX2 static inline size_t render_unchanged_avx2(const uint8_t *src,
+                                                             const uint8_t *cache,
+                                                             const size_t num_bytes)
+{
+	size_t i = 0;
+	for (; i + 32 <= num_bytes; i += 32) {
+		const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+		const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cache + i));
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)) != -1)
+			break;
+	}
+	return i;
+}
+#endif
+
+// Returns how many bytes at the start of the line are unchanged, rounded
+// down to whole RENDER_COMPARE_BLOCKs. Nothing past num_bytes is read; the
+// caller compares whatever partial block remains.
+static inline size_t RENDER_CountUnchangedBytes(const uint8_t *src,
+                                                const uint8_t *cache,
+                                                const size_t num_bytes)
+{
+	size_t i = 0;
+#if defined(HAS_AVX2)
+	if (host_has_avx2())
+		i = render_unchanged_avx2(src, cache, num_bytes);
+#endif
+	for (; i + RENDER_COMPARE_BLOCK <= num_bytes; i += RENDER_COMPARE_BLOCK) {
+#if defined(HAS_SSE2)
+		const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+		const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cache + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xffff)
+			break;
+#elif defined(HAS_NEON)
+		const auto diff = veorq_u8(vld1q_u8(src + i), vld1q_u8(cache + i));
+		if (vmaxvq_u8(diff))
+			break;
+#else
+		if ((read_unaligned_uint64(src + i) ^ read_unaligned_uint64(cache + i)) |
+		    (read_unaligned_uint64(src + i + 8) ^ read_unaligned_uint64(cache + i + 8)))
+			break;
+#endif
+	}
+	return i;
+}
+
+#endif
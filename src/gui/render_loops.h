@@ -16,33 +16,25 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+/* Renders the changed blocks of a single output line. This only touches the
+ * given line's change markers and output, so different lines can be rendered
+ * on different threads once the frame cache holds their neighbours. */
 #if defined (SCALERLINEAR)
-static void conc3d(SCALERNAME,SBPP,L)(void) {
-#else
-static void conc3d(SCALERNAME,SBPP,R)(void) {
-#endif
-//Skip the first one for multiline input scalers
-	if (!render.scale.outLine) {
-		render.scale.outLine++;
-		return;
-	}
-lastagain:
-	if (!CC[render.scale.outLine][0]) {
-#if defined(SCALERLINEAR) 
-		Bitu scaleLines = SCALERHEIGHT;
+static void conc3d(SCALERNAME,SBPP,LineL)(const Bitu outLine, uint8_t *outWrite,
+                                          scalerWriteCache_t *writeCache) {
+	auto &wc = writeCache->WCM;
 #else
-		Bitu scaleLines = Scaler_Aspect[ render.scale.outLine ];
+static void conc3d(SCALERNAME,SBPP,LineR)(const Bitu outLine, uint8_t *outWrite,
+                                          [[maybe_unused]] scalerWriteCache_t *writeCache) {
 #endif
-		ScalerAddLines( 0, scaleLines );
-		if (++render.scale.outLine == render.scale.inHeight)
-			goto lastagain;
-		return;
-	}
 	/* Clear the complete line marker */
-	CC[render.scale.outLine][0] = 0;
-	const PTYPE * fc = &FC[render.scale.outLine][1];
-	PTYPE * line0=(PTYPE *)(render.scale.outWrite);
-	uint8_t * changed = &CC[render.scale.outLine][1];
+	CC[outLine][0] = 0;
+	const PTYPE * fc = &FC[outLine][1];
+	/* Read the row below next as it was when this line was reached */
+	[[maybe_unused]] const Bits fdOffset = 2 * SCALER_COMPLEXWIDTH +
+		(ScalerRowSaved(outLine + 2) ? &FS[0][0] - &FC[0][0] : 0);
+	PTYPE * line0=(PTYPE *)(outWrite);
+	uint8_t * changed = &CC[outLine][1];
 	Bitu b;
 	for (b=0;b<render.scale.blocks;b++) {
 #if (SCALERHEIGHT > 1) 
@@ -131,16 +123,16 @@ lastagain:
 		default:
 #if defined(SCALERLINEAR)
 #if (SCALERHEIGHT > 1) 
-			line1 = WC[0];
+			line1 = wc[0];
 #endif
 #if (SCALERHEIGHT > 2) 
-			line2 = WC[1];
+			line2 = wc[1];
 #endif
 #if (SCALERHEIGHT > 3) 
-			line3 = WC[2];
+			line3 = wc[2];
 #endif
 #if (SCALERHEIGHT > 4) 
-			line4 = WC[3];
+			line4 = wc[3];
 #endif
 #else
 #if (SCALERHEIGHT > 1) 
@@ -175,31 +167,65 @@ lastagain:
 			}
 #if defined(SCALERLINEAR)
 #if (SCALERHEIGHT > 1) 
-			BituMove((uint8_t*)(&line0[-SCALER_BLOCKSIZE*SCALERWIDTH])+render.scale.outPitch  ,WC[0], SCALER_BLOCKSIZE *SCALERWIDTH*PSIZE);
+			BituMove((uint8_t*)(&line0[-SCALER_BLOCKSIZE*SCALERWIDTH])+render.scale.outPitch  ,wc[0], SCALER_BLOCKSIZE *SCALERWIDTH*PSIZE);
 #endif
 #if (SCALERHEIGHT > 2) 
-			BituMove((uint8_t*)(&line0[-SCALER_BLOCKSIZE*SCALERWIDTH])+render.scale.outPitch*2,WC[1], SCALER_BLOCKSIZE *SCALERWIDTH*PSIZE);
+			BituMove((uint8_t*)(&line0[-SCALER_BLOCKSIZE*SCALERWIDTH])+render.scale.outPitch*2,wc[1], SCALER_BLOCKSIZE *SCALERWIDTH*PSIZE);
 #endif
 #if (SCALERHEIGHT > 3) 
-			BituMove((uint8_t*)(&line0[-SCALER_BLOCKSIZE*SCALERWIDTH])+render.scale.outPitch*3,WC[2], SCALER_BLOCKSIZE *SCALERWIDTH*PSIZE);
+			BituMove((uint8_t*)(&line0[-SCALER_BLOCKSIZE*SCALERWIDTH])+render.scale.outPitch*3,wc[2], SCALER_BLOCKSIZE *SCALERWIDTH*PSIZE);
 #endif
 #if (SCALERHEIGHT > 4) 
-			BituMove((uint8_t*)(&line0[-SCALER_BLOCKSIZE*SCALERWIDTH])+render.scale.outPitch*4,WC[3], SCALER_BLOCKSIZE *SCALERWIDTH*PSIZE);
+			BituMove((uint8_t*)(&line0[-SCALER_BLOCKSIZE*SCALERWIDTH])+render.scale.outPitch*4,wc[3], SCALER_BLOCKSIZE *SCALERWIDTH*PSIZE);
 #endif
 #endif //defined(SCALERLINEAR)
 			break;
 		}
 	}
+#if !defined(SCALERLINEAR)
+	Bitu scaleLines = Scaler_Aspect[ outLine ];
+	if ( ((Bits)(scaleLines - SCALERHEIGHT)) > 0 ) {
+		BituMove( outWrite + render.scale.outPitch * SCALERHEIGHT,
+			outWrite + render.scale.outPitch * (SCALERHEIGHT-1),
+			render.src.width * SCALERWIDTH * PSIZE);
+	}
+#endif
+}
+
+#if defined (SCALERLINEAR)
+static void conc3d(SCALERNAME,SBPP,L)(void) {
+#else
+static void conc3d(SCALERNAME,SBPP,R)(void) {
+#endif
+//Skip the first one for multiline input scalers
+	if (!render.scale.outLine) {
+		render.scale.outLine++;
+		return;
+	}
+lastagain:
 #if defined(SCALERLINEAR) 
 	Bitu scaleLines = SCALERHEIGHT;
 #else
 	Bitu scaleLines = Scaler_Aspect[ render.scale.outLine ];
-	if ( ((Bits)(scaleLines - SCALERHEIGHT)) > 0 ) {
-		BituMove( render.scale.outWrite + render.scale.outPitch * SCALERHEIGHT,
-			render.scale.outWrite + render.scale.outPitch * (SCALERHEIGHT-1),
-			render.src.width * SCALERWIDTH * PSIZE);
-	}
 #endif
+	if (!CC[render.scale.outLine][0]) {
+		ScalerAddLines( 0, scaleLines );
+		if (++render.scale.outLine == render.scale.inHeight)
+			goto lastagain;
+		return;
+	}
+#if defined (SCALERLINEAR)
+	const auto lineHandler = conc3d(SCALERNAME,SBPP,LineL);
+#else
+	const auto lineHandler = conc3d(SCALERNAME,SBPP,LineR);
+#endif
+	if (render.scale.parallel) {
+		/* Queued lines must not overlap each other's output */
+		assert(scaleLines >= SCALERHEIGHT);
+		ScalerQueueLine( lineHandler, render.scale.outLine, render.scale.outWrite );
+	} else {
+		lineHandler( render.scale.outLine, render.scale.outWrite, &scalerWriteCache );
+	}
 	ScalerAddLines( 1, scaleLines );
 	if (++render.scale.outLine == render.scale.inHeight)
 		goto lastagain;
@@ -23,18 +23,25 @@
 
 #include "dosbox.h"
 #include "render.h"
+#include <algorithm>
+#include <cassert>
+#include <memory>
 #include <string.h>
+#include <vector>
+
+#include "worker_pool.h"
 
 uint8_t Scaler_Aspect[SCALER_MAXHEIGHT];
 uint16_t Scaler_ChangedLines[SCALER_MAXHEIGHT];
 Bitu Scaler_ChangedLineIndex;
 
-static union {
+typedef union {
 	 //The +1 is a at least for the normal scalers not needed. (-1 is enough)
 	uint32_t b32 [SCALER_MAX_MUL_HEIGHT + 1][SCALER_MAXLINE_WIDTH];
 	uint16_t b16 [SCALER_MAX_MUL_HEIGHT + 1][SCALER_MAXLINE_WIDTH];
 	uint8_t   b8 [SCALER_MAX_MUL_HEIGHT + 1][SCALER_MAXLINE_WIDTH];
-} scalerWriteCache;
+} scalerWriteCache_t;
+static scalerWriteCache_t scalerWriteCache;
 //scalerFrameCache_t scalerFrameCache;
 scalerSourceCache_t scalerSourceCache;
 #if RENDER_USE_ADVANCED_SCALERS>1
@@ -72,6 +79,80 @@ static inline void ScalerAddLines( Bitu changed, Bitu count ) {
 }
 
 
+#if RENDER_USE_ADVANCED_SCALERS>1
+typedef void (*ScalerComplexLineHandler_t)(Bitu outLine, uint8_t *outWrite,
+                                           scalerWriteCache_t *writeCache);
+
+/* Changed lines of the current frame that the complex scaler has queued up
+ * to be rendered in parallel once the frame is complete. */
+static struct {
+	ScalerComplexLineHandler_t handler = nullptr;
+	std::vector<std::pair<Bitu, uint8_t *>> lines = {};
+	// One write cache per band, as the linear scalers stage lines in it
+	std::vector<std::unique_ptr<scalerWriteCache_t>> writeCaches = {};
+} scalerQueue;
+
+/* Most complex scalers only look at the rows next to a line, which are final
+ * by the time the line is reached. The SaI scalers also read the row below
+ * next, which the serial path sees before that row is updated. So when lines
+ * are queued, each frame cache row is saved before it's changed, and queued
+ * lines read the saved copy instead. */
+static bool scalerRowSaved[SCALER_COMPLEXHEIGHT] = {};
+
+static inline void ScalerSaveRow(Bitu row, void *saved, const void *current, size_t size) {
+	memcpy(saved, current, size);
+	scalerRowSaved[row] = true;
+}
+
+static inline bool ScalerRowSaved(Bitu row) {
+	return scalerRowSaved[row];
+}
+
+static inline void ScalerQueueLine(ScalerComplexLineHandler_t handler,
+                                   Bitu outLine, uint8_t *outWrite) {
+	assert(!scalerQueue.handler || scalerQueue.handler == handler);
+	scalerQueue.handler = handler;
+	scalerQueue.lines.emplace_back(outLine, outWrite);
+}
+
+void Scaler_RenderQueuedLines(WorkerPool *workers) {
+	const auto &lines = scalerQueue.lines;
+	if (lines.empty()) {
+		Scaler_ClearQueuedLines();
+		return;
+	}
+	const auto handler = scalerQueue.handler;
+	assert(handler);
+
+	// A few bands per thread evens out lines that differ in cost
+	const auto num_threads = workers ? workers->NumThreads() : 1;
+	const auto num_bands = static_cast<int>(
+	        std::min(lines.size(), static_cast<size_t>(num_threads) * 4));
+	auto &caches = scalerQueue.writeCaches;
+	while (caches.size() < static_cast<size_t>(num_bands))
+		caches.emplace_back(std::make_unique<scalerWriteCache_t>());
+
+	auto render_band = [&](const int band) {
+		const auto first = lines.size() * band / num_bands;
+		const auto end = lines.size() * (band + 1) / num_bands;
+		for (auto i = first; i < end; ++i)
+			handler(lines[i].first, lines[i].second, caches[band].get());
+	};
+	if (workers)
+		workers->Run(num_bands, render_band);
+	else
+		for (auto band = 0; band < num_bands; ++band)
+			render_band(band);
+	Scaler_ClearQueuedLines();
+}
+
+void Scaler_ClearQueuedLines() {
+	scalerQueue.handler = nullptr;
+	scalerQueue.lines.clear();
+	memset(scalerRowSaved, 0, sizeof(scalerRowSaved));
+}
+#endif
+
 #define BituMove2(_DST,_SRC,_SIZE)			\
 {											\
 	Bitu bsize=(_SIZE)/sizeof(Bitu);		\
@@ -148,5 +148,12 @@ extern ScalerComplexBlock_t ScaleAdvInterp3x;
 #endif
 #if RENDER_USE_ADVANCED_SCALERS>1
 extern ScalerLineBlock_t ScalerCache;
+
+/* With render.scale.parallel set, the complex scalers queue up the changed
+ * lines of a frame instead of rendering them as they come in. They're then
+ * rendered in bands on the given workers, or on this thread without any. */
+class WorkerPool;
+void Scaler_RenderQueuedLines(WorkerPool *workers);
+void Scaler_ClearQueuedLines();
 #endif
 #endif
@@ -17,6 +17,7 @@
  */
 
 #include "mem_unaligned.h"
+#include "render_compare.h"
 
 #if SCALER_MAX_MUL_HEIGHT < SCALERHEIGHT
 #error "Scaler goes too high"
@@ -48,6 +49,17 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 	const SRCTYPE *src = (SRCTYPE*)s;
 	SRCTYPE *cache = (SRCTYPE*)(render.scale.cacheRead);
 	render.scale.cacheRead += render.scale.cachePitch;
+#if (SBPP != 9)
+	/* Skip all scaler work for lines that didn't change at all */
+	if (memcmp(src, cache, render.src.width * sizeof(SRCTYPE)) == 0) {
+#if defined(SCALERLINEAR)
+		ScalerAddLines( 0, SCALERHEIGHT );
+#else
+		ScalerAddLines( 0, Scaler_Aspect[ render.scale.outLine++ ] );
+#endif
+		return;
+	}
+#endif
 	PTYPE * line0=(PTYPE *)(render.scale.outWrite);
 #if (SBPP == 9)
 	for (Bits x=render.src.width;x>0;) {
@@ -65,9 +77,22 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 
 	for (Bits x = render.src.width; x > 0;) {
 		const auto src_ptr = reinterpret_cast<const uint8_t *>(src);
-		const auto src_val = read_unaligned_size_t(src_ptr);
-
 		const auto cache_ptr = reinterpret_cast<uint8_t *>(cache);
+
+		/* Skip unchanged runs a vector at a time, in whole word steps */
+		const auto same_bytes = RENDER_CountUnchangedBytes(src_ptr, cache_ptr,
+		                                                   x * sizeof(SRCTYPE));
+		const auto same = static_cast<Bits>(same_bytes / sizeof(SRCTYPE) /
+		                                    address_step * address_step);
+		if (same) {
+			x -= same;
+			src += same;
+			cache += same;
+			line0 += same * SCALERWIDTH;
+			continue;
+		}
+
+		const auto src_val = read_unaligned_size_t(src_ptr);
 		const auto cache_val = read_unaligned_size_t(cache_ptr);
 
 		if (src_val == cache_val) {
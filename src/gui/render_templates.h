@@ -20,8 +20,10 @@
 #define PSIZE 1
 #define PTYPE uint8_t
 #define WC scalerWriteCache.b8
+#define WCM b8
 //#define FC scalerFrameCache.b8
 #define FC (*(scalerFrameCache_t*)(&scalerSourceCache.b32[400][0])).b8
+#define FS (*(scalerFrameCache_t*)(&scalerSourceCache.b32[700][0])).b8
 #define redMask		0
 #define	greenMask	0
 #define blueMask	0
@@ -35,8 +37,10 @@
 #define PSIZE 2
 #define PTYPE uint16_t
 #define WC scalerWriteCache.b16
+#define WCM b16
 //#define FC scalerFrameCache.b16
 #define FC (*(scalerFrameCache_t*)(&scalerSourceCache.b32[400][0])).b16
+#define FS (*(scalerFrameCache_t*)(&scalerSourceCache.b32[700][0])).b16
 #if DBPP == 15
 #define	redMask		0x7C00
 #define	greenMask	0x03E0
@@ -62,8 +66,10 @@
 #define PSIZE 4
 #define PTYPE uint32_t
 #define WC scalerWriteCache.b32
+#define WCM b32
 //#define FC scalerFrameCache.b32
 #define FC (*(scalerFrameCache_t*)(&scalerSourceCache.b32[400][0])).b32
+#define FS (*(scalerFrameCache_t*)(&scalerSourceCache.b32[700][0])).b32
 #define redMask		0xff0000
 #define greenMask	0x00ff00
 #define blueMask	0x0000ff
@@ -186,13 +192,15 @@
 #define C7 fc[+0 + SCALER_COMPLEXWIDTH]
 #define C8 fc[+1 + SCALER_COMPLEXWIDTH]
 
-#define D0 fc[-1 + 2*SCALER_COMPLEXWIDTH]
-#define D1 fc[+0 + 2*SCALER_COMPLEXWIDTH]
-#define D2 fc[+1 + 2*SCALER_COMPLEXWIDTH]
+// The bottom row is read through fd, as the line might be rendered after
+// that row was updated; see ScalerSaveRow
+#define D0 fd[-1]
+#define D1 fd[+0]
+#define D2 fd[+1]
 #define D3 fc[+2 - SCALER_COMPLEXWIDTH]
 #define D4 fc[+2]
 #define D5 fc[+2 + SCALER_COMPLEXWIDTH]
-#define D6 fc[+2 + 2*SCALER_COMPLEXWIDTH]
+#define D6 fd[+2]
 
 #if (SBPP != 9) || (DBPP != 8)
 
@@ -210,6 +218,17 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	PTYPE *fc= &FC[render.scale.inLine+1][1];
 	SRCTYPE *sc = (SRCTYPE*)(render.scale.cacheRead);
 	render.scale.cacheRead += render.scale.cachePitch;
+#if (SBPP != 9)
+	/* Unchanged lines need no frame cache or change map updates */
+	if (memcmp(src, sc, render.scale.blocks * SCALER_BLOCKSIZE * sizeof(SRCTYPE)) == 0) {
+		render.scale.inLine++;
+		render.scale.complexHandler();
+		return;
+	}
+#endif
+	if (render.scale.parallel)
+		ScalerSaveRow(render.scale.inLine + 1, &FS[render.scale.inLine + 1][0],
+		              &FC[render.scale.inLine + 1][0], sizeof(FC[0]));
 	Bitu b;
 	bool hadChange = false;
 	/* This should also copy the surrounding pixels but it looks nice enough without */
@@ -483,7 +502,7 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERNAME		Super2xSaI
 #define SCALERWIDTH		2
 #define SCALERHEIGHT	2
-#define SCALERFUNC		conc2d(Super2xSaI,SBPP)(line0, line1, fc)
+#define SCALERFUNC		conc2d(Super2xSaI,SBPP)(line0, line1, fc, fc + fdOffset)
 #include "render_loops.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
@@ -493,7 +512,7 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERNAME		SuperEagle
 #define SCALERWIDTH		2
 #define SCALERHEIGHT	2
-#define SCALERFUNC		conc2d(SuperEagle,SBPP)(line0, line1, fc)
+#define SCALERFUNC		conc2d(SuperEagle,SBPP)(line0, line1, fc, fc + fdOffset)
 #include "render_loops.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
@@ -503,7 +522,7 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERNAME		_2xSaI
 #define SCALERWIDTH		2
 #define SCALERHEIGHT	2
-#define SCALERFUNC		conc2d(_2xSaI,SBPP)(line0, line1, fc)
+#define SCALERFUNC		conc2d(_2xSaI,SBPP)(line0, line1, fc, fc + fdOffset)
 #include "render_loops.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
@@ -616,8 +635,10 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #undef PTYPE
 #undef PMAKE
 #undef WC
+#undef WCM
 #undef LC
 #undef FC
+#undef FS
 #undef SC
 #undef redMask
 #undef greenMask
@@ -65,6 +65,10 @@ static inline void conc2d(InitLUTs,SBPP)(void)
 	int r, g, b;
 	int Y, u, v;
 
+	// Shared with the other source depths
+	if (_RGBtoYUV)
+		return;
+
 	_RGBtoYUV = (uint32_t *)malloc(65536 * sizeof(uint32_t));
 	if (_RGBtoYUV == nullptr) {
 		return;
@@ -89,7 +89,9 @@
 
 inline void conc2d(Hq3x,SBPP)(PTYPE * line0, PTYPE * line1, PTYPE * line2, const PTYPE * fc)
 {
-	if (_RGBtoYUV == 0) conc2d(InitLUTs,SBPP)();
+	// Lines can be scaled on several threads, so only set up the tables once
+	static const bool has_luts = (conc2d(InitLUTs,SBPP)(), true);
+	(void)has_luts;
 
 	uint32_t pattern = 0;
 	const uint32_t YUV4 = RGBtoYUV(C4);
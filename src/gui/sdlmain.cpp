@@ -24,6 +24,7 @@
 #include <array>
 #include <cassert>
 #include <cerrno>
+#include <csignal>
 #include <cstdlib>
 #include <string.h>
 #include <stdio.h>
@@ -53,6 +54,7 @@
 #include "debug.h"
 #include "fs_utils.h"
 #include "gui_msgs.h"
+#include "hardware.h"
 #include "../ints/int10.h"
 #include "joystick.h"
 #include "keyboard.h"
@@ -576,6 +578,7 @@ check_surface:
 	case SCREEN_OPENGL:
 #endif
 	case SCREEN_TEXTURE:
+	case SCREEN_NONE:
 		// We only accept 32bit output from the scalers here
 		if (!(flags&GFX_CAN_32)) goto check_surface;
 		flags|=GFX_SCALING;
@@ -1308,6 +1311,10 @@ static SDL_Rect get_canvas_size(const SCREEN_TYPES screen_type)
 		SDL_GL_GetDrawableSize(sdl.window, &canvas.w, &canvas.h);
 		break;
 #endif
+	case SCREEN_NONE:
+		canvas.w = sdl.draw.width;
+		canvas.h = sdl.draw.height;
+		break;
 	}
 
 	assert(canvas.w > 0 && canvas.h > 0);
@@ -2047,11 +2054,26 @@ dosurface:
 		break; // SCREEN_OPENGL
 	}
 #endif // C_OPENGL
+
+	case SCREEN_NONE:
+		// Nothing is shown, so the frame is only kept for captures
+		sdl.clip = {0, 0, width, height};
+		sdl.headless.pitch = width * 4;
+		sdl.headless.framebuf.resize(static_cast<size_t>(sdl.headless.pitch) *
+		                             static_cast<size_t>(height));
+		retFlags = GFX_CAN_32 | GFX_SCALING;
+
+		sdl.frame.update = update_frame_noop;
+		sdl.frame.present = present_frame_noop;
+
+		sdl.desktop.type = SCREEN_NONE;
+		break; // SCREEN_NONE
 	}
 
 	// Ensure mouse emulation knows the current parameters
 	NewMouseScreenParams();
-	update_vsync_state();
+	if (sdl.desktop.type != SCREEN_NONE)
+		update_vsync_state();
 
 	if (retFlags)
 		GFX_Start();
@@ -2210,6 +2232,9 @@ void sticky_keys(bool restore){
 
 void GFX_SwitchFullScreen()
 {
+	if (sdl.desktop.want_type == SCREEN_NONE)
+		return;
+
 	sdl.desktop.switching_fullscreen = true;
 #if defined (WIN32)
 	// We are about to switch to the opposite of our current mode
@@ -2291,6 +2316,13 @@ bool GFX_StartUpdate(uint8_t * &pixels, int &pitch)
 		pitch = sdl.surface->pitch;
 		sdl.updating = true;
 		return true;
+	case SCREEN_NONE:
+		if (sdl.headless.framebuf.empty())
+			return false;
+		pixels = sdl.headless.framebuf.data();
+		pitch = sdl.headless.pitch;
+		sdl.updating = true;
+		return true;
 	}
 	return false;
 }
@@ -2320,16 +2352,39 @@ void GFX_EndUpdate(const uint16_t *changedLines)
 	sdl.updating = false;
 }
 
+// Walks the renderer's changed-lines list, which alternates between counts
+// of unchanged and changed lines starting with an unchanged count, and calls
+// update(y, height) for each run of changed lines in the frame.
+template <typename Func>
+static void for_each_changed_span(const uint16_t *changedLines, Func update)
+{
+	assert(changedLines);
+	int y = 0;
+	size_t index = 0;
+	while (y < sdl.draw.height) {
+		const int height = changedLines[index];
+		if (index & 1)
+			update(y, std::min(height, sdl.draw.height - y));
+		y += height;
+		index++;
+	}
+}
+
 // Texture update and presentation
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-static void update_frame_texture([[maybe_unused]] const uint16_t *changedLines)
+static void update_frame_texture(const uint16_t *changedLines)
 {
-	if (sdl.update_display_contents) {
-		SDL_UpdateTexture(sdl.texture.texture,
-		                  nullptr, // update entire texture
-		                  sdl.texture.input_surface->pixels,
-		                  sdl.texture.input_surface->pitch);
-	}
+	// The texture keeps the previous frame, so only the lines the renderer
+	// reports as changed need to be uploaded
+	if (!sdl.update_display_contents || !changedLines)
+		return;
+
+	const auto pixels = static_cast<uint8_t *>(sdl.texture.input_surface->pixels);
+	const auto pitch = sdl.texture.input_surface->pitch;
+	for_each_changed_span(changedLines, [&](const int y, const int height) {
+		const SDL_Rect rect = {0, y, sdl.draw.width, height};
+		SDL_UpdateTexture(sdl.texture.texture, &rect, pixels + y * pitch, pitch);
+	});
 }
 
 static bool present_frame_texture()
@@ -2347,13 +2402,21 @@ static bool present_frame_texture()
 // OpenGL PBO-based update, frame-based update, and presentation
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 #if C_OPENGL
-static void update_frame_gl_pbo([[maybe_unused]] const uint16_t *changedLines)
+static void update_frame_gl_pbo(const uint16_t *changedLines)
 {
 	if (sdl.updating) {
 		glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, sdl.draw.width,
-		                sdl.draw.height, GL_BGRA_EXT,
-		                GL_UNSIGNED_INT_8_8_8_8_REV, 0);
+		// With a pixel buffer bound, the data pointer is an offset into it
+		if (changedLines) {
+			const auto pitch = static_cast<uintptr_t>(sdl.opengl.pitch);
+			for_each_changed_span(changedLines, [&](const int y, const int height) {
+				const auto offset = static_cast<uintptr_t>(y) * pitch;
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y,
+				                sdl.draw.width, height, GL_BGRA_EXT,
+				                GL_UNSIGNED_INT_8_8_8_8_REV,
+				                reinterpret_cast<const void *>(offset));
+			});
+		}
 		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT, 0);
 	} else {
 		sdl.opengl.actual_frame_count++;
@@ -2365,21 +2428,11 @@ static void update_frame_gl_fb(const uint16_t *changedLines)
 	if (changedLines) {
 		const auto framebuf = static_cast<uint8_t *>(sdl.opengl.framebuf);
 		const auto pitch = sdl.opengl.pitch;
-		int y = 0;
-		size_t index = 0;
-		while (y < sdl.draw.height) {
-			if (!(index & 1)) {
-				y += changedLines[index];
-			} else {
-				const uint8_t *pixels = framebuf + y * pitch;
-				const int height = changedLines[index];
-				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y,
-				                sdl.draw.width, height, GL_BGRA_EXT,
-				                GL_UNSIGNED_INT_8_8_8_8_REV, pixels);
-				y += height;
-			}
-			index++;
-		}
+		for_each_changed_span(changedLines, [&](const int y, const int height) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, sdl.draw.width,
+			                height, GL_BGRA_EXT,
+			                GL_UNSIGNED_INT_8_8_8_8_REV, framebuf + y * pitch);
+		});
 	} else {
 		sdl.opengl.actual_frame_count++;
 	}
@@ -2406,7 +2459,7 @@ static bool present_frame_gl()
 
 // Surface update & presentation
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-static void update_frame_surface([[maybe_unused]] const uint16_t *changedLines)
+static void update_frame_surface(const uint16_t *changedLines)
 {
 	// Changed lines are "streamed in" over multiple ticks - so important
 	// we don't ignore or skip this content (otherwise parts of the image
@@ -2414,23 +2467,17 @@ static void update_frame_surface([[maybe_unused]] const uint16_t *changedLines)
 	// even if we don't have to render a frame this pass.  The content is
 	// updated in a persistent buffer.
 	if (changedLines) {
-		int y = 0;
-		size_t index = 0;
 		int16_t rect_count = 0;
 		auto *rect = sdl.updateRects;
 		assert(rect);
-		while (y < sdl.draw.height) {
-			if (index & 1) {
-				rect->x = sdl.clip.x;
-				rect->y = sdl.clip.y + y;
-				rect->w = sdl.draw.width;
-				rect->h = changedLines[index];
-				rect++;
-				rect_count++;
-			}
-			y += changedLines[index];
-			index++;
-		}
+		for_each_changed_span(changedLines, [&](const int y, const int height) {
+			rect->x = sdl.clip.x;
+			rect->y = sdl.clip.y + y;
+			rect->w = sdl.draw.width;
+			rect->h = height;
+			rect++;
+			rect_count++;
+		});
 		if (rect_count) {
 			SDL_UpdateWindowSurfaceRects(sdl.window, sdl.updateRects,
 			                             rect_count);
@@ -2447,12 +2494,18 @@ Bitu GFX_GetRGB(uint8_t red,uint8_t green,uint8_t blue) {
 		return SDL_MapRGB(sdl.texture.pixelFormat, red, green, blue);
 #if C_OPENGL
 	case SCREEN_OPENGL:
-		return ((blue << 0) | (green << 8) | (red << 16)) | (255 << 24);
 #endif
+	case SCREEN_NONE:
+		return ((blue << 0) | (green << 8) | (red << 16)) | (255 << 24);
 	}
 	return 0;
 }
 
+bool GFX_IsHeadless()
+{
+	return sdl.desktop.want_type == SCREEN_NONE;
+}
+
 void GFX_Stop() {
 	if (sdl.updating)
 		GFX_EndUpdate(nullptr);
@@ -3124,6 +3177,17 @@ static SDL_Rect calc_viewport_pp(int win_width, int win_height)
 		return calc_viewport_fit(width, height);
 }
 
+#if !defined(WIN32) && C_SSHOT
+// Without a window there is no hotkey to press, so headless runs take
+// screenshots when sent SIGUSR1. The request is picked up in GFX_Events.
+static volatile sig_atomic_t screenshot_requested = 0;
+
+static void request_screenshot_signal(int)
+{
+	screenshot_requested = 1;
+}
+#endif
+
 static void set_output(Section *sec, bool should_stretch_pixels)
 {
 	// Apply the user's mouse settings
@@ -3133,7 +3197,16 @@ static void set_output(Section *sec, bool should_stretch_pixels)
 	GFX_DisengageRendering();
 	// it's the job of everything after this to re-engage it.
 
-	if (output == "surface") {
+	if (output == "none") {
+		sdl.desktop.want_type = SCREEN_NONE;
+		sdl.scaling_mode = SCALING_MODE::NONE;
+#if !defined(WIN32) && C_SSHOT
+		signal(SIGUSR1, request_screenshot_signal);
+		LOG_MSG("SDL: Video output is disabled, send SIGUSR1 to take a screenshot");
+#else
+		LOG_MSG("SDL: Video output is disabled");
+#endif
+	} else if (output == "surface") {
 		sdl.desktop.want_type = SCREEN_SURFACE;
 	} else if (output == "texture") {
 		sdl.desktop.want_type = SCREEN_TEXTURE;
@@ -3473,12 +3546,15 @@ static void GUI_StartUp(Section *sec)
 
 	set_output(section, should_stretch_pixels);
 
-	SDL_SetWindowTitle(sdl.window, "DOSBox Staging");
-	SetIcon();
+	if (sdl.window) {
+		SDL_SetWindowTitle(sdl.window, "DOSBox Staging");
+		SetIcon();
+	}
 
 	const bool tiny_fullresolution = splash_image.width > sdl.desktop.full.width ||
 	                                 splash_image.height > sdl.desktop.full.height;
-	if ((control->GetStartupVerbosity() == Verbosity::High ||
+	if (sdl.desktop.want_type != SCREEN_NONE &&
+	    (control->GetStartupVerbosity() == Verbosity::High ||
 	     control->GetStartupVerbosity() == Verbosity::SplashOnly) &&
 	    !(sdl.desktop.fullscreen && tiny_fullresolution)) {
 		GFX_Start();
@@ -3744,6 +3820,13 @@ bool GFX_Events()
 	last_check = current_check;
 #endif
 
+#if !defined(WIN32) && C_SSHOT
+	if (screenshot_requested) {
+		screenshot_requested = 0;
+		CaptureState |= CAPTURE_IMAGE;
+	}
+#endif
+
 	SDL_Event event;
 #if defined (REDUCE_JOYSTICK_POLLING)
 	if (MAPPER_IsUsingJoysticks()) {
@@ -4133,7 +4216,8 @@ void Config_Add_SDL() {
 	pstring->Set_values(presentation_modes);
 
 	const char *outputs[] =
-	{ "surface",
+	{ "none",
+	  "surface",
 	  "texture",
 	  "texturenb",
 	  "texturepp",
@@ -4149,7 +4233,11 @@ void Config_Add_SDL() {
 #else
 	Pstring = sdl_sec->Add_string("output", always, "texture");
 #endif
-	Pstring->Set_help("What video system to use for output.");
+	Pstring->Set_help(
+	        "What video system to use for output.\n"
+	        "'none' opens no window and skips scaling and presentation, for\n"
+	        "batch jobs on hosts without a display. Screenshots are still taken\n"
+	        "on request (send SIGUSR1 where signals are available).");
 	Pstring->Set_values(outputs);
 
 	pstring = sdl_sec->Add_string("texture_renderer", always, "auto");
@@ -4495,6 +4583,20 @@ void GFX_GetSize(int &width, int &height, bool &fullscreen)
 }
 
 extern "C" int SDL_CDROMInit(void);
+static void finish_sdl_init()
+{
+	if (SDL_CDROMInit() < 0)
+		LOG_WARNING("Failed to init CD-ROM support");
+
+	sdl.initialized = true;
+	// Once initialized, ensure we clean up SDL for all exit conditions
+	atexit(QuitSDL);
+
+	LOG_MSG("SDL: version %d.%d.%d initialized (%s video and %s audio)",
+		SDL_MAJOR_VERSION, SDL_MINOR_VERSION, SDL_PATCHLEVEL,
+		SDL_GetCurrentVideoDriver(), SDL_GetCurrentAudioDriver());
+}
+
 int sdl_main(int argc, char *argv[])
 {
 	CommandLine com_line(argc, argv);
@@ -4600,18 +4702,13 @@ int sdl_main(int argc, char *argv[])
 
 	check_kmsdrm_setting();
 
+	// Display-less hosts can still run with output=none, so a failure is
+	// only fatal once the configuration has been read
+	std::string sdl_init_error = {};
 	if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) < 0)
-		E_Exit("Can't init SDL %s", SDL_GetError());
-	if (SDL_CDROMInit() < 0)
-		LOG_WARNING("Failed to init CD-ROM support");
-
-	sdl.initialized = true;
-	// Once initialized, ensure we clean up SDL for all exit conditions
-	atexit(QuitSDL);
-
-	LOG_MSG("SDL: version %d.%d.%d initialized (%s video and %s audio)",
-		SDL_MAJOR_VERSION, SDL_MINOR_VERSION, SDL_PATCHLEVEL,
-		SDL_GetCurrentVideoDriver(), SDL_GetCurrentAudioDriver());
+		sdl_init_error = SDL_GetError();
+	else
+		finish_sdl_init();
 
 	const auto config_path = CROSS_GetPlatformConfigDir();
 	SETUP_ParseConfigFiles(config_path);
@@ -4670,6 +4767,20 @@ int sdl_main(int argc, char *argv[])
 #endif // C_MT32EMU
 
 		control->ParseEnv();
+
+		if (!sdl_init_error.empty()) {
+			const auto sec = static_cast<Section_prop *>(
+			        control->GetSection("sdl"));
+			if (std::string(sec->Get_string("output")) != "none")
+				E_Exit("Can't init SDL %s", sdl_init_error.c_str());
+			LOG_WARNING("SDL: %s, retrying with the dummy video driver",
+			            sdl_init_error.c_str());
+			SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+			if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) < 0)
+				E_Exit("Can't init SDL %s", SDL_GetError());
+			finish_sdl_init();
+		}
+
 //		UI_Init();
 //		if (control->cmdline->FindExist("-startui")) UI_Run(false);
 		/* Init all the sections */
@@ -84,15 +84,12 @@ static void perform_dma_io(const DMA_DIRECTION direction,
 		// Determine how many bytes to transfer within this page
 		const auto chunk_bytes = std::min(remaining_bytes, bytes_to_page_end);
 
-		// Copy the data from the page address into the data pointer
+		// DMA goes straight to physical memory, which is one flat block
+		// on the host, so the chunk is copied in one go
 		if (direction == DMA_DIRECTION::READ)
-			for (auto i = 0; i < chunk_bytes; ++i)
-				data_pt[i] = phys_readb(chunk_start + i);
-
-		// Copy the data from the data pointer into the page address
+			memcpy(data_pt, MemBase + chunk_start, chunk_bytes);
 		else if (direction == DMA_DIRECTION::WRITE)
-			for (auto i = 0; i < chunk_bytes; ++i)
-				phys_writeb(chunk_start + i, data_pt[i]);
+			memcpy(MemBase + chunk_start, data_pt, chunk_bytes);
 
 		mem_address += chunk_bytes;
 		data_pt += chunk_bytes;
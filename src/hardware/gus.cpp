@@ -21,12 +21,13 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
 #include <array>
 #include <iomanip>
 #include <memory>
 #include <string>
 #include <unistd.h>
-#include <queue>
+#include <vector>
 
 #include "control.h"
 #include "dma.h"
@@ -59,6 +60,9 @@ constexpr uint8_t MAX_VOICES = 32u;
 constexpr uint8_t MIN_VOICES = 14u;
 constexpr uint8_t VOICE_DEFAULT_STATE = 3u;
 
+// Number of frames the voices are rendered in at a time
+constexpr uint16_t RENDER_BLOCK_FRAMES = 256u;
+
 // DMA and IRQ extents and quantities
 constexpr uint8_t MIN_DMA_ADDRESS = 0u;
 constexpr uint8_t MAX_DMA_ADDRESS = 7u;
@@ -111,6 +115,7 @@ struct VoiceCtrl {
 using address_array_t = std::array<uint8_t, DMA_IRQ_ADDRESSES>;
 using autoexec_array_t = std::array<AutoexecObject, 2>;
 using pan_scalars_array_t = std::array<AudioFrame, PAN_POSITIONS>;
+using render_block_array_t = std::array<float, RENDER_BLOCK_FRAMES>;
 using ram_array_t = std::array<uint8_t, RAM_SIZE>;
 using read_io_array_t = std::array<IO_ReadHandleObject, READ_HANDLERS>;
 using vol_scalars_array_t = std::array<float, VOLUME_LEVELS>;
@@ -129,9 +134,12 @@ class Voice {
 public:
 	Voice(uint8_t num, VoiceIrq &irq) noexcept;
 
-	AudioFrame RenderFrame(const ram_array_t &ram,
-	                       const vol_scalars_array_t &vol_scalars,
-	                       const pan_scalars_array_t &pan_scalars);
+	int RenderFrames(const ram_array_t &ram,
+	                 const vol_scalars_array_t &vol_scalars,
+	                 const pan_scalars_array_t &pan_scalars,
+	                 render_block_array_t &samples,
+	                 AudioFrame *frames,
+	                 int num_frames);
 
 	uint8_t ReadVolState() const noexcept;
 	uint8_t ReadWaveState() const noexcept;
@@ -228,6 +236,7 @@ private:
 	void BeginPlayback();
 	void CheckIrq();
 	void CheckVoiceIrq();
+	void SelectIrqVoice(uint32_t irq_mask) noexcept;
 	double ConvertFramesToMs(const int frames) const;
 	uint32_t GetDmaOffset() noexcept;
 	void UpdateDmaAddr(uint32_t offset) noexcept;
@@ -244,7 +253,8 @@ private:
 
 	void RegisterIoHandlers();
 	void Reset(uint8_t state);
-	AudioFrame RenderFrame();
+	void RenderFrames(AudioFrame *frames, int num_frames);
+	void RenderBlock(AudioFrame *frames, int num_frames);
 	bool RenderForMs(const double interval_ms);
 	void RenderUpToNow();
 	void SetLevelCallback(const AudioFrame &levels);
@@ -257,7 +267,9 @@ private:
 	void WriteToRegister();
 
 	// Collections
-	std::queue<AudioFrame> fifo = {};
+	std::vector<AudioFrame> fifo = {};
+	std::vector<AudioFrame> render_buffer = {};
+	render_block_array_t voice_samples = {{}};
 	vol_scalars_array_t vol_scalars = {{}};
 	pan_scalars_array_t pan_scalars = {{}};
 	alignas(sizeof(int16_t)) ram_array_t ram = {{0u}};
@@ -436,21 +448,46 @@ float Voice::GetSample(const ram_array_t &ram) noexcept
 	return sample;
 }
 
-AudioFrame Voice::RenderFrame(const ram_array_t &ram,
-                              const vol_scalars_array_t &vol_scalars,
-                              const pan_scalars_array_t &pan_scalars)
+// Renders up to RENDER_BLOCK_FRAMES frames and adds them into the given
+// frames. Returns the index of the frame that raised this voice's IRQ, or -1
+// if the IRQ wasn't newly raised.
+int Voice::RenderFrames(const ram_array_t &ram,
+                        const vol_scalars_array_t &vol_scalars,
+                        const pan_scalars_array_t &pan_scalars,
+                        render_block_array_t &samples,
+                        AudioFrame *frames,
+                        const int num_frames)
 {
-	if (vol_ctrl.state & wave_ctrl.state & CTRL::DISABLED)
-		return {0.0f, 0.0f};
+	assert(num_frames <= RENDER_BLOCK_FRAMES);
+	const auto irq_was_raised = (vol_ctrl.irq_state | wave_ctrl.irq_state) & irq_mask;
+	int irq_frame = -1;
+
+	// Step the voice's state machine first, as each sample depends on the
+	// positions left by the previous one
+	int rendered = 0;
+	while (rendered < num_frames) {
+		if (vol_ctrl.state & wave_ctrl.state & CTRL::DISABLED)
+			break;
 
-	// Keep track of how many ms this voice has generated
-	Is16Bit() ? ++generated_16bit_ms : ++generated_8bit_ms;
+		samples[rendered] = GetSample(ram) * PopVolScalar(vol_scalars);
 
-	const auto sample = GetSample(ram) * PopVolScalar(vol_scalars);
+		if (irq_frame < 0 && !irq_was_raised &&
+		    ((vol_ctrl.irq_state | wave_ctrl.irq_state) & irq_mask))
+			irq_frame = rendered;
+		++rendered;
+	}
 
-	const auto pan_scalar = pan_scalars.at(pan_position);
+	// Keep track of how many ms this voice has generated
+	auto &generated_ms = Is16Bit() ? generated_16bit_ms : generated_8bit_ms;
+	generated_ms += static_cast<uint32_t>(rendered);
 
-	return {sample * pan_scalar.left, sample * pan_scalar.right};
+	// Then pan and mix the block in a loop the compiler can vectorize
+	const auto pan_scalar = pan_scalars.at(pan_position);
+	for (int i = 0; i < rendered; ++i) {
+		frames[i].left += samples[i] * pan_scalar.left;
+		frames[i].right += samples[i] * pan_scalar.right;
+	}
+	return irq_frame;
 }
 
 // Returns the current wave position and increments the position
@@ -646,44 +683,74 @@ void Gus::SetLevelCallback(const AudioFrame &levels)
 	accumulator_scalar = {levels.left * rms_squared, levels.right * rms_squared};
 }
 
-AudioFrame Gus::RenderFrame()
+void Gus::RenderFrames(AudioFrame *frames, int num_frames)
 {
-	AudioFrame accumulator = {};
-
-	if (dac_enabled) {
-
-		auto voice = voices.begin();
-		const auto voice_end = voice + active_voices;
+	while (num_frames > 0) {
+		const auto block_frames = std::min(num_frames,
+		                                   static_cast<int>(RENDER_BLOCK_FRAMES));
+		RenderBlock(frames, block_frames);
+		frames += block_frames;
+		num_frames -= block_frames;
+	}
+}
 
-		while (voice < voice_end && *voice) {
-			const auto voice_frame = voice->get()->RenderFrame(
-			        ram, vol_scalars, pan_scalars);
+// Renders the block one voice at a time. Nothing the voices depend on can
+// change while the block is rendered, so the result is the same as rendering
+// it frame by frame.
+void Gus::RenderBlock(AudioFrame *frames, const int num_frames)
+{
+	std::fill_n(frames, num_frames, AudioFrame{});
+	if (!dac_enabled) {
+		CheckVoiceIrq();
+		return;
+	}
 
-			accumulator.left += voice_frame.left;
-			accumulator.right += voice_frame.right;
+	uint32_t irq_mask = (voice_irq.vol_state | voice_irq.wave_state) &
+	                    active_voice_mask;
+	std::array<int, MAX_VOICES> irq_frames = {};
+	irq_frames.fill(-1);
+	for (uint8_t i = 0; i < active_voices && voices[i]; ++i)
+		irq_frames[i] = voices[i]->RenderFrames(ram, vol_scalars, pan_scalars,
+		                                        voice_samples, frames, num_frames);
+
+	for (int i = 0; i < num_frames; ++i) {
+		frames[i].left *= accumulator_scalar.left;
+		frames[i].right *= accumulator_scalar.right;
+	}
 
-			++voice;
-		}
-		accumulator.left *= accumulator_scalar.left;
-		accumulator.right *= accumulator_scalar.right;
+	// The IRQ voice used to be selected after every frame, so replay the
+	// frames that raised new IRQs in order to select the same one
+	int frame = -1;
+	while (true) {
+		int next_frame = num_frames;
+		for (const auto f : irq_frames)
+			if (f > frame && f < next_frame)
+				next_frame = f;
+		if (next_frame == num_frames)
+			break;
+		if (frame < 0 && next_frame > 0 && irq_mask)
+			SelectIrqVoice(irq_mask);
+		frame = next_frame;
+		for (uint8_t i = 0; i < active_voices; ++i)
+			if (irq_frames[i] == frame)
+				irq_mask |= 1u << i;
+		SelectIrqVoice(irq_mask);
 	}
 	CheckVoiceIrq();
-	return accumulator;
 }
 
 bool Gus::RenderForMs(const double interval_ms)
 {
 	// How many frames fall within the given duration?
-	auto frames_to_render = static_cast<int>(interval_ms * frame_rate_per_ms);
-
-	// Capture our return state
-	const auto did_some_rendering = frames_to_render > 0;
+	const auto frames_to_render = static_cast<int>(interval_ms * frame_rate_per_ms);
+	if (frames_to_render <= 0)
+		return false;
 
 	// Render and queue the frames, which will be drained by the callback
-	while (frames_to_render-- > 0)
-		fifo.emplace(RenderFrame());
-
-	return did_some_rendering;
+	const auto queued = fifo.size();
+	fifo.resize(queued + static_cast<size_t>(frames_to_render));
+	RenderFrames(fifo.data() + queued, frames_to_render);
+	return true;
 }
 
 void Gus::RenderUpToNow()
@@ -712,18 +779,20 @@ double Gus::ConvertFramesToMs(const int frames) const
 void Gus::AudioCallback(uint16_t requested_frames)
 {
 	assert(audio_channel);
-	while (requested_frames && fifo.size()) {
-		audio_channel->AddSamples_sfloat(1, &fifo.front()[0]);
-		fifo.pop();
-		--requested_frames;
+	const auto queued_frames = static_cast<uint16_t>(
+	        std::min(fifo.size(), static_cast<size_t>(requested_frames)));
+	if (queued_frames) {
+		audio_channel->AddSamples_sfloat(queued_frames, &fifo.front()[0]);
+		fifo.erase(fifo.begin(), fifo.begin() + queued_frames);
+		requested_frames -= queued_frames;
 	}
 
 	if (requested_frames) {
 		last_render_time_ms += ConvertFramesToMs(requested_frames);
-		while (requested_frames--) {
-			const auto frame = RenderFrame();
-			audio_channel->AddSamples_sfloat(1, &frame[0]);
-		}
+		render_buffer.resize(requested_frames);
+		RenderFrames(render_buffer.data(), requested_frames);
+		audio_channel->AddSamples_sfloat(requested_frames,
+		                                 &render_buffer.front()[0]);
 	}
 	// Pause the channel if the card hasn't been written to for 3 seconds
 	constexpr uint16_t three_seconds_of_ticks = 3 * 1000;
@@ -791,7 +860,14 @@ void Gus::CheckVoiceIrq()
 	if (voice_irq.wave_state)
 		irq_status |= 0x20;
 	CheckIrq();
-	while (!(totalmask & 1ULL << voice_irq.status)) {
+	SelectIrqVoice(check_cast<uint32_t>(totalmask));
+}
+
+// Moves the voice IRQ status onto the next voice raising an IRQ
+void Gus::SelectIrqVoice(const uint32_t irq_mask) noexcept
+{
+	assert(irq_mask);
+	while (!(irq_mask & 1ULL << voice_irq.status)) {
 		voice_irq.status++;
 		if (voice_irq.status >= active_voices)
 			voice_irq.status = 0;
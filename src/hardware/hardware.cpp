@@ -18,8 +18,11 @@
 
 #include "hardware.h"
 
+#include <atomic>
 #include <cerrno>
+#include <memory>
 #include <string.h>
+#include <thread>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -31,6 +34,7 @@
 #include "pic.h"
 #include "render.h"
 #include "rgb24.h"
+#include "rwqueue.h"
 #include "setup.h"
 #include "string_utils.h"
 #include "support.h"
@@ -41,6 +45,7 @@
 #endif
 
 static std::string capturedir;
+static int capture_threads = 1;
 extern const char* RunningProgram;
 Bitu CaptureState;
 
@@ -48,6 +53,23 @@ Bitu CaptureState;
 #define MIDI_BUF 4*1024
 #define AVI_HEADER_SIZE	500
 
+#if (C_SSHOT)
+// Video frames are converted on the emulation thread into a small pool of
+// buffers and then compressed and written out by a dedicated encoder thread.
+// When the encoder falls behind and the pool runs dry, frames are dropped
+// (and later written as empty "repeat previous frame" chunks) rather than
+// stalling the emulation.
+constexpr int CAPTURE_FRAME_POOL_SIZE = 8;
+constexpr int CAPTURE_STOP_ENCODER = -1;
+
+struct CaptureFrame {
+	std::vector<uint8_t> pixels = {};
+	uint8_t palette[256 * 4] = {};
+	std::vector<int16_t> audio = {};
+	uint32_t dropped_before = 0;
+};
+#endif
+
 static struct {
 	struct {
 		FILE *handle = nullptr;
@@ -73,8 +95,9 @@ static struct {
 	struct {
 		FILE *handle = nullptr;
 		uint32_t frames = 0;
-		int16_t audiobuf[WAVE_BUF][2] = {};
-		uint32_t audioused = 0;
+		// Interleaved stereo audio since the last submitted frame. It
+		// grows while frames are dropped, so none of it is lost.
+		std::vector<int16_t> audiobuf = {};
 		uint32_t audiorate = 0;
 		uint32_t audiowritten = 0;
 		VideoCodec *codec = nullptr;
@@ -87,6 +110,18 @@ static struct {
 		std::vector<uint8_t> buf = {};
 		std::vector<uint8_t> index = {};
 		uint32_t indexused = 0;
+		ZMBV_FORMAT format = ZMBV_FORMAT::NONE;
+		int pixelsize = 0;
+
+		// Frame pool shared with the encoder thread; the queues
+		// carry indexes into the pool.
+		std::unique_ptr<CaptureFrame> pool[CAPTURE_FRAME_POOL_SIZE] = {};
+		RWQueue<int> free_frames{CAPTURE_FRAME_POOL_SIZE};
+		RWQueue<int> pending_frames{CAPTURE_FRAME_POOL_SIZE + 1};
+		std::thread encoder = {};
+		std::atomic<bool> encoder_failed = false;
+		uint32_t pending_drops = 0;
+		uint32_t dropped = 0;
 	} video = {};
 #endif
 
@@ -172,6 +207,110 @@ static void CAPTURE_AddAviChunk(const char * tag, uint32_t size, void * data, ui
 	host_writed(index+8, pos);
 	host_writed(index+12, size);
 }
+
+static void CAPTURE_AddDroppedVideoFrames(uint32_t count)
+{
+	// A zero-length video chunk tells players to repeat the previous
+	// frame, which keeps the video in step with the audio.
+	while (count--) {
+		CAPTURE_AddAviChunk("00dc", 0, capture.video.buf.data(), 0);
+		capture.video.frames++;
+	}
+}
+
+static bool CAPTURE_EncodeVideoFrame(CaptureFrame &frame)
+{
+	CAPTURE_AddDroppedVideoFrames(frame.dropped_before);
+
+	const int codecFlags = (capture.video.frames % 300 == 0) ? 1 : 0;
+	if (!capture.video.codec->PrepareCompressFrame(codecFlags,
+	                                               capture.video.format,
+	                                               frame.palette,
+	                                               capture.video.buf.data(),
+	                                               capture.video.bufSize))
+		return false;
+
+	const auto row_bytes = capture.video.width * capture.video.pixelsize;
+	auto row = frame.pixels.data();
+	for (auto i = 0; i < capture.video.height; ++i) {
+		capture.video.codec->CompressLines(1, &row);
+		row += row_bytes;
+	}
+	const int written = capture.video.codec->FinishCompressFrame();
+	if (written < 0)
+		return false;
+	CAPTURE_AddAviChunk("00dc", written, capture.video.buf.data(), codecFlags & 1 ? 0x10 : 0x0);
+	capture.video.frames++;
+
+	if (!frame.audio.empty()) {
+		const auto audio_bytes = check_cast<uint32_t>(frame.audio.size() * sizeof(int16_t));
+		CAPTURE_AddAviChunk("01wb", audio_bytes, frame.audio.data(), 0);
+		capture.video.audiowritten = audio_bytes;
+	}
+	return true;
+}
+
+// Runs on the encoder thread: compresses and writes the frames handed over
+// by CAPTURE_AddImage until it is asked to stop.
+static void CAPTURE_EncodeVideo()
+{
+	while (true) {
+		const auto i = capture.video.pending_frames.Dequeue();
+		if (i == CAPTURE_STOP_ENCODER)
+			break;
+
+		if (!capture.video.encoder_failed &&
+		    !CAPTURE_EncodeVideoFrame(*capture.video.pool[i]))
+			capture.video.encoder_failed = true;
+
+		capture.video.free_frames.Enqueue(i);
+	}
+}
+
+static void CAPTURE_StartVideoEncoder()
+{
+	const auto frame_bytes = static_cast<size_t>(capture.video.width) *
+	                         static_cast<size_t>(capture.video.height) *
+	                         static_cast<size_t>(capture.video.pixelsize);
+	for (auto i = 0; i < CAPTURE_FRAME_POOL_SIZE; ++i) {
+		auto &frame = capture.video.pool[i];
+		if (!frame)
+			frame = std::make_unique<CaptureFrame>();
+		frame->pixels.resize(frame_bytes);
+		capture.video.free_frames.Enqueue(i);
+	}
+	capture.video.pending_drops = 0;
+	capture.video.dropped = 0;
+	capture.video.encoder_failed = false;
+
+	capture.video.encoder = std::thread(CAPTURE_EncodeVideo);
+	set_thread_name(capture.video.encoder, "dosbox:capture");
+}
+
+static void CAPTURE_StopVideoEncoder()
+{
+	if (!capture.video.encoder.joinable())
+		return;
+
+	capture.video.pending_frames.Enqueue(CAPTURE_STOP_ENCODER);
+	capture.video.encoder.join();
+
+	// Leave the pool empty so the next recording starts from scratch
+	while (!capture.video.free_frames.IsEmpty())
+		capture.video.free_frames.Dequeue();
+
+	// Frames dropped after the last submitted one still need their slots,
+	// followed by the audio that came with them
+	CAPTURE_AddDroppedVideoFrames(capture.video.pending_drops);
+	capture.video.pending_drops = 0;
+	auto &audio = capture.video.audiobuf;
+	if (!audio.empty()) {
+		const auto audio_bytes = check_cast<uint32_t>(audio.size() * sizeof(int16_t));
+		CAPTURE_AddAviChunk("01wb", audio_bytes, audio.data(), 0);
+		capture.video.audiowritten = audio_bytes;
+		audio.clear();
+	}
+}
 #endif
 
 #if (C_SSHOT)
@@ -180,10 +319,15 @@ static void CAPTURE_VideoEvent(bool pressed) {
 		return;
 	if (CaptureState & CAPTURE_VIDEO) {
 		/* Close the video */
+		CAPTURE_StopVideoEncoder();
 		if (capture.video.codec)
 			capture.video.codec->FinishVideo();
 		CaptureState &= ~CAPTURE_VIDEO;
-		LOG_MSG("Stopped capturing video.");	
+		if (capture.video.dropped)
+			LOG_MSG("Stopped capturing video, %u frames were dropped.",
+			        capture.video.dropped);
+		else
+			LOG_MSG("Stopped capturing video.");
 
 		uint8_t avi_header[AVI_HEADER_SIZE];
 		Bitu main_list;
@@ -306,6 +450,7 @@ static void CAPTURE_VideoEvent(bool pressed) {
 		fwrite(&avi_header, 1, AVI_HEADER_SIZE, capture.video.handle);
 		fclose(capture.video.handle);
 		delete capture.video.codec;
+		capture.video.codec = nullptr;
 		capture.video.handle = nullptr;
 	} else {
 		CaptureState |= CAPTURE_VIDEO;
@@ -517,6 +662,11 @@ void CAPTURE_AddImage([[maybe_unused]] int width,
 skip_shot:
 	if (CaptureState & CAPTURE_VIDEO) {
 		ZMBV_FORMAT format;
+		/* Stop capturing if the encoder thread ran into an error */
+		if (capture.video.handle && capture.video.encoder_failed) {
+			CAPTURE_VideoEvent(true);
+			goto skip_video;
+		}
 		/* Disable capturing if any of the test fails */
 		if (capture.video.handle && (
 			capture.video.width != width ||
@@ -548,6 +698,7 @@ skip_shot:
 			capture.video.codec = new VideoCodec();
 			if (!capture.video.codec)
 				goto skip_video;
+			capture.video.codec->SetThreads(capture_threads);
 			if (!capture.video.codec->SetupCompress( width, height)) 
 				goto skip_video;
 			capture.video.bufSize = capture.video.codec->NeededSize(width, height, format);
@@ -559,81 +710,81 @@ skip_shot:
 			capture.video.height = height;
 			capture.video.bpp = bpp;
 			capture.video.fps = fps;
+			capture.video.format = format;
+			capture.video.pixelsize = (bpp == 8) ? 1 : (bpp <= 16) ? 2 : 4;
 			for (auto i = 0; i < AVI_HEADER_SIZE; ++i)
 				fputc(0,capture.video.handle);
 			capture.video.frames = 0;
 			capture.video.written = 0;
-			capture.video.audioused = 0;
+			capture.video.audiobuf.clear();
 			capture.video.audiowritten = 0;
+			CAPTURE_StartVideoEncoder();
 		}
-		int codecFlags;
-		if (capture.video.frames % 300 == 0)
-			codecFlags = 1;
-		else codecFlags = 0;
-		if (!capture.video.codec->PrepareCompressFrame(codecFlags, format, pal,
-		                                               capture.video.buf.data(),
-		                                               capture.video.bufSize))
+
+		// Hand the frame to the encoder thread if a buffer is free,
+		// otherwise drop it and let the encoder catch up
+		if (capture.video.free_frames.IsEmpty()) {
+			capture.video.pending_drops++;
+			capture.video.dropped++;
+			CaptureState |= CAPTURE_VIDEO;
 			goto skip_video;
+		}
+		const auto frame_index = capture.video.free_frames.Dequeue();
+		auto &frame = *capture.video.pool[frame_index];
 
 		const bool is_double_width = flags & CAPTURE_FLAG_DBLW;
 		const auto height_divisor = (flags & CAPTURE_FLAG_DBLH) ? 1 : 0;
+		const auto row_bytes = width * capture.video.pixelsize;
 
 		for (auto i = 0; i < height; ++i) {
-			auto rowPointer = doubleRow;
 			const auto srcLine = data + (i >> height_divisor) * pitch;
+			const auto dstLine = frame.pixels.data() + i * row_bytes;
 
 			if (is_double_width) {
 				countWidth = width >> 1;
 				switch ( bpp) {
 				case 8:
 					for (auto x = 0; x < countWidth; ++x)
-						doubleRow[x * 2 + 0] = doubleRow[x * 2 + 1] = srcLine[x];
+						dstLine[x * 2 + 0] = dstLine[x * 2 + 1] = srcLine[x];
 					break;
 				case 15:
 				case 16:
 					for (auto x = 0; x < countWidth; ++x)
-						((uint16_t *)doubleRow)[x*2+0] =
-						((uint16_t *)doubleRow)[x*2+1] = ((uint16_t *)srcLine)[x];
+						((uint16_t *)dstLine)[x*2+0] =
+						((uint16_t *)dstLine)[x*2+1] = ((uint16_t *)srcLine)[x];
 					break;
 				case 24:
 					for (auto x = 0; x < countWidth; ++x) {
 						const auto pixel = reinterpret_cast<rgb24 *>(srcLine)[x];
-						reinterpret_cast<uint32_t *>(doubleRow)[x * 2 + 0] = pixel;
-						reinterpret_cast<uint32_t *>(doubleRow)[x * 2 + 1] = pixel;
+						reinterpret_cast<uint32_t *>(dstLine)[x * 2 + 0] = pixel;
+						reinterpret_cast<uint32_t *>(dstLine)[x * 2 + 1] = pixel;
 					}
 					break;
 				case 32:
 					for (auto x = 0; x < countWidth; ++x)
-						((uint32_t *)doubleRow)[x*2+0] =
-						((uint32_t *)doubleRow)[x*2+1] = ((uint32_t *)srcLine)[x];
+						((uint32_t *)dstLine)[x*2+0] =
+						((uint32_t *)dstLine)[x*2+1] = ((uint32_t *)srcLine)[x];
 					break;
 				}
-                rowPointer=doubleRow;
-			} else {
-				if (bpp == 24) {
-					for (auto x = 0; x < width; ++x) {
-						const auto pixel = reinterpret_cast<rgb24 *>(srcLine)[x];
-						reinterpret_cast<uint32_t *>(doubleRow)[x] = pixel;
-					}
-					// Using doubleRow for this conversion when it is not actually double row!
-					rowPointer = doubleRow;
-				} else {
-					rowPointer = srcLine;
+			} else if (bpp == 24) {
+				for (auto x = 0; x < width; ++x) {
+					const auto pixel = reinterpret_cast<rgb24 *>(srcLine)[x];
+					reinterpret_cast<uint32_t *>(dstLine)[x] = pixel;
 				}
+			} else {
+				memcpy(dstLine, srcLine, static_cast<size_t>(row_bytes));
 			}
-			capture.video.codec->CompressLines( 1, &rowPointer);
-		}
-		int written = capture.video.codec->FinishCompressFrame();
-		if (written < 0)
-			goto skip_video;
-		CAPTURE_AddAviChunk("00dc", written, capture.video.buf.data(), codecFlags & 1 ? 0x10 : 0x0);
-		capture.video.frames++;
-//		LOG_MSG("Frame %d video %d audio %d",capture.video.frames, written, capture.video.audioused *4 );
-		if ( capture.video.audioused ) {
-			CAPTURE_AddAviChunk( "01wb", capture.video.audioused * 4, capture.video.audiobuf, 0);
-			capture.video.audiowritten = capture.video.audioused*4;
-			capture.video.audioused = 0;
 		}
+		if (pal)
+			memcpy(frame.palette, pal, sizeof(frame.palette));
+
+		// Swap rather than copy, so both buffers keep their capacity
+		frame.audio.swap(capture.video.audiobuf);
+		capture.video.audiobuf.clear();
+		frame.dropped_before = capture.video.pending_drops;
+		capture.video.pending_drops = 0;
+
+		capture.video.pending_frames.Enqueue(frame_index);
 
 		/* Everything went okay, set flag again for next frame */
 		CaptureState |= CAPTURE_VIDEO;
@@ -665,11 +816,8 @@ static uint8_t wavheader[]={
 void CAPTURE_AddWave(uint32_t freq, uint32_t len, int16_t * data) {
 #if (C_SSHOT)
 	if (CaptureState & CAPTURE_VIDEO) {
-		Bitu left = WAVE_BUF - capture.video.audioused;
-		if (left > len)
-			left = len;
-		memcpy( &capture.video.audiobuf[capture.video.audioused], data, left*4);
-		capture.video.audioused += left;
+		auto &audio = capture.video.audiobuf;
+		audio.insert(audio.end(), data, data + len * 2);
 		capture.video.audiorate = freq;
 	}
 #endif
@@ -821,6 +969,7 @@ public:
 		Section_prop * section = static_cast<Section_prop *>(configuration);
 		Prop_path* proppath= section->Get_path("captures");
 		capturedir = proppath->realpath;
+		capture_threads = section->Get_int("capture_threads");
 		CaptureState = 0;
 		MAPPER_AddHandler(CAPTURE_WaveEvent, SDL_SCANCODE_F6,
 		                  PRIMARY_MOD, "recwave", "Rec. Audio");
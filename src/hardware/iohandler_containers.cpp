@@ -21,11 +21,12 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <functional>
 #include <limits>
-#include <unordered_map>
+#include <vector>
 
 #include "inout.h"
 #include "support.h"
@@ -54,36 +55,136 @@ IO_WriteHandleObject::~IO_WriteHandleObject(){
 	// static_cast<uint32_t>(m_port));
 }
 
+// Direct-indexed table of the handlers of one port width. Each port holds
+// the index of its handler, so a dispatch is an array load and a call. The
+// handlers are stored once per registration and shared by the ports of its
+// range; their slots are reused once no port refers to them anymore.
+template <typename handler_t>
+class IoHandlerTable {
+public:
+	static constexpr uint16_t unhandled = 0;
+	static constexpr uint16_t blocked = 1;
+
+	explicit IoHandlerTable(const handler_t &blocked_handler)
+	{
+		handlers.emplace_back();                // unhandled
+		handlers.emplace_back(blocked_handler); // blocked
+		port_counts.resize(handlers.size(), 0);
+	}
+
+	uint16_t SlotOf(const io_port_t port) const { return slots[port]; }
+
+	const handler_t &operator[](const uint16_t slot) const
+	{
+		return handlers[slot];
+	}
+
+	uint16_t Add(const handler_t &handler)
+	{
+		if (free_slots.empty()) {
+			if (handlers.size() > UINT16_MAX)
+				E_Exit("IOBUS: Too many port handlers registered");
+			free_slots.push_back(static_cast<uint16_t>(handlers.size()));
+			handlers.emplace_back();
+			port_counts.push_back(0);
+		}
+		const auto slot = free_slots.back();
+		free_slots.pop_back();
+		handlers[slot] = handler;
+		return slot;
+	}
+
+	void Set(const io_port_t port, const uint16_t slot)
+	{
+		Release(slots[port]);
+		slots[port] = slot;
+		++port_counts[slot];
+	}
+
+	void Clear(const io_port_t port) { Set(port, unhandled); }
+
+	size_t NumPorts() const
+	{
+		return slots.size() - static_cast<size_t>(std::count(slots.begin(),
+		                                                     slots.end(),
+		                                                     unhandled));
+	}
+
+	size_t NumBytes() const
+	{
+		return sizeof(*this) + slots.size() * sizeof(slots[0]) +
+		       handlers.capacity() * sizeof(handler_t) +
+		       port_counts.capacity() * sizeof(port_counts[0]);
+	}
+
+	void Reset()
+	{
+		for (uint32_t port = 0; port <= UINT16_MAX; ++port)
+			Clear(static_cast<io_port_t>(port));
+	}
+
+private:
+	void Release(const uint16_t slot)
+	{
+		if (slot <= blocked)
+			return;
+		assert(port_counts[slot] > 0);
+		if (--port_counts[slot] == 0) {
+			handlers[slot] = nullptr; // drop what the handler captured
+			free_slots.push_back(slot);
+		}
+	}
+
+	std::vector<uint16_t> slots = std::vector<uint16_t>(UINT16_MAX + 1, unhandled);
+	std::vector<handler_t> handlers = {};
+	std::vector<uint32_t> port_counts = {}; // ports using each handler
+	std::vector<uint16_t> free_slots = {};
+};
+
+constexpr io_val_t blocked_read(const io_port_t, const io_width_t)
+{
+	return 0xff;
+}
+
+constexpr void blocked_write(const io_port_t, const io_val_t, const io_width_t)
+{
+	// nothing to write to
+}
+
 // type-sized IO handlers
-std::unordered_map<io_port_t, io_read_f> io_read_handlers[io_widths] = {};
+IoHandlerTable<io_read_f> io_read_handlers[io_widths] = {
+        IoHandlerTable<io_read_f>(blocked_read),
+        IoHandlerTable<io_read_f>(blocked_read),
+        IoHandlerTable<io_read_f>(blocked_read)};
 constexpr auto &io_read_byte_handler = io_read_handlers[0];
 constexpr auto &io_read_word_handler = io_read_handlers[1];
 constexpr auto &io_read_dword_handler = io_read_handlers[2];
 
-std::unordered_map<io_port_t, io_write_f> io_write_handlers[io_widths] = {};
+IoHandlerTable<io_write_f> io_write_handlers[io_widths] = {
+        IoHandlerTable<io_write_f>(blocked_write),
+        IoHandlerTable<io_write_f>(blocked_write),
+        IoHandlerTable<io_write_f>(blocked_write)};
 constexpr auto &io_write_byte_handler = io_write_handlers[0];
 constexpr auto &io_write_word_handler = io_write_handlers[1];
 constexpr auto &io_write_dword_handler = io_write_handlers[2];
 
-constexpr io_val_t blocked_read(const io_port_t, const io_width_t)
-{
-	return 0xff;
-}
-
 // type-sized IO handler API
 uint8_t read_byte_from_port(const io_port_t port)
 {
-	const auto [it, was_blocked] = io_read_byte_handler.emplace(port, blocked_read);
-	if (was_blocked)
+	auto slot = io_read_byte_handler.SlotOf(port);
+	if (GCC_UNLIKELY(slot == io_read_byte_handler.unhandled)) {
 		LOG(LOG_IO, LOG_WARN)("Unhandled read from port %04Xh; blocking", port);
-	return it->second(port, io_width_t::byte) & 0xff;
+		slot = io_read_byte_handler.blocked;
+		io_read_byte_handler.Set(port, slot);
+	}
+	return io_read_byte_handler[slot](port, io_width_t::byte) & 0xff;
 }
 
 uint16_t read_word_from_port(const io_port_t port)
 {
-	const auto reader = io_read_word_handler.find(port);
-	const auto value = reader != io_read_word_handler.end()
-	                           ? (reader->second(port, io_width_t::word) & 0xffff)
+	const auto slot = io_read_word_handler.SlotOf(port);
+	const auto value = slot != io_read_word_handler.unhandled
+	                           ? (io_read_word_handler[slot](port, io_width_t::word) & 0xffff)
 	                           : static_cast<io_val_t>(
 	                                     read_byte_from_port(port) |
 	                                     (read_byte_from_port(port + 1) << 8));
@@ -92,9 +193,9 @@ uint16_t read_word_from_port(const io_port_t port)
 
 uint32_t read_dword_from_port(const io_port_t port)
 {
-	const auto reader = io_read_dword_handler.find(port);
-	const auto value = reader != io_read_dword_handler.end()
-	                           ? reader->second(port, io_width_t::dword)
+	const auto slot = io_read_dword_handler.SlotOf(port);
+	const auto value = slot != io_read_dword_handler.unhandled
+	                           ? io_read_dword_handler[slot](port, io_width_t::dword)
 	                           : static_cast<io_val_t>(
 	                                     read_word_from_port(port) |
 	                                     (read_word_from_port(port + 2) << 16));
@@ -102,26 +203,24 @@ uint32_t read_dword_from_port(const io_port_t port)
 	return static_cast<uint32_t>(value);
 }
 
-constexpr void blocked_write(const io_port_t, const io_val_t, const io_width_t)
-{
-	// nothing to write to
-}
-
 void write_byte_to_port(const io_port_t port, const uint8_t val)
 {
-	const auto [it, was_blocked] = io_write_byte_handler.emplace(port, blocked_write);
-	if (was_blocked)
+	auto slot = io_write_byte_handler.SlotOf(port);
+	if (GCC_UNLIKELY(slot == io_write_byte_handler.unhandled)) {
 		LOG(LOG_IO, LOG_WARN)("Unhandled write of value 0x%02x"
 		                      " (%u) to port %04Xh; blocking",
 		                      val, val, port);
-	it->second(port, val, io_width_t::byte);
+		slot = io_write_byte_handler.blocked;
+		io_write_byte_handler.Set(port, slot);
+	}
+	io_write_byte_handler[slot](port, val, io_width_t::byte);
 }
 
 void write_word_to_port(const io_port_t port, const uint16_t val)
 {
-	const auto writer = io_write_word_handler.find(port);
-	if (writer != io_write_word_handler.end()) {
-		writer->second(port, val, io_width_t::word);
+	const auto slot = io_write_word_handler.SlotOf(port);
+	if (slot != io_write_word_handler.unhandled) {
+		io_write_word_handler[slot](port, val, io_width_t::word);
 	} else {
 		write_byte_to_port(port, static_cast<uint8_t>(val & 0xff));
 		write_byte_to_port(port + 1, static_cast<uint8_t>(val >> 8));
@@ -130,28 +229,53 @@ void write_word_to_port(const io_port_t port, const uint16_t val)
 
 void write_dword_to_port(const io_port_t port, const uint32_t val)
 {
-	const auto writer = io_write_dword_handler.find(port);
-	if (writer != io_write_dword_handler.end()) {
-		writer->second(port, val, io_width_t::dword);
+	const auto slot = io_write_dword_handler.SlotOf(port);
+	if (slot != io_write_dword_handler.unhandled) {
+		io_write_dword_handler[slot](port, val, io_width_t::dword);
 	} else {
 		write_word_to_port(port, static_cast<uint16_t>(val & 0xffff));
 		write_word_to_port(port + 2, static_cast<uint16_t>(val >> 16));
 	}
 }
 
+// Registers the handler for each port of the range in the tables up to the
+// given width
+template <typename handler_t>
+static void register_handler(IoHandlerTable<handler_t> (&tables)[io_widths],
+                             io_port_t port, const handler_t &handler,
+                             const io_width_t max_width, io_port_t range)
+{
+	if (!range)
+		return;
+	for (uint8_t i = 0; i < io_widths; ++i) {
+		if ((1 << i) > static_cast<int>(max_width))
+			break;
+		auto &table = tables[i];
+		const auto slot = table.Add(handler);
+		for (io_port_t p = port, r = range; r > 0; --r, ++p)
+			table.Set(p, slot);
+	}
+}
+
+template <typename handler_t>
+static void free_handler(IoHandlerTable<handler_t> (&tables)[io_widths],
+                         io_port_t port, const io_width_t max_width,
+                         io_port_t range)
+{
+	for (uint8_t i = 0; i < io_widths; ++i) {
+		if ((1 << i) > static_cast<int>(max_width))
+			break;
+		for (io_port_t p = port, r = range; r > 0; --r, ++p)
+			tables[i].Clear(p);
+	}
+}
+
 void IO_RegisterReadHandler(io_port_t port,
                             const io_read_f handler,
                             const io_width_t max_width,
                             io_port_t range)
 {
-	while (range--) {
-		io_read_byte_handler[port] = handler;
-		if (max_width == io_width_t::word || max_width == io_width_t::dword)
-			io_read_word_handler[port] = handler;
-		if (max_width == io_width_t::dword)
-			io_read_dword_handler[port] = handler;
-		++port;
-	}
+	register_handler(io_read_handlers, port, handler, max_width, range);
 }
 
 void IO_RegisterWriteHandler(io_port_t port,
@@ -159,42 +283,39 @@ void IO_RegisterWriteHandler(io_port_t port,
                              const io_width_t max_width,
                              io_port_t range)
 {
-	while (range--) {
-		io_write_byte_handler[port] = handler;
-		if (max_width == io_width_t::word || max_width == io_width_t::dword)
-			io_write_word_handler[port] = handler;
-		if (max_width == io_width_t::dword)
-			io_write_dword_handler[port] = handler;
-		++port;
-	}
+	register_handler(io_write_handlers, port, handler, max_width, range);
 }
 
 void IO_FreeReadHandler(io_port_t port,
                         const io_width_t max_width,
                         io_port_t range)
 {
-	while (range--) {
-		io_read_byte_handler.erase(port);
-		if (max_width == io_width_t::word || max_width == io_width_t::dword)
-			io_read_word_handler.erase(port);
-		if (max_width == io_width_t::dword)
-			io_read_dword_handler.erase(port);
-		++port;
-	}
+	free_handler(io_read_handlers, port, max_width, range);
 }
 
 void IO_FreeWriteHandler(io_port_t port,
                          const io_width_t width,
                          io_port_t range)
 {
-	while (range--) {
-		io_write_byte_handler.erase(port);
-		if (width == io_width_t::word || width == io_width_t::dword)
-			io_write_word_handler.erase(port);
-		if (width == io_width_t::dword)
-			io_write_dword_handler.erase(port);
-		++port;
+	free_handler(io_write_handlers, port, width, range);
+}
+
+void IO_ReleaseHandlers()
+{
+	[[maybe_unused]] size_t total_bytes = 0u;
+	for (uint8_t i = 0; i < io_widths; ++i) {
+		const auto readers = io_read_handlers[i].NumPorts();
+		const auto writers = io_write_handlers[i].NumPorts();
+		DEBUG_LOG_MSG("IOBUS: Releasing %d read and %d write %d-bit port handlers",
+		              static_cast<int>(readers), static_cast<int>(writers), 8 << i);
+
+		total_bytes += io_read_handlers[i].NumBytes();
+		total_bytes += io_write_handlers[i].NumBytes();
+		io_read_handlers[i].Reset();
+		io_write_handlers[i].Reset();
 	}
+	DEBUG_LOG_MSG("IOBUS: Handlers consumed %d total bytes",
+	              static_cast<int>(total_bytes));
 }
 
 void IO_ReadHandleObject::Install(const io_port_t port,
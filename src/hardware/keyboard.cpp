@@ -20,6 +20,7 @@
 #include "keyboard.h"
 
 #include "bitops.h"
+#include "cpu.h"
 #include "inout.h"
 #include "pic.h"
 #include "mem.h"
@@ -304,6 +305,8 @@ static void write_p64(io_port_t, io_val_t value, io_width_t)
 
 static uint8_t read_p64(io_port_t, io_width_t)
 {
+	if (!keyb.p60changed)
+		CPU_IdlePoll();
 	uint8_t status = 0x1c | (keyb.p60changed ? 0x1 : 0x0);
 	return status;
 }
@@ -19,6 +19,7 @@
 
 #include "mem.h"
 
+#include <algorithm>
 #include <string.h>
 
 #include "inout.h"
@@ -176,22 +177,74 @@ void mem_strcpy(PhysPt dest,PhysPt src) {
 	mem_writeb_inline(dest,0);
 }
 
+// The bulk copies below work a page at a time: pages with a host pointer in
+// the TLB are copied directly, the others byte by byte through their
+// handler. Unlinked pages get linked by their handler on the first access,
+// so after one byte the TLB is looked at again.
+
+static inline size_t bytes_left_in_page(const PhysPt address, const size_t size)
+{
+	const auto left = MEM_PAGE_SIZE - (address & (MEM_PAGE_SIZE - 1));
+	return std::min(size, static_cast<size_t>(left));
+}
+
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size) {
-	while (size--) mem_writeb_inline(dest++,mem_readb_inline(src++));
+	while (size) {
+		const auto read = get_tlb_read(src);
+		const auto write = get_tlb_write(dest);
+		if (!read || !write) {
+			mem_writeb_inline(dest++, mem_readb_inline(src++));
+			--size;
+			continue;
+		}
+		const auto chunk = bytes_left_in_page(dest, bytes_left_in_page(src, size));
+		const auto from = read + src;
+		const auto to = write + dest;
+		if (to > from && to < from + chunk) {
+			// keep the forward byte copy semantics on overlap
+			for (size_t i = 0; i < chunk; ++i)
+				to[i] = from[i];
+		} else {
+			memmove(to, from, chunk);
+		}
+		src += static_cast<PhysPt>(chunk);
+		dest += static_cast<PhysPt>(chunk);
+		size -= chunk;
+	}
 }
 
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size) {
 	uint8_t * write=reinterpret_cast<uint8_t *>(data);
-	while (size--) {
-		*write++=mem_readb_inline(pt++);
+	while (size) {
+		const auto read = get_tlb_read(pt);
+		if (!read) {
+			*write++ = mem_readb_inline(pt++);
+			--size;
+			continue;
+		}
+		const auto chunk = bytes_left_in_page(pt, size);
+		memcpy(write, read + pt, chunk);
+		write += chunk;
+		pt += static_cast<PhysPt>(chunk);
+		size -= chunk;
 	}
 }
 
 void MEM_BlockWrite(PhysPt pt, const void *data, size_t size)
 {
 	const uint8_t *read = static_cast<const uint8_t *>(data);
-	while (size--) {
-		mem_writeb_inline(pt++,*read++);
+	while (size) {
+		const auto write = get_tlb_write(pt);
+		if (!write) {
+			mem_writeb_inline(pt++, *read++);
+			--size;
+			continue;
+		}
+		const auto chunk = bytes_left_in_page(pt, size);
+		memcpy(write + pt, read, chunk);
+		read += chunk;
+		pt += static_cast<PhysPt>(chunk);
+		size -= chunk;
 	}
 }
 
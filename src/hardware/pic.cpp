@@ -17,6 +17,11 @@
  */
 
 #include "dosbox.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
 #include "inout.h"
 #include "cpu.h"
 #include "callback.h"
@@ -38,8 +43,6 @@
 // "master-slave" relationship, which is misleading given that fact that the
 // primary has no control over the secondary.
 
-#define PIC_QUEUESIZE 512
-
 struct PIC_Controller {
 	Bitu icw_words;
 	Bitu icw_index;
@@ -190,17 +193,26 @@ void PIC_Controller::start_irq(uint8_t val) {
 }
 
 
+// Scheduled events are kept in a binary min-heap ordered by their absolute
+// time in milliseconds, so nothing has to be rebased as the ticks go by.
+// Events due at the same time run in the order they were added.
 struct PICEntry {
-	double index;
-	Bitu value;
-	PIC_EventHandler pic_event;
-	PICEntry * next;
+	double time = 0.0;      // PIC_Ticks-based time the event is due at
+	uint64_t sequence = 0;  // tie breaker keeping same-time events in order
+	uint32_t value = 0;
+	uint32_t generation = 1; // bumped on reuse, invalidates old handles
+	PIC_EventHandler pic_event = nullptr;
+	bool cancelled = false;
 };
 
 static struct {
-	PICEntry entries[PIC_QUEUESIZE];
-	PICEntry * free_entry;
-	PICEntry * next_entry;
+	std::vector<PICEntry> entries = {};  // pool, grows as needed
+	std::vector<uint32_t> free = {};     // unused pool entries
+	std::vector<uint32_t> heap = {};     // pending entries, soonest first
+	uint64_t next_sequence = 0;
+	size_t cancelled = 0;                // cancelled entries still in the heap
+	// number of pending events per handler, to skip needless searches
+	std::unordered_map<PIC_EventHandler, uint32_t> pending = {};
 } pic_queue;
 
 static void write_command(io_port_t port, io_val_t value, io_width_t)
@@ -416,104 +428,136 @@ void PIC_SetIRQMask(uint32_t irq, bool masked)
 	pic->set_imr(newmask);
 }
 
-static void AddEntry(PICEntry * entry) {
-	PICEntry * find_entry=pic_queue.next_entry;
-	if (GCC_UNLIKELY(find_entry ==0)) {
-		entry->next=0;
-		pic_queue.next_entry=entry;
-	} else if (find_entry->index>entry->index) {
-		pic_queue.next_entry=entry;
-		entry->next=find_entry;
-	} else while (find_entry) {
-		if (find_entry->next) {
-			/* See if the next index comes later than this one */
-			if (find_entry->next->index > entry->index) {
-				entry->next=find_entry->next;
-				find_entry->next=entry;
-				break;
-			} else {
-				find_entry=find_entry->next;
-			}
-		} else {
-			entry->next=find_entry->next;
-			find_entry->next=entry;
-			break;
-		}
+// heap order: true if entry a is due after entry b
+static bool pic_entry_later(const uint32_t a, const uint32_t b)
+{
+	const auto &ea = pic_queue.entries[a];
+	const auto &eb = pic_queue.entries[b];
+	if (ea.time != eb.time)
+		return ea.time > eb.time;
+	return ea.sequence > eb.sequence;
+}
+
+static void release_entry(const uint32_t slot)
+{
+	auto &entry = pic_queue.entries[slot];
+	if (entry.cancelled)
+		--pic_queue.cancelled;
+	else
+		--pic_queue.pending[entry.pic_event];
+	entry.generation++;
+	entry.cancelled = false;
+	pic_queue.free.push_back(slot);
+}
+
+static void cancel_entry(PICEntry &entry)
+{
+	// The entry stays in the heap and is dropped when it comes up
+	entry.cancelled = true;
+	--pic_queue.pending[entry.pic_event];
+	++pic_queue.cancelled;
+}
+
+// Drops the cancelled entries from the heap once they make up most of it,
+// so repeatedly rescheduled events can't make it grow without bound.
+static void compact_queue()
+{
+	auto &heap = pic_queue.heap;
+	if (pic_queue.cancelled < 64 || pic_queue.cancelled * 2 < heap.size())
+		return;
+	const auto live_end = std::partition(heap.begin(), heap.end(), [](const uint32_t slot) {
+		return !pic_queue.entries[slot].cancelled;
+	});
+	std::for_each(live_end, heap.end(), release_entry);
+	heap.erase(live_end, heap.end());
+	std::make_heap(heap.begin(), heap.end(), pic_entry_later);
+	assert(pic_queue.cancelled == 0);
+}
+
+// Returns the soonest pending entry, dropping cancelled ones on the way
+static PICEntry *next_entry()
+{
+	auto &heap = pic_queue.heap;
+	while (!heap.empty()) {
+		const auto slot = heap.front();
+		auto &entry = pic_queue.entries[slot];
+		if (!entry.cancelled)
+			return &entry;
+		std::pop_heap(heap.begin(), heap.end(), pic_entry_later);
+		heap.pop_back();
+		release_entry(slot);
 	}
-	Bits cycles=PIC_MakeCycles(pic_queue.next_entry->index-PIC_TickIndex());
+	return nullptr;
+}
+
+static bool InEventService = false;
+static double srv_lag = 0.0;
+
+PIC_EventHandle PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val)
+{
+	if (pic_queue.free.empty()) {
+		pic_queue.free.push_back(static_cast<uint32_t>(pic_queue.entries.size()));
+		pic_queue.entries.emplace_back();
+	}
+	const auto slot = pic_queue.free.back();
+	pic_queue.free.pop_back();
+
+	auto &entry = pic_queue.entries[slot];
+	const double index = InEventService ? delay + srv_lag
+	                                    : delay + PIC_TickIndex();
+	entry.time = static_cast<double>(PIC_Ticks) + index;
+	entry.sequence = pic_queue.next_sequence++;
+	entry.pic_event = handler;
+	entry.value = val;
+	++pic_queue.pending[handler];
+
+	pic_queue.heap.push_back(slot);
+	std::push_heap(pic_queue.heap.begin(), pic_queue.heap.end(), pic_entry_later);
+
+	// end the current cycle slice early if this event is due before it
+	Bits cycles = PIC_MakeCycles(index - PIC_TickIndex());
 	if (cycles<CPU_Cycles) {
 		CPU_CycleLeft+=CPU_Cycles;
 		CPU_Cycles=0;
 	}
+	return {slot, entry.generation};
 }
-static bool InEventService = false;
-static double srv_lag = 0.0;
 
-void PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val)
+void PIC_RemoveEvent(const PIC_EventHandle handle)
 {
-	if (GCC_UNLIKELY(!pic_queue.free_entry)) {
-		LOG(LOG_PIC,LOG_ERROR)("Event queue full");
+	if (handle.slot >= pic_queue.entries.size())
 		return;
-	}
-	PICEntry * entry=pic_queue.free_entry;
-	if(InEventService) entry->index = delay + srv_lag;
-	else entry->index = delay + PIC_TickIndex();
-
-	entry->pic_event=handler;
-	entry->value=val;
-	pic_queue.free_entry=pic_queue.free_entry->next;
-	AddEntry(entry);
+	auto &entry = pic_queue.entries[handle.slot];
+	// a stale handle refers to an event that has already run or was removed
+	if (entry.generation != handle.generation || entry.cancelled)
+		return;
+	cancel_entry(entry);
+	compact_queue();
 }
 
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, uint32_t val)
 {
-	PICEntry *entry = pic_queue.next_entry;
-	PICEntry *prev_entry;
-	prev_entry = 0;
-	while (entry) {
-		if (GCC_UNLIKELY((entry->pic_event == handler)) && (entry->value == val)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
+	const auto pending = pic_queue.pending.find(handler);
+	if (pending == pic_queue.pending.end() || !pending->second)
+		return;
+	for (const auto slot : pic_queue.heap) {
+		auto &entry = pic_queue.entries[slot];
+		if (!entry.cancelled && entry.pic_event == handler && entry.value == val)
+			cancel_entry(entry);
 	}
+	compact_queue();
 }
 
 void PIC_RemoveEvents(PIC_EventHandler handler) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry=0;
-	while (entry) {
-		if (GCC_UNLIKELY(entry->pic_event==handler)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
+	const auto pending = pic_queue.pending.find(handler);
+	if (pending == pic_queue.pending.end() || !pending->second)
+		return;
+	for (const auto slot : pic_queue.heap) {
+		auto &entry = pic_queue.entries[slot];
+		if (!entry.cancelled && entry.pic_event == handler)
+			cancel_entry(entry);
 	}
+	compact_queue();
 }
 
 
@@ -528,25 +572,31 @@ bool PIC_RunQueue(void) {
 	const auto index_nd_f = static_cast<double>(PIC_TickIndexND());
 
 	/* Check the queue for an entry */
+	const auto ticks = static_cast<double>(PIC_Ticks);
 	InEventService = true;
-	while (pic_queue.next_entry &&
-	       (pic_queue.next_entry->index * static_cast<double>(CPU_CycleMax) <= index_nd_f)) {
-		PICEntry *entry = pic_queue.next_entry;
-		pic_queue.next_entry = entry->next;
-
-		srv_lag = entry->index;
-		(entry->pic_event)(entry->value); // call the event handler
+	for (auto entry = next_entry(); entry; entry = next_entry()) {
+		const auto index = entry->time - ticks;
+		if (index * static_cast<double>(CPU_CycleMax) > index_nd_f)
+			break;
 
-		/* Put the entry in the free list */
-		entry->next=pic_queue.free_entry;
-		pic_queue.free_entry=entry;
+		/* Take the entry off the queue before running it, as the
+		 * handler is free to add and remove events */
+		const auto slot = pic_queue.heap.front();
+		std::pop_heap(pic_queue.heap.begin(), pic_queue.heap.end(), pic_entry_later);
+		pic_queue.heap.pop_back();
+		const auto handler = entry->pic_event;
+		const auto value = entry->value;
+		release_entry(slot);
+
+		srv_lag = index;
+		handler(value); // call the event handler
 	}
 	InEventService = false;
 
 	/* Check when to set the new cycle end */
-	if (pic_queue.next_entry) {
+	if (const auto entry = next_entry(); entry) {
 		auto cycles = static_cast<int32_t>(
-		        pic_queue.next_entry->index * static_cast<double>(CPU_CycleMax) -
+		        (entry->time - ticks) * static_cast<double>(CPU_CycleMax) -
 		        index_nd_f);
 		if (GCC_UNLIKELY(!cycles))
 			cycles = 1;
@@ -596,12 +646,6 @@ void TIMER_AddTick(void) {
 	CPU_CycleLeft=CPU_CycleMax;
 	CPU_Cycles=0;
 	PIC_Ticks++;
-	/* Go through the list of scheduled events and lower their index with 1000 */
-	PICEntry * entry=pic_queue.next_entry;
-	while (entry) {
-		entry->index -= 1.0f;
-		entry=entry->next;
-	}
 	/* Call our list of ticker handlers */
 	TickerBlock * ticker=firstticker;
 	while (ticker) {
@@ -654,13 +698,15 @@ public:
 		ReadHandler[3].Install(0xa1, read_data, io_width_t::byte);
 		WriteHandler[2].Install(0xa0, write_command, io_width_t::byte);
 		WriteHandler[3].Install(0xa1, write_data, io_width_t::byte);
-		/* Initialize the pic queue */
-		for (i=0;i<PIC_QUEUESIZE-1;i++) {
-			pic_queue.entries[i].next=&pic_queue.entries[i+1];
-		}
-		pic_queue.entries[PIC_QUEUESIZE-1].next=0;
-		pic_queue.free_entry=&pic_queue.entries[0];
-		pic_queue.next_entry=0;
+		/* Initialize the pic queue, the pool grows from here on demand */
+		constexpr uint32_t initial_entries = 512;
+		pic_queue.entries.assign(initial_entries, PICEntry());
+		pic_queue.free.clear();
+		for (auto slot = initial_entries; slot > 0; --slot)
+			pic_queue.free.push_back(slot - 1);
+		pic_queue.heap.clear();
+		pic_queue.pending.clear();
+		pic_queue.cancelled = 0;
 	}
 
 	~PIC_8259A(){
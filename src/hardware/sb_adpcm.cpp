@@ -0,0 +1,175 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *  Copyright (C) 2002-2021  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "sb_adpcm.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+// Each sample looks up its code plus the current step size in a pair of
+// maps: one gives the change to the reference, the other the change to the
+// step size. Rather than walk that per sample, a table per format holds the
+// reference changes and resulting step size for every encoded byte at every
+// step size, so a byte costs one lookup plus a clamp per sample.
+
+namespace {
+
+struct TwoBitMaps {
+	static constexpr uint32_t samples_per_byte = 4;
+	static constexpr int8_t scale_map[24] = {
+		0,  1,  0,  -1, 1,  3,  -1,  -3,
+		2,  6, -2,  -6, 4, 12,  -4, -12,
+		8, 24, -8, -24, 6, 48, -16, -48
+	};
+	static constexpr uint8_t adjust_map[24] = {
+		  0, 4,   0, 4,
+		252, 4, 252, 4, 252, 4, 252, 4,
+		252, 4, 252, 4, 252, 4, 252, 4,
+		252, 0, 252, 0
+	};
+	static constexpr uint8_t code(const uint8_t byte, const uint32_t n)
+	{
+		return (byte >> (6 - 2 * n)) & 0x3;
+	}
+};
+
+struct ThreeBitMaps {
+	static constexpr uint32_t samples_per_byte = 3;
+	static constexpr int8_t scale_map[40] = {
+		0,  1,  2,  3,  0,  -1,  -2,  -3,
+		1,  3,  5,  7, -1,  -3,  -5,  -7,
+		2,  6, 10, 14, -2,  -6, -10, -14,
+		4, 12, 20, 28, -4, -12, -20, -28,
+		5, 15, 25, 35, -5, -15, -25, -35
+	};
+	static constexpr uint8_t adjust_map[40] = {
+		  0, 0, 0, 8,   0, 0, 0, 8,
+		248, 0, 0, 8, 248, 0, 0, 8,
+		248, 0, 0, 8, 248, 0, 0, 8,
+		248, 0, 0, 8, 248, 0, 0, 8,
+		248, 0, 0, 0, 248, 0, 0, 0
+	};
+	// The last sample only has two bits, which are the code's top ones
+	static constexpr uint8_t code(const uint8_t byte, const uint32_t n)
+	{
+		return n == 0 ? (byte >> 5) & 0x7
+		     : n == 1 ? (byte >> 2) & 0x7
+		              : static_cast<uint8_t>((byte & 0x3) << 1);
+	}
+};
+
+struct FourBitMaps {
+	static constexpr uint32_t samples_per_byte = 2;
+	static constexpr int8_t scale_map[64] = {
+		0,  1,  2,  3,  4,  5,  6,  7,  0,  -1,  -2,  -3,  -4,  -5,  -6,  -7,
+		1,  3,  5,  7,  9, 11, 13, 15, -1,  -3,  -5,  -7,  -9, -11, -13, -15,
+		2,  6, 10, 14, 18, 22, 26, 30, -2,  -6, -10, -14, -18, -22, -26, -30,
+		4, 12, 20, 28, 36, 44, 52, 60, -4, -12, -20, -28, -36, -44, -52, -60
+	};
+	static constexpr uint8_t adjust_map[64] = {
+		  0, 0, 0, 0, 0, 16, 16, 16,
+		  0, 0, 0, 0, 0, 16, 16, 16,
+		240, 0, 0, 0, 0, 16, 16, 16,
+		240, 0, 0, 0, 0, 16, 16, 16,
+		240, 0, 0, 0, 0, 16, 16, 16,
+		240, 0, 0, 0, 0, 16, 16, 16,
+		240, 0, 0, 0, 0,  0,  0,  0,
+		240, 0, 0, 0, 0,  0,  0,  0
+	};
+	static constexpr uint8_t code(const uint8_t byte, const uint32_t n)
+	{
+		return n == 0 ? byte >> 4 : byte & 0xf;
+	}
+};
+
+struct ByteStep {
+	std::array<int8_t, 4> deltas = {};
+	uint16_t next_stepsize = 0;
+};
+
+// Step sizes at or above the last map index always pick that entry, which
+// leaves the step size unchanged, so they all share the last row
+template <typename Maps>
+constexpr uint16_t last_index = static_cast<uint16_t>(std::size(Maps::scale_map) - 1);
+
+template <typename Maps>
+using StepTable = std::array<std::array<ByteStep, 256>, last_index<Maps> + 1>;
+
+template <typename Maps>
+StepTable<Maps> build_step_table()
+{
+	static_assert(Maps::adjust_map[last_index<Maps>] == 0);
+
+	StepTable<Maps> table = {};
+	for (uint16_t stepsize = 0; stepsize <= last_index<Maps>; ++stepsize) {
+		for (uint16_t byte = 0; byte < 256; ++byte) {
+			auto &step = table[stepsize][byte];
+			auto scale = stepsize;
+			for (uint32_t n = 0; n < Maps::samples_per_byte; ++n) {
+				const auto code = Maps::code(static_cast<uint8_t>(byte), n);
+				const auto i = std::min<uint16_t>(code + scale,
+				                                  last_index<Maps>);
+				scale = (scale + Maps::adjust_map[i]) & 0xff;
+				step.deltas[n] = Maps::scale_map[i];
+			}
+			step.next_stepsize = scale;
+		}
+	}
+	return table;
+}
+
+template <typename Maps>
+uint32_t decode(AdpcmState &state, const uint8_t *in, const uint32_t num_bytes,
+                uint8_t *out)
+{
+	static const auto table = build_step_table<Maps>();
+
+	int reference = state.reference;
+	auto stepsize = state.stepsize;
+	for (uint32_t b = 0; b < num_bytes; ++b) {
+		const auto row = std::min(stepsize, last_index<Maps>);
+		const auto &step = table[row][in[b]];
+		for (uint32_t n = 0; n < Maps::samples_per_byte; ++n) {
+			reference = std::clamp(reference + step.deltas[n], 0, 255);
+			*out++ = static_cast<uint8_t>(reference);
+		}
+		if (stepsize < last_index<Maps>)
+			stepsize = step.next_stepsize;
+	}
+	state.reference = static_cast<uint8_t>(reference);
+	state.stepsize = stepsize;
+	return num_bytes * Maps::samples_per_byte;
+}
+
+} // namespace
+
+uint32_t ADPCM_Decode(const AdpcmFormat format, AdpcmState &state,
+                      const uint8_t *in, const uint32_t num_bytes, uint8_t *out)
+{
+	switch (format) {
+	case AdpcmFormat::TwoBit: return decode<TwoBitMaps>(state, in, num_bytes, out);
+	case AdpcmFormat::ThreeBit: return decode<ThreeBitMaps>(state, in, num_bytes, out);
+	case AdpcmFormat::FourBit: return decode<FourBitMaps>(state, in, num_bytes, out);
+	}
+	assert(false);
+	return 0;
+}
@@ -30,6 +30,7 @@
 #include "mixer.h"
 #include "midi.h"
 #include "pic.h"
+#include "sb_adpcm.h"
 #include "setup.h"
 #include "shell.h"
 #include "string_utils.h"
@@ -173,8 +174,7 @@ struct SB_INFO {
 		uint8_t unhandled[0x48] = {};
 	} mixer = {};
 	struct {
-		uint8_t reference = 0;
-		uint16_t stepsize = 0;
+		AdpcmState state = {};
 		bool haveref = false;
 	} adpcm = {};
 	struct {
@@ -554,83 +554,6 @@ static void DSP_DMA_CallBack(DmaChannel * chan, DMAEvent event) {
 	}
 }
 
-static uint8_t decode_ADPCM_4_sample(const int val)
-{
-	const auto sample = check_cast<uint8_t>(val);
-	constexpr int8_t scaleMap[64] = {
-		0,  1,  2,  3,  4,  5,  6,  7,  0,  -1,  -2,  -3,  -4,  -5,  -6,  -7,
-		1,  3,  5,  7,  9, 11, 13, 15, -1,  -3,  -5,  -7,  -9, -11, -13, -15,
-		2,  6, 10, 14, 18, 22, 26, 30, -2,  -6, -10, -14, -18, -22, -26, -30,
-		4, 12, 20, 28, 36, 44, 52, 60, -4, -12, -20, -28, -36, -44, -52, -60
-	};
-	constexpr uint8_t adjustMap[64] = {
-		  0, 0, 0, 0, 0, 16, 16, 16,
-		  0, 0, 0, 0, 0, 16, 16, 16,
-		240, 0, 0, 0, 0, 16, 16, 16,
-		240, 0, 0, 0, 0, 16, 16, 16,
-		240, 0, 0, 0, 0, 16, 16, 16,
-		240, 0, 0, 0, 0, 16, 16, 16,
-		240, 0, 0, 0, 0,  0,  0,  0,
-		240, 0, 0, 0, 0,  0,  0,  0
-	};
-	auto & scale = sb.adpcm.stepsize;
-	const auto i = std::min(sample + scale, 63);
-	scale = (scale + adjustMap[i]) & 0xff;
-
-	auto &ref = sb.adpcm.reference;
-	ref = static_cast<uint8_t>(clamp(ref + scaleMap[i], 0, 255));
-	return ref;
-}
-
-static uint8_t decode_ADPCM_2_sample(const int val)
-{
-	const auto sample = check_cast<uint8_t>(val);
-	constexpr int8_t scaleMap[24] = {
-		0,  1,  0,  -1, 1,  3,  -1,  -3,
-		2,  6, -2,  -6, 4, 12,  -4, -12,
-		8, 24, -8, -24, 6, 48, -16, -48
-	};
-	constexpr uint8_t adjustMap[24] = {
-		  0, 4,   0, 4,
-		252, 4, 252, 4, 252, 4, 252, 4,
-		252, 4, 252, 4, 252, 4, 252, 4,
-		252, 0, 252, 0
-	};
-	auto & scale = sb.adpcm.stepsize;
-	const auto i = std::min(sample + scale, 23);
-	scale = (scale + adjustMap[i]) & 0xff;
-
-	auto &ref = sb.adpcm.reference;
-	ref = static_cast<uint8_t>(clamp(ref + scaleMap[i], 0, 255));
-	return ref;
-}
-
-static uint8_t decode_ADPCM_3_sample(const int val)
-{
-	const auto sample = check_cast<uint8_t>(val);
-	constexpr int8_t scaleMap[40] = {
-		0,  1,  2,  3,  0,  -1,  -2,  -3,
-		1,  3,  5,  7, -1,  -3,  -5,  -7,
-		2,  6, 10, 14, -2,  -6, -10, -14,
-		4, 12, 20, 28, -4, -12, -20, -28,
-		5, 15, 25, 35, -5, -15, -25, -35
-	};
-	constexpr uint8_t adjustMap[40] = {
-		  0, 0, 0, 8,   0, 0, 0, 8,
-		248, 0, 0, 8, 248, 0, 0, 8,
-		248, 0, 0, 8, 248, 0, 0, 8,
-		248, 0, 0, 8, 248, 0, 0, 8,
-		248, 0, 0, 0, 248, 0, 0, 0
-	};
-	auto & scale = sb.adpcm.stepsize;
-	const auto i = std::min(sample + scale, 39);
-	scale = (scale + adjustMap[i]) & 0xff;
-
-	auto &ref = sb.adpcm.reference;
-	ref = static_cast<uint8_t>(clamp(ref + scaleMap[i], 0, 255));
-	return ref;
-}
-
 template <typename T>
 static const T *maybe_silence(const uint32_t num_samples, const T *buffer)
 {
@@ -680,59 +603,29 @@ static void PlayDMATransfer(uint32_t bytes_requested)
 
 	last_dma_callback = PIC_FullIndex();
 
-	// Temporary counter for ADPCM modes
-	uint32_t i = 0;
-
 	//Read the actual data, process it and send it off to the mixer
 	switch (sb.dma.mode) {
 	case DSP_DMA_2:
-		bytes_read = ReadDMA8(bytes_to_read);
-		if (bytes_read && sb.adpcm.haveref) {
-			sb.adpcm.haveref=false;
-			sb.adpcm.reference=sb.dma.buf.b8[0];
-			sb.adpcm.stepsize=MIN_ADAPTIVE_STEP_SIZE;
-			i++;
-		}
-		for (;i<bytes_read; ++i) {
-			MixTemp[samples++]=decode_ADPCM_2_sample((sb.dma.buf.b8[i] >> 6) & 0x3);
-			MixTemp[samples++]=decode_ADPCM_2_sample((sb.dma.buf.b8[i] >> 4) & 0x3);
-			MixTemp[samples++]=decode_ADPCM_2_sample((sb.dma.buf.b8[i] >> 2) & 0x3);
-			MixTemp[samples++]=decode_ADPCM_2_sample((sb.dma.buf.b8[i] >> 0) & 0x3);
-		}
-		frames = check_cast<uint16_t>(samples / channels);
-		sb.chan->AddSamples_m8(frames, maybe_silence(samples, MixTemp));
-		break;
 	case DSP_DMA_3:
+	case DSP_DMA_4: {
+		const auto format = sb.dma.mode == DSP_DMA_2 ? AdpcmFormat::TwoBit
+		                  : sb.dma.mode == DSP_DMA_3 ? AdpcmFormat::ThreeBit
+		                                             : AdpcmFormat::FourBit;
 		bytes_read = ReadDMA8(bytes_to_read);
+		const uint8_t *encoded = sb.dma.buf.b8;
+		auto bytes_to_decode = bytes_read;
 		if (bytes_read && sb.adpcm.haveref) {
-			sb.adpcm.haveref=false;
-			sb.adpcm.reference=sb.dma.buf.b8[0];
-			sb.adpcm.stepsize=MIN_ADAPTIVE_STEP_SIZE;
-			i++;
-		}
-		for (;i<bytes_read; ++i) {
-			MixTemp[samples++]=decode_ADPCM_3_sample((sb.dma.buf.b8[i] >> 5) & 0x7);
-			MixTemp[samples++]=decode_ADPCM_3_sample((sb.dma.buf.b8[i] >> 2) & 0x7);
-			MixTemp[samples++]=decode_ADPCM_3_sample((sb.dma.buf.b8[i] & 0x3) << 1);
-		}
-		frames = check_cast<uint16_t>(samples / channels);
-		sb.chan->AddSamples_m8(frames,maybe_silence(samples, MixTemp));
-		break;
-	case DSP_DMA_4:
-		bytes_read = ReadDMA8(bytes_to_read);
-		if (bytes_read && sb.adpcm.haveref) {
-			sb.adpcm.haveref=false;
-			sb.adpcm.reference=sb.dma.buf.b8[0];
-			sb.adpcm.stepsize=MIN_ADAPTIVE_STEP_SIZE;
-			i++;
-		}
-		for (;i<bytes_read; ++i) {
-			MixTemp[samples++]=decode_ADPCM_4_sample(sb.dma.buf.b8[i] >> 4);
-			MixTemp[samples++]=decode_ADPCM_4_sample(sb.dma.buf.b8[i]& 0xf);
+			sb.adpcm.haveref = false;
+			sb.adpcm.state.reference = encoded[0];
+			sb.adpcm.state.stepsize = MIN_ADAPTIVE_STEP_SIZE;
+			++encoded;
+			--bytes_to_decode;
 		}
+		samples = ADPCM_Decode(format, sb.adpcm.state, encoded,
+		                       bytes_to_decode, MixTemp);
 		frames = check_cast<uint16_t>(samples / channels);
 		sb.chan->AddSamples_m8(frames, maybe_silence(samples, MixTemp));
-		break;
+	} break;
 	case DSP_DMA_8:
  		if (sb.dma.stereo) {
 			bytes_read = ReadDMA8(bytes_to_read, sb.dma.remain_size);
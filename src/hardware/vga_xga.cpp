@@ -18,6 +18,8 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <math.h>
 #include <stdio.h>
@@ -254,6 +256,342 @@ static Bitu GetMixResult(uint32_t mixmode, Bitu srcval, Bitu dstdata)
 	return destval;
 }
 
+// Row-wise paths for the rectangle, blit and pattern commands. They apply
+// when the whole command lies inside the scissors and video memory, where
+// XGA_DrawPoint would never clip, so each row is one contiguous run of
+// pixels that can be mixed without going through the per-pixel calls.
+
+// Each mix can be written as (DST and keep) xor flip, with both terms
+// depending only on the source value
+struct XGAMixTerms {
+	uint32_t keep = 0;
+	uint32_t flip = 0;
+};
+
+static XGAMixTerms GetMixTerms(const uint32_t mixmode, const uint32_t s)
+{
+	constexpr uint32_t all = 0xffffffff;
+	switch (mixmode & 0xf) {
+	case 0x00: return {all, all}; /* not DST */
+	case 0x01: return {0, 0};     /* 0 (false) */
+	case 0x02: return {0, all};   /* 1 (true) */
+	case 0x03: return {all, 0};   /* 2 DST */
+	case 0x04: return {0, ~s};    /* not SRC */
+	case 0x05: return {all, s};   /* SRC xor DST */
+	case 0x06: return {all, ~s};  /* not (SRC xor DST) */
+	case 0x07: return {0, s};     /* SRC */
+	case 0x08: return {s, all};   /* not (SRC and DST) */
+	case 0x09: return {s, ~s};    /* (not SRC) or DST */
+	case 0x0a: return {~s, all};  /* SRC or (not DST) */
+	case 0x0b: return {~s, s};    /* SRC or DST */
+	case 0x0c: return {s, 0};     /* SRC and DST */
+	case 0x0d: return {s, s};     /* SRC and (not DST) */
+	case 0x0e: return {~s, 0};    /* (not SRC) and DST */
+	case 0x0f: return {~s, ~s};   /* not (SRC or DST) */
+	}
+	return {};
+}
+
+// The bits XGA_DrawPoint keeps when storing a pixel
+static uint32_t XGA_PixelMask()
+{
+	switch (XGA_COLOR_MODE) {
+	case M_LIN8: return 0xff;
+	case M_LIN15: return 0x7fff;
+	case M_LIN16: return 0xffff;
+	case M_LIN32: return 0xffffffff;
+	default: return 0;
+	}
+}
+
+static Bitu XGA_BytesPerPixel()
+{
+	switch (XGA_COLOR_MODE) {
+	case M_LIN8: return 1;
+	case M_LIN15:
+	case M_LIN16: return 2;
+	case M_LIN32: return 4;
+	default: return 0;
+	}
+}
+
+// Lowest coordinate covered by a run of count pixels walked in direction d
+static Bits XGA_RunStart(const Bits start, const Bits count, const Bits d)
+{
+	return d > 0 ? start : start - (count - 1);
+}
+
+static bool XGA_InVideoMemory(const Bits x1, const Bits y1, const Bits x2, const Bits y2)
+{
+	const auto bpp = XGA_BytesPerPixel();
+	if (!bpp || x1 < 0 || y1 < 0 || x2 < x1 || y2 < y1)
+		return false;
+	const auto last = static_cast<Bitu>(y2) * XGA_SCREEN_WIDTH +
+	                  static_cast<Bitu>(x2);
+	return (last + 1) * bpp <= vga.vmemsize;
+}
+
+static bool XGA_DrawsUnclipped(const Bits x1, const Bits y1, const Bits x2, const Bits y2)
+{
+	if (!(xga.curcommand & 0x1) || !(xga.curcommand & 0x10))
+		return false;
+	if (x1 < xga.scissors.x1 || x2 > xga.scissors.x2 ||
+	    y1 < xga.scissors.y1 || y2 > xga.scissors.y2)
+		return false;
+	return XGA_InVideoMemory(x1, y1, x2, y2);
+}
+
+template <typename T>
+static T *XGA_PixelPtr(const Bits x, const Bits y)
+{
+	return reinterpret_cast<T *>(vga.mem.linear) +
+	       static_cast<Bitu>(y) * XGA_SCREEN_WIDTH + static_cast<Bitu>(x);
+}
+
+template <typename T>
+static void XGA_MixRun(T *dst, const Bits count, const XGAMixTerms terms,
+                       const uint32_t pixel_mask)
+{
+	const auto keep = static_cast<T>(terms.keep & pixel_mask);
+	const auto flip = static_cast<T>(terms.flip & pixel_mask);
+	if (!keep) {
+		std::fill_n(dst, count, flip);
+		return;
+	}
+	for (Bits i = 0; i < count; ++i)
+		dst[i] = static_cast<T>((dst[i] & keep) ^ flip);
+}
+
+template <typename T>
+static void XGA_FillRect(const Bits x, const Bits y, const Bits w, const Bits h,
+                         const XGAMixTerms terms)
+{
+	const auto pixel_mask = XGA_PixelMask();
+	for (Bits row = y; row < y + h; ++row)
+		XGA_MixRun(XGA_PixelPtr<T>(x, row), w, terms, pixel_mask);
+}
+
+// Mixes a source run into a destination run, walking the pixels in the
+// same order as the per-pixel loop so overlapping runs come out the same
+template <typename T>
+static void XGA_BlitRun(T *dst, const T *src, const Bits count,
+                        const bool backwards, const uint32_t mixmode,
+                        const uint32_t pixel_mask)
+{
+	if ((mixmode & 0xf) == 0x07 && pixel_mask == static_cast<T>(~T(0))) {
+		const bool overlap_safe = backwards ? (dst >= src || dst + count <= src)
+		                                    : (dst <= src || dst >= src + count);
+		if (overlap_safe) {
+			memmove(dst, src, count * sizeof(T));
+			return;
+		}
+	}
+	const auto mix_pixel = [&](const Bits i) {
+		const auto terms = GetMixTerms(mixmode, src[i]);
+		dst[i] = static_cast<T>(((dst[i] & terms.keep) ^ terms.flip) & pixel_mask);
+	};
+	if (backwards) {
+		for (Bits i = count - 1; i >= 0; --i)
+			mix_pixel(i);
+	} else {
+		for (Bits i = 0; i < count; ++i)
+			mix_pixel(i);
+	}
+}
+
+template <typename T>
+static void XGA_BlitRows(const Bits srcx, const Bits srcy, const Bits tarx,
+                         const Bits tary, const Bits w, const Bits h,
+                         const Bits dx, const Bits dy, const uint32_t mixmode)
+{
+	const auto pixel_mask = XGA_PixelMask();
+	for (Bits yat = 0; yat < h; ++yat) {
+		const auto sy = srcy + dy * yat;
+		const auto ty = tary + dy * yat;
+		XGA_BlitRun(XGA_PixelPtr<T>(tarx, ty),
+		            XGA_PixelPtr<const T>(srcx, sy),
+		            w,
+		            dx < 0,
+		            mixmode,
+		            pixel_mask);
+	}
+}
+
+// Each row of a pattern fill repeats the same eight mixes, picked by the
+// low three bits of the target x coordinate
+template <typename T>
+static void XGA_PatternRow(T *dst, const Bits x, const Bits count,
+                           const std::array<XGAMixTerms, 8> &terms)
+{
+	const auto pixel_mask = XGA_PixelMask();
+	std::array<T, 8> keep = {};
+	std::array<T, 8> flip = {};
+	for (size_t i = 0; i < 8; ++i) {
+		keep[i] = static_cast<T>(terms[i].keep & pixel_mask);
+		flip[i] = static_cast<T>(terms[i].flip & pixel_mask);
+	}
+	for (Bits i = 0; i < count; ++i) {
+		const auto phase = static_cast<size_t>((x + i) & 0x7);
+		dst[i] = static_cast<T>((dst[i] & keep[phase]) ^ flip[phase]);
+	}
+}
+
+// Source value picked by a mix for the immediate commands, or false when
+// the source needs data the row-wise paths don't handle
+static bool XGA_GetMixSource(const uint32_t mixmode, const Bitu bitmap, uint32_t &srcval)
+{
+	switch ((mixmode >> 5) & 0x03) {
+	case 0x00: srcval = xga.backcolor; return true;
+	case 0x01: srcval = xga.forecolor; return true;
+	case 0x03: srcval = static_cast<uint32_t>(bitmap); return true;
+	default: return false;
+	}
+}
+
+static bool XGA_FastRectangle(const Bits x, const Bits y, const Bits dx,
+                              const Bits dy, const Bits w, const Bits h)
+{
+	// Only the foreground mix with a colour source is drawn by this command
+	if (((xga.pix_cntl >> 6) & 0x3) != 0 || ((xga.foremix >> 5) & 0x03) > 1)
+		return false;
+
+	const auto x1 = XGA_RunStart(x, w, dx);
+	const auto y1 = XGA_RunStart(y, h, dy);
+	if (!XGA_DrawsUnclipped(x1, y1, x1 + w - 1, y1 + h - 1))
+		return false;
+
+	uint32_t srcval = 0;
+	XGA_GetMixSource(xga.foremix, 0, srcval);
+	const auto terms = GetMixTerms(xga.foremix, srcval);
+	switch (XGA_COLOR_MODE) {
+	case M_LIN8: XGA_FillRect<uint8_t>(x1, y1, w, h, terms); break;
+	case M_LIN15:
+	case M_LIN16: XGA_FillRect<uint16_t>(x1, y1, w, h, terms); break;
+	case M_LIN32: XGA_FillRect<uint32_t>(x1, y1, w, h, terms); break;
+	default: return false;
+	}
+	return true;
+}
+
+static bool XGA_FastBlit(const Bits dx, const Bits dy)
+{
+	// Mixes selected per pixel stay on the per-pixel path
+	if (((xga.pix_cntl >> 6) & 0x3) != 0)
+		return false;
+	const uint32_t mixmode = xga.foremix;
+	const auto source = (mixmode >> 5) & 0x03;
+	if (source == 0x02)
+		return false;
+
+	const Bits w = xga.MAPcount + 1;
+	const Bits h = xga.MIPcount + 1;
+	const auto tx1 = XGA_RunStart(xga.destx, w, dx);
+	const auto ty1 = XGA_RunStart(xga.desty, h, dy);
+	if (!XGA_DrawsUnclipped(tx1, ty1, tx1 + w - 1, ty1 + h - 1))
+		return false;
+
+	// A colour source doesn't read the bitmap, so it's a plain fill
+	if (source != 0x03) {
+		uint32_t srcval = 0;
+		XGA_GetMixSource(mixmode, 0, srcval);
+		const auto terms = GetMixTerms(mixmode, srcval);
+		switch (XGA_COLOR_MODE) {
+		case M_LIN8: XGA_FillRect<uint8_t>(tx1, ty1, w, h, terms); break;
+		case M_LIN15:
+		case M_LIN16: XGA_FillRect<uint16_t>(tx1, ty1, w, h, terms); break;
+		case M_LIN32: XGA_FillRect<uint32_t>(tx1, ty1, w, h, terms); break;
+		default: return false;
+		}
+		return true;
+	}
+
+	const auto sx1 = XGA_RunStart(xga.curx, w, dx);
+	const auto sy1 = XGA_RunStart(xga.cury, h, dy);
+	if (!XGA_InVideoMemory(sx1, sy1, sx1 + w - 1, sy1 + h - 1))
+		return false;
+
+	// Rows are walked in the command's vertical direction, starting from
+	// the first row it touches
+	const auto sy = dy > 0 ? sy1 : sy1 + h - 1;
+	const auto ty = dy > 0 ? ty1 : ty1 + h - 1;
+	switch (XGA_COLOR_MODE) {
+	case M_LIN8:
+		XGA_BlitRows<uint8_t>(sx1, sy, tx1, ty, w, h, dx, dy, mixmode);
+		break;
+	case M_LIN15:
+	case M_LIN16:
+		XGA_BlitRows<uint16_t>(sx1, sy, tx1, ty, w, h, dx, dy, mixmode);
+		break;
+	case M_LIN32:
+		XGA_BlitRows<uint32_t>(sx1, sy, tx1, ty, w, h, dx, dy, mixmode);
+		break;
+	default: return false;
+	}
+	return true;
+}
+
+template <typename T>
+static void XGA_PatternRows(const Bits x1, const Bits tary, const Bits w,
+                            const Bits h, const Bits dy, const Bitu mixselect)
+{
+	for (Bits yat = 0; yat < h; ++yat) {
+		const auto ty = tary + dy * yat;
+		std::array<XGAMixTerms, 8> terms = {};
+		for (Bits phase = 0; phase < 8; ++phase) {
+			const auto srcdata = XGA_GetPoint(xga.curx + phase,
+			                                  xga.cury + (ty & 0x7));
+			uint32_t mixmode = xga.foremix;
+			if (mixselect == 0x3)
+				mixmode = srcdata ? xga.foremix : xga.backmix;
+			uint32_t srcval = 0;
+			XGA_GetMixSource(mixmode, srcdata, srcval);
+			terms[static_cast<size_t>(phase)] = GetMixTerms(mixmode, srcval);
+		}
+		XGA_PatternRow(XGA_PixelPtr<T>(x1, ty), x1, w, terms);
+	}
+}
+
+static bool XGA_FastPattern(const Bits dx, const Bits dy)
+{
+	const Bitu mixselect = (xga.pix_cntl >> 6) & 0x3;
+	if (mixselect != 0x0 && mixselect != 0x3)
+		return false;
+	if (((xga.foremix >> 5) & 0x03) == 0x02 ||
+	    (mixselect == 0x3 && ((xga.backmix >> 5) & 0x03) == 0x02))
+		return false;
+
+	const Bits w = xga.MAPcount + 1;
+	const Bits h = xga.MIPcount + 1;
+	const auto tx1 = XGA_RunStart(xga.destx, w, dx);
+	const auto ty1 = XGA_RunStart(xga.desty, h, dy);
+	if (!XGA_DrawsUnclipped(tx1, ty1, tx1 + w - 1, ty1 + h - 1))
+		return false;
+
+	// The 8x8 pattern is read up front for each row, so it must not be
+	// overwritten by the fill itself
+	const Bits px1 = xga.curx;
+	const Bits py1 = xga.cury;
+	if (!XGA_InVideoMemory(px1, py1, px1 + 7, py1 + 7))
+		return false;
+	const auto pattern_first = static_cast<Bitu>(py1) * XGA_SCREEN_WIDTH + px1;
+	const auto pattern_last = static_cast<Bitu>(py1 + 7) * XGA_SCREEN_WIDTH + px1 + 7;
+	const auto target_first = static_cast<Bitu>(ty1) * XGA_SCREEN_WIDTH + tx1;
+	const auto target_last = static_cast<Bitu>(ty1 + h - 1) * XGA_SCREEN_WIDTH +
+	                         tx1 + w - 1;
+	if (pattern_first <= target_last && target_first <= pattern_last)
+		return false;
+
+	const auto ty = dy > 0 ? ty1 : ty1 + h - 1;
+	switch (XGA_COLOR_MODE) {
+	case M_LIN8: XGA_PatternRows<uint8_t>(tx1, ty, w, h, dy, mixselect); break;
+	case M_LIN15:
+	case M_LIN16: XGA_PatternRows<uint16_t>(tx1, ty, w, h, dy, mixselect); break;
+	case M_LIN32: XGA_PatternRows<uint32_t>(tx1, ty, w, h, dy, mixselect); break;
+	default: return false;
+	}
+	return true;
+}
+
 static void XGA_DrawLineVector(const uint32_t val, const bool skip_last_pixel)
 {
 	// No work to do with a zero-length line
@@ -515,6 +853,12 @@ static void XGA_DrawRectangle(const uint32_t val, const bool skip_last_pixel)
 	// one pixel too wide (but don't underflow below zero).
 	const auto xrun = xga.MAPcount - (xga.MAPcount && skip_last_pixel);
 
+	if (XGA_FastRectangle(xga.curx, xga.cury, dx, dy, xrun + 1, xga.MIPcount + 1)) {
+		xga.curx = static_cast<uint16_t>(xga.curx + dx * (xrun + 1));
+		xga.cury = static_cast<uint16_t>(xga.cury + dy * (xga.MIPcount + 1));
+		return;
+	}
+
 	for (auto yat = 0; yat <= xga.MIPcount; ++yat) {
 		srcx = xga.curx;
 		for (auto xat = 0; xat <= xrun; ++xat) {
@@ -803,6 +1147,9 @@ void XGA_BlitRect(Bitu val) {
 	if(((val >> 5) & 0x01) != 0) dx = 1;
 	if(((val >> 7) & 0x01) != 0) dy = 1;
 
+	if (XGA_FastBlit(dx, dy))
+		return;
+
 	Bitu mixselect = (xga.pix_cntl >> 6) & 0x3;
 	uint32_t mixmode = 0x67; /* Source is bitmap data, mix mode is src */
 	switch(mixselect) {
@@ -894,6 +1241,9 @@ void XGA_DrawPattern(Bitu val) {
 
 	tary = xga.desty;
 
+	if (XGA_FastPattern(dx, dy))
+		return;
+
 	Bitu mixselect = (xga.pix_cntl >> 6) & 0x3;
 	uint32_t mixmode = 0x67; /* Source is bitmap data, mix mode is src */
 	switch (mixselect) {
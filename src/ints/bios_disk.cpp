@@ -20,14 +20,23 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cinttypes>
 #include <utility>
 
+#if defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include "callback.h"
+#include "control.h"
 #include "regs.h"
 #include "mem.h"
 #include "dos_inc.h" /* for Drives[] */
 #include "drives.h"
 #include "mapper.h"
+#include "setup.h"
 #include "string_utils.h"
 
 diskGeo DiskGeometryList[] = {
@@ -166,6 +175,9 @@ uint8_t imageDisk::Read_AbsoluteSector(uint32_t sectnum, void *data)
 {
 	const uint32_t bytenum = sectnum * sector_size;
 
+	if (mapped_image || !cache.empty())
+		return CachedRead(bytenum, static_cast<uint8_t *>(data));
+
 	if (last_action == WRITE || bytenum != current_fpos) {
 		if (fseek(diskimg, bytenum, SEEK_SET) != 0) {
 			LOG_ERR("BIOSDISK: Could not seek to sector %u in file '%s': %s",
@@ -176,6 +188,7 @@ uint8_t imageDisk::Read_AbsoluteSector(uint32_t sectnum, void *data)
 	size_t ret = fread(data, 1, sector_size, diskimg);
 	current_fpos=bytenum+ret;
 	last_action=READ;
+	cache_stats.host_bytes_read += ret;
 
 	return 0x00;
 }
@@ -196,6 +209,9 @@ uint8_t imageDisk::Write_AbsoluteSector(uint32_t sectnum, void *data) {
 
 	//LOG_MSG("Writing sectors to %ld at bytenum %d", sectnum, bytenum);
 
+	if (mapped_image || !cache.empty())
+		return CachedWrite(bytenum, static_cast<const uint8_t *>(data));
+
 	if (last_action == READ || bytenum != current_fpos) {
 		if (fseek(diskimg, bytenum, SEEK_SET) != 0) {
 			LOG_ERR("BIOSDISK: Could not seek to byte %u in file '%s': %s",
@@ -206,11 +222,245 @@ uint8_t imageDisk::Write_AbsoluteSector(uint32_t sectnum, void *data) {
 	size_t ret = fwrite(data, 1, sector_size, diskimg);
 	current_fpos=bytenum+ret;
 	last_action=WRITE;
+	cache_stats.host_bytes_written += ret;
 
 	return ((ret>0)?0x00:0x05);
 
 }
 
+imageDisk::CacheBlock *imageDisk::GetCacheBlock(uint32_t index)
+{
+	++cache_tick;
+	const auto it = cache_map.find(index);
+	if (it != cache_map.end()) {
+		++cache_stats.hits;
+		it->second->last_used = cache_tick;
+		return it->second;
+	}
+	++cache_stats.misses;
+	if (!LoadCacheBlocks(index))
+		return nullptr;
+	return cache_map[index];
+}
+
+bool imageDisk::LoadCacheBlocks(uint32_t index)
+{
+	// Read further ahead while the misses keep following each other
+	readahead = (index == last_miss + 1) ? std::min(readahead * 2, readahead_max) : 1;
+
+	uint32_t loaded = 0;
+	while (loaded < readahead) {
+		const uint32_t block_index = index + loaded;
+		if (loaded > 0 && cache_map.count(block_index))
+			break;
+
+		auto victim = std::min_element(cache.begin(), cache.end(),
+		                               [](const CacheBlock &a, const CacheBlock &b) {
+			                               return a.last_used < b.last_used;
+		                               });
+		FlushCacheBlock(*victim);
+		cache_map.erase(victim->index);
+		victim->index = UINT32_MAX;
+
+		if (fseek(diskimg, block_index * cache_block_size, SEEK_SET) != 0) {
+			LOG_ERR("BIOSDISK: Could not seek to block %u in file '%s': %s",
+			        block_index, diskname, strerror(errno));
+			break;
+		}
+		const auto ret = fread(victim->data.data(), 1, cache_block_size, diskimg);
+		std::fill(victim->data.begin() + ret, victim->data.end(), 0);
+		cache_stats.host_bytes_read += ret;
+
+		victim->index = block_index;
+		victim->last_used = cache_tick;
+		victim->valid_bytes = check_cast<uint32_t>(ret);
+		cache_map[block_index] = &*victim;
+		++loaded;
+
+		// Nothing left to read ahead past the end of the image
+		if (ret < cache_block_size)
+			break;
+	}
+	last_miss = index + loaded - 1;
+	return loaded > 0;
+}
+
+void imageDisk::FlushCacheBlock(CacheBlock &block)
+{
+	if (block.dirty_end <= block.dirty_start)
+		return;
+
+	const uint32_t bytenum = block.index * cache_block_size + block.dirty_start;
+	const uint32_t bytes = block.dirty_end - block.dirty_start;
+	block.dirty_start = block.dirty_end = 0;
+
+	if (fseek(diskimg, bytenum, SEEK_SET) != 0) {
+		LOG_ERR("BIOSDISK: Could not seek to byte %u in file '%s': %s",
+		        bytenum, diskname, strerror(errno));
+		return;
+	}
+	const auto ret = fwrite(&block.data[bytenum % cache_block_size], 1, bytes, diskimg);
+	cache_stats.host_bytes_written += ret;
+	if (ret != bytes)
+		LOG_ERR("BIOSDISK: Could not write %u bytes at byte %u to file '%s': %s",
+		        bytes, bytenum, diskname, strerror(errno));
+}
+
+uint8_t imageDisk::CachedRead(uint32_t bytenum, uint8_t *data)
+{
+	// As with fread, the part of a sector past the end of the image is
+	// left untouched
+	if (mapped_image) {
+		++cache_stats.hits;
+		if (bytenum < mapped_size) {
+			const auto bytes = std::min<size_t>(sector_size, mapped_size - bytenum);
+			memcpy(data, mapped_image + bytenum, bytes);
+			cache_stats.host_bytes_read += bytes;
+		}
+		return 0x00;
+	}
+
+	uint32_t done = 0;
+	while (done < sector_size) {
+		const uint32_t pos = bytenum + done;
+		const CacheBlock *block = GetCacheBlock(pos / cache_block_size);
+		if (!block)
+			return 0xff;
+		const uint32_t offset = pos % cache_block_size;
+		const uint32_t bytes = std::min(sector_size - done, cache_block_size - offset);
+		if (offset < block->valid_bytes)
+			memcpy(data + done, &block->data[offset],
+			       std::min(bytes, block->valid_bytes - offset));
+		done += bytes;
+	}
+	return 0x00;
+}
+
+uint8_t imageDisk::CachedWrite(uint32_t bytenum, const uint8_t *data)
+{
+	if (read_only)
+		return 0x05;
+
+	// The first write goes straight to the file to learn whether the
+	// image is writable, so read-only images keep failing right away
+	// instead of when the block is written back
+	if (!write_checked) {
+		write_checked = true;
+		size_t ret = 0;
+		if (fseek(diskimg, bytenum, SEEK_SET) == 0)
+			ret = fwrite(data, 1, sector_size, diskimg);
+		if (ret == 0) {
+			read_only = true;
+			return 0x05;
+		}
+		cache_stats.host_bytes_written += ret;
+	}
+
+	uint32_t done = 0;
+	while (done < sector_size) {
+		const uint32_t pos = bytenum + done;
+		CacheBlock *block = GetCacheBlock(pos / cache_block_size);
+		if (!block)
+			return 0xff;
+		const uint32_t offset = pos % cache_block_size;
+		const uint32_t bytes = std::min(sector_size - done, cache_block_size - offset);
+		memcpy(&block->data[offset], data + done, bytes);
+
+		if (block->dirty_end <= block->dirty_start) {
+			block->dirty_start = offset;
+			block->dirty_end = offset + bytes;
+		} else {
+			block->dirty_start = std::min(block->dirty_start, offset);
+			block->dirty_end = std::max(block->dirty_end, offset + bytes);
+		}
+		// Writing past the end grows the image, as fwrite would
+		block->valid_bytes = std::max(block->valid_bytes, offset + bytes);
+		done += bytes;
+	}
+	return 0x00;
+}
+
+void imageDisk::Flush()
+{
+	for (auto &block : cache)
+		FlushCacheBlock(block);
+	if (diskimg)
+		fflush(diskimg);
+}
+
+void imageDisk::ReleaseMapping()
+{
+#if defined(HAVE_MMAP)
+	if (mapped_image)
+		munmap(const_cast<uint8_t *>(mapped_image), mapped_size);
+#endif
+	mapped_image = nullptr;
+	mapped_size = 0;
+}
+
+void imageDisk::SetCache(uint32_t size_kb, bool use_mmap)
+{
+	Flush();
+	ReleaseMapping();
+	cache.clear();
+	cache_map.clear();
+	last_action = NONE;
+	// the mapping or cache may have moved the file position, so make the
+	// next uncached access seek
+	current_fpos = UINT32_MAX;
+	last_miss = UINT32_MAX;
+	readahead = 1;
+
+	if (size_kb == 0 || !diskimg)
+		return;
+
+#if defined(HAVE_MMAP)
+	// Images that were opened read-only can't change under us, so they
+	// can be read straight from a mapping of the file
+	const int fd = fileno(diskimg);
+	if ((fcntl(fd, F_GETFL) & O_ACCMODE) == O_RDONLY) {
+		read_only = true;
+		struct stat st;
+		if (use_mmap && fstat(fd, &st) == 0 && st.st_size > 0) {
+			const auto size = static_cast<size_t>(st.st_size);
+			void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+			if (map != MAP_FAILED) {
+				mapped_image = static_cast<const uint8_t *>(map);
+				mapped_size = size;
+				return;
+			}
+		}
+	}
+#else
+	(void)use_mmap;
+#endif
+
+	const uint32_t num_blocks = std::max(size_kb * 1024 / cache_block_size,
+	                                     2 * readahead_max);
+	cache.resize(num_blocks);
+	for (auto &block : cache)
+		block.data.resize(cache_block_size);
+	cache_map.reserve(num_blocks);
+}
+
+imageDisk::~imageDisk()
+{
+	Flush();
+	ReleaseMapping();
+
+	[[maybe_unused]] const auto accesses = cache_stats.hits + cache_stats.misses;
+	if (accesses) {
+		DEBUG_LOG_MSG("BIOSDISK: Cache for '%s': %.1f%% hits, %" PRIu64
+		              " KiB read and %" PRIu64 " KiB written",
+		              diskname, 100.0 * cache_stats.hits / accesses,
+		              cache_stats.host_bytes_read / 1024,
+		              cache_stats.host_bytes_written / 1024);
+	}
+
+	if (diskimg != nullptr)
+		fclose(diskimg);
+}
+
 imageDisk::imageDisk(FILE *img_file, const char *img_name, uint32_t img_size_k, bool is_hdd)
         : hardDrive(is_hdd),
           active(false),
@@ -250,6 +500,12 @@ imageDisk::imageDisk(FILE *img_file, const char *img_name, uint32_t img_size_k,
 			incrementFDD();
 		}
 	}
+
+	const auto section = control ? static_cast<Section_prop *>(control->GetSection("dos"))
+	                             : nullptr;
+	if (section)
+		SetCache(check_cast<uint32_t>(section->Get_int("disk_cache")),
+		         section->Get_bool("disk_mmap"));
 }
 
 void imageDisk::Set_Geometry(uint32_t setHeads, uint32_t setCyl, uint32_t setSect, uint32_t setSectSize) {
@@ -21,6 +21,7 @@
 #include <SDL.h>
 
 #include "callback.h"
+#include "cpu.h"
 #include "mem.h"
 #include "keyboard.h"
 #include "regs.h"
@@ -477,6 +478,7 @@ static Bitu INT16_Handler(void) {
 		} else {
 			/* enter small idle loop to allow for irqs to happen */
 			reg_ip+=1;
+			CPU_Idle();
 		}
 		break;
 	case 0x10: /* GET KEYSTROKE (enhanced keyboards only) */
@@ -489,6 +491,7 @@ static Bitu INT16_Handler(void) {
 		} else {
 			/* enter small idle loop to allow for irqs to happen */
 			reg_ip+=1;
+			CPU_Idle();
 		}
 		break;
 	case 0x01: /* CHECK FOR KEYSTROKE */
@@ -505,6 +508,7 @@ static Bitu INT16_Handler(void) {
 				}
 			} else {
 				/* no key available, return key at buffer head anyway */
+				CPU_IdlePoll();
 				break;
 			}
 //			CALLBACK_Idle();
@@ -519,6 +523,8 @@ static Bitu INT16_Handler(void) {
 				/* special enhanced key, clear low part before returning key */
 				temp&=0xff00;
 			}
+		} else {
+			CPU_IdlePoll();
 		}
 		reg_ax=temp;
 		break;
@@ -18,6 +18,8 @@
 
 #include "zmbv.h"
 
+#include <algorithm>
+#include <bitset>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
@@ -25,8 +27,10 @@
 #include <cstring>
 
 #include "mem_unaligned.h"
+#include "simd.h"
 #include "support.h"
 #include "checks.h"
+#include "worker_pool.h"
 
 CHECK_NARROWING();
 
@@ -43,9 +47,233 @@ constexpr uint8_t COMPRESSION_ZLIB     = 1;
 constexpr int ZLIB_COMPRESSION_LEVEL   = 6;          // 0 to 9 (0 = no compression)
 constexpr auto ZLIB_COMPRESSION_METHOD = Z_DEFLATED; // currently the only option
 constexpr int ZLIB_MEM_LEVEL           = 9;          // 1 to 9 (default 8)
+constexpr int ZLIB_WINDOW_BITS         = 9;          // 9 to 15 (default 15)
 constexpr auto ZLIB_STRATEGY           = Z_FILTERED; // Z_DEFAULT_STRATEGY, Z_FILTERED,
                                                      // Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED
 
+// Row kernels
+// ~~~~~~~~~~~
+// The motion search and XOR stages work on blocks of 16x16 pixels. Rows of
+// blocks that are a full 16 pixels wide are handed to the kernels below,
+// which compare or XOR all 16 pixels at once. The partial blocks along the
+// right edge of the frame still go through the scalar loops.
+//
+// The diff kernels return a 16-bit mask with one bit set per pixel that
+// differs; like the scalar loops, 32-bit pixels only compare their low 24
+// bits.
+constexpr int SIMD_BLOCK_WIDTH = 16;
+
+static int count_bits(const uint32_t mask)
+{
+	return static_cast<int>(std::bitset<32>(mask).count());
+}
+
+#if defined(HAS_SSE2)
+static uint32_t row_diff_8_sse2(const uint8_t *pold, const uint8_t *pnew)
+{
+	const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pold));
+	const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pnew));
+	const auto same = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+	return ~static_cast<uint32_t>(same) & 0xffff;
+}
+
+static uint32_t row_diff_16_sse2(const uint8_t *pold, const uint8_t *pnew)
+{
+	const auto a = reinterpret_cast<const __m128i *>(pold);
+	const auto b = reinterpret_cast<const __m128i *>(pnew);
+	const auto eq0 = _mm_cmpeq_epi16(_mm_loadu_si128(a), _mm_loadu_si128(b));
+	const auto eq1 = _mm_cmpeq_epi16(_mm_loadu_si128(a + 1),
+	                                 _mm_loadu_si128(b + 1));
+	const auto same = _mm_movemask_epi8(_mm_packs_epi16(eq0, eq1));
+	return ~static_cast<uint32_t>(same) & 0xffff;
+}
+
+static uint32_t row_diff_32_sse2(const uint8_t *pold, const uint8_t *pnew)
+{
+	const auto a = reinterpret_cast<const __m128i *>(pold);
+	const auto b = reinterpret_cast<const __m128i *>(pnew);
+	const auto rgb_mask = _mm_set1_epi32(0x00ffffff);
+	__m128i eq[4];
+	for (auto i = 0; i < 4; ++i)
+		eq[i] = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128(a + i), rgb_mask),
+		                        _mm_and_si128(_mm_loadu_si128(b + i), rgb_mask));
+	const auto packed = _mm_packs_epi16(_mm_packs_epi32(eq[0], eq[1]),
+	                                    _mm_packs_epi32(eq[2], eq[3]));
+	const auto same = _mm_movemask_epi8(packed);
+	return ~static_cast<uint32_t>(same) & 0xffff;
+}
+
+template <int row_bytes>
+static void row_xor_sse2(const uint8_t *pold, const uint8_t *pnew, uint8_t *dest)
+{
+	const auto a = reinterpret_cast<const __m128i *>(pold);
+	const auto b = reinterpret_cast<const __m128i *>(pnew);
+	auto d = reinterpret_cast<__m128i *>(dest);
+	for (auto i = 0; i < row_bytes / 16; ++i)
+		_mm_storeu_si128(d + i, _mm_xor_si128(_mm_loadu_si128(a + i),
+		                                      _mm_loadu_si128(b + i)));
+}
+#endif
+
+#if defined(HAS_AVX2)
+static SIMD_TARGET_AVX2 uint32_t row_diff_16_avx2(const uint8_t *pold,
+                                                  const uint8_t *pnew)
+{
+	const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pold));
+	const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pnew));
+	const auto eq = _mm256_cmpeq_epi16(a, b);
+	const auto packed = _mm_packs_epi16(_mm256_castsi256_si128(eq),
+	                                    _mm256_extracti128_si256(eq, 1));
+	const auto same = _mm_movemask_epi8(packed);
+	return ~static_cast<uint32_t>(same) & 0xffff;
+}
+
+static SIMD_TARGET_AVX2 uint32_t row_diff_32_avx2(const uint8_t *pold,
+                                                  const uint8_t *pnew)
+{
+	const auto a = reinterpret_cast<const __m256i *>(pold);
+	const auto b = reinterpret_cast<const __m256i *>(pnew);
+	const auto rgb_mask = _mm256_set1_epi32(0x00ffffff);
+	const auto eq0 = _mm256_cmpeq_epi32(
+	        _mm256_and_si256(_mm256_loadu_si256(a), rgb_mask),
+	        _mm256_and_si256(_mm256_loadu_si256(b), rgb_mask));
+	const auto eq1 = _mm256_cmpeq_epi32(
+	        _mm256_and_si256(_mm256_loadu_si256(a + 1), rgb_mask),
+	        _mm256_and_si256(_mm256_loadu_si256(b + 1), rgb_mask));
+	const auto same_lo = _mm256_movemask_ps(_mm256_castsi256_ps(eq0));
+	const auto same_hi = _mm256_movemask_ps(_mm256_castsi256_ps(eq1));
+	const auto same = static_cast<uint32_t>(same_lo | (same_hi << 8));
+	return ~same & 0xffff;
+}
+
+template <int row_bytes>
+static SIMD_TARGET_AVX2 void row_xor_avx2(const uint8_t *pold,
+                                          const uint8_t *pnew,
+                                          uint8_t *dest)
+{
+	const auto a = reinterpret_cast<const __m256i *>(pold);
+	const auto b = reinterpret_cast<const __m256i *>(pnew);
+	auto d = reinterpret_cast<__m256i *>(dest);
+	for (auto i = 0; i < row_bytes / 32; ++i)
+		_mm256_storeu_si256(d + i,
+		                    _mm256_xor_si256(_mm256_loadu_si256(a + i),
+		                                     _mm256_loadu_si256(b + i)));
+}
+#endif
+
+#if defined(HAS_NEON) && !defined(WORDS_BIGENDIAN)
+// NEON has no movemask, so weigh each lane by its bit and add them up
+static uint32_t movemask_neon(const uint8x16_t eq)
+{
+	static const uint8_t bit_weights[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+	                                        1, 2, 4, 8, 16, 32, 64, 128};
+	const auto bits = vandq_u8(eq, vld1q_u8(bit_weights));
+	const uint32_t lo = vaddv_u8(vget_low_u8(bits));
+	const uint32_t hi = vaddv_u8(vget_high_u8(bits));
+	return lo | (hi << 8);
+}
+
+static uint32_t row_diff_8_neon(const uint8_t *pold, const uint8_t *pnew)
+{
+	const auto eq = vceqq_u8(vld1q_u8(pold), vld1q_u8(pnew));
+	return ~movemask_neon(eq) & 0xffff;
+}
+
+static uint32_t row_diff_16_neon(const uint8_t *pold, const uint8_t *pnew)
+{
+	const auto eq0 = vceqq_u16(vreinterpretq_u16_u8(vld1q_u8(pold)),
+	                           vreinterpretq_u16_u8(vld1q_u8(pnew)));
+	const auto eq1 = vceqq_u16(vreinterpretq_u16_u8(vld1q_u8(pold + 16)),
+	                           vreinterpretq_u16_u8(vld1q_u8(pnew + 16)));
+	const auto eq = vcombine_u8(vmovn_u16(eq0), vmovn_u16(eq1));
+	return ~movemask_neon(eq) & 0xffff;
+}
+
+static uint32_t row_diff_32_neon(const uint8_t *pold, const uint8_t *pnew)
+{
+	const auto rgb_mask = vdupq_n_u32(0x00ffffff);
+	uint32x4_t eq[4];
+	for (auto i = 0; i < 4; ++i)
+		eq[i] = vceqq_u32(vandq_u32(vreinterpretq_u32_u8(vld1q_u8(pold + i * 16)), rgb_mask),
+		                  vandq_u32(vreinterpretq_u32_u8(vld1q_u8(pnew + i * 16)), rgb_mask));
+	const auto eq_lo = vcombine_u16(vmovn_u32(eq[0]), vmovn_u32(eq[1]));
+	const auto eq_hi = vcombine_u16(vmovn_u32(eq[2]), vmovn_u32(eq[3]));
+	const auto eq8 = vcombine_u8(vmovn_u16(eq_lo), vmovn_u16(eq_hi));
+	return ~movemask_neon(eq8) & 0xffff;
+}
+
+template <int row_bytes>
+static void row_xor_neon(const uint8_t *pold, const uint8_t *pnew, uint8_t *dest)
+{
+	for (auto i = 0; i < row_bytes; i += 16)
+		vst1q_u8(dest + i, veorq_u8(vld1q_u8(pold + i), vld1q_u8(pnew + i)));
+}
+#endif
+
+void VideoCodec::SelectKernels()
+{
+	row_diff = nullptr;
+	row_xor  = nullptr;
+	if (!simd_enabled)
+		return;
+
+#if defined(HAS_AVX2)
+	if (host_has_avx2()) {
+		switch (pixelsize) {
+		case 1:
+			row_diff = row_diff_8_sse2;
+			row_xor  = row_xor_sse2<SIMD_BLOCK_WIDTH>;
+			return;
+		case 2:
+			row_diff = row_diff_16_avx2;
+			row_xor  = row_xor_avx2<SIMD_BLOCK_WIDTH * 2>;
+			return;
+		case 4:
+			row_diff = row_diff_32_avx2;
+			row_xor  = row_xor_avx2<SIMD_BLOCK_WIDTH * 4>;
+			return;
+		}
+	}
+#endif
+#if defined(HAS_SSE2)
+	switch (pixelsize) {
+	case 1:
+		row_diff = row_diff_8_sse2;
+		row_xor  = row_xor_sse2<SIMD_BLOCK_WIDTH>;
+		break;
+	case 2:
+		row_diff = row_diff_16_sse2;
+		row_xor  = row_xor_sse2<SIMD_BLOCK_WIDTH * 2>;
+		break;
+	case 4:
+		row_diff = row_diff_32_sse2;
+		row_xor  = row_xor_sse2<SIMD_BLOCK_WIDTH * 4>;
+		break;
+	}
+#elif defined(HAS_NEON) && !defined(WORDS_BIGENDIAN)
+	switch (pixelsize) {
+	case 1:
+		row_diff = row_diff_8_neon;
+		row_xor  = row_xor_neon<SIMD_BLOCK_WIDTH>;
+		break;
+	case 2:
+		row_diff = row_diff_16_neon;
+		row_xor  = row_xor_neon<SIMD_BLOCK_WIDTH * 2>;
+		break;
+	case 4:
+		row_diff = row_diff_32_neon;
+		row_xor  = row_xor_neon<SIMD_BLOCK_WIDTH * 4>;
+		break;
+	}
+#endif
+}
+
+void VideoCodec::EnableSimd(const bool enable)
+{
+	simd_enabled = enable;
+	SelectKernels();
+}
+
 ZMBV_FORMAT BPPFormat(const int bpp)
 {
 	switch (bpp) {
@@ -86,6 +314,7 @@ bool VideoCodec::SetupBuffers(const ZMBV_FORMAT _format, const int blockwidth, c
 	case ZMBV_FORMAT::BPP_32: pixelsize = 4; break;
 	default: return false;
 	};
+	SelectKernels();
 	bufsize = static_cast<uint32_t>((height + 2 * MAX_VECTOR) * pitch * pixelsize + 2048);
 
 	assert(bufsize > 0);
@@ -129,6 +358,8 @@ bool VideoCodec::SetupBuffers(const ZMBV_FORMAT _format, const int blockwidth, c
 		}
 	}
 
+	SetupBands(blockwidth, blockheight);
+
 	oldframe = buf1.data();
 	newframe = buf2.data();
 	format   = _format;
@@ -159,11 +390,24 @@ int VideoCodec::PossibleBlock(const int vx, const int vy, const FrameBlock & blo
 	int ret = 0;
 	P *pold = reinterpret_cast<P *>(oldframe) + block.start + (vy * pitch) + vx;
 	P *pnew = reinterpret_cast<P *>(newframe) + block.start;
-	;
+
+	if (row_diff && block.dx == SIMD_BLOCK_WIDTH) {
+		// only sample every fourth pixel, as the scalar loop does
+		constexpr uint32_t sample_mask = 0x1111;
+		for (auto y = 0; y < block.dy; y += 4) {
+			const auto diff = row_diff(reinterpret_cast<uint8_t *>(pold),
+			                           reinterpret_cast<uint8_t *>(pnew));
+			ret += count_bits(diff & sample_mask);
+			pold += pitch * 4;
+			pnew += pitch * 4;
+		}
+		return ret;
+	}
 	for (auto y = 0; y < block.dy; y += 4) {
 		for (auto x = 0; x < block.dx; x += 4) {
-			const auto test = 0 - ((pold[x] - pnew[x]) & 0x00ffffff);
-			ret -= check_cast<int>(test >> 31);
+			// only the low 24 bits of 32-bit pixels are compared
+			if ((pold[x] ^ pnew[x]) & 0x00ffffff)
+				++ret;
 		}
 		pold += pitch * 4;
 		pnew += pitch * 4;
@@ -177,11 +421,21 @@ int VideoCodec::CompareBlock(const int vx, const int vy, const FrameBlock & bloc
 	int ret = 0;
 	P *pold = reinterpret_cast<P *>(oldframe) + block.start + (vy * pitch) + vx;
 	P *pnew = reinterpret_cast<P *>(newframe) + block.start;
-	;
+
+	if (row_diff && block.dx == SIMD_BLOCK_WIDTH) {
+		for (auto y = 0; y < block.dy; y++) {
+			ret += count_bits(row_diff(reinterpret_cast<uint8_t *>(pold),
+			                           reinterpret_cast<uint8_t *>(pnew)));
+			pold += pitch;
+			pnew += pitch;
+		}
+		return ret;
+	}
 	for (auto y = 0; y < block.dy; y++) {
 		for (auto x = 0; x < block.dx; x++) {
-			const auto test = 0 - ((pold[x] - pnew[x]) & 0x00ffffff);
-			ret -= check_cast<int>(test >> 31);
+			// only the low 24 bits of 32-bit pixels are compared
+			if ((pold[x] ^ pnew[x]) & 0x00ffffff)
+				++ret;
 		}
 		pold += pitch;
 		pnew += pitch;
@@ -190,18 +444,31 @@ int VideoCodec::CompareBlock(const int vx, const int vy, const FrameBlock & bloc
 }
 
 template <class P>
-void VideoCodec::AddXorBlock(const int vx, const int vy, const FrameBlock & block)
+size_t VideoCodec::AddXorBlock(const int vx, const int vy, const FrameBlock & block, uint8_t *dest)
 {
 	P *pold = reinterpret_cast<P *>(oldframe) + block.start + (vy * pitch) + vx;
 	P *pnew = reinterpret_cast<P *>(newframe) + block.start;
+	auto out = dest;
+
+	if (row_xor && block.dx == SIMD_BLOCK_WIDTH) {
+		for (auto y = 0; y < block.dy; ++y) {
+			row_xor(reinterpret_cast<uint8_t *>(pold),
+			        reinterpret_cast<uint8_t *>(pnew), out);
+			out += SIMD_BLOCK_WIDTH * sizeof(P);
+			pold += pitch;
+			pnew += pitch;
+		}
+		return static_cast<size_t>(out - dest);
+	}
 	for (auto y = 0; y < block.dy; ++y) {
 		for (auto x = 0; x < block.dx; ++x) {
-			*reinterpret_cast<P *>(&work[workUsed]) = pnew[x] ^ pold[x];
-			workUsed += sizeof(P);
+			*reinterpret_cast<P *>(out) = pnew[x] ^ pold[x];
+			out += sizeof(P);
 		}
 		pold += pitch;
 		pnew += pitch;
 	}
+	return static_cast<size_t>(out - dest);
 }
 
 // align offset to the next 4-byte boundary
@@ -209,15 +476,16 @@ void VideoCodec::AlignWork(size_t & offset) {
 	offset = (offset + blocks.size() * 2u + 3u) & ~3u;
 }
 
+// Finds the best motion vector for each block in [first, end) and writes the
+// XOR data of the blocks that still differ to dest. Only reads the frames, so
+// separate ranges can be processed concurrently.
 template <class P>
-void VideoCodec::AddXorFrame()
+size_t VideoCodec::AddXorBlocks(const size_t first, const size_t end,
+                                uint8_t *vectors, uint8_t *dest)
 {
-	auto vectors = &work[workUsed];
-
-	AlignWork(workUsed);
-
-	size_t b = 0;
-	for (const auto & block : blocks) {
+	size_t used = 0;
+	for (auto b = first; b < end; ++b) {
+		const auto &block = blocks[b];
 
 		int8_t bestvx   = 0;
 		int8_t bestvy   = 0;
@@ -245,21 +513,91 @@ void VideoCodec::AddXorFrame()
 		vectors[b * 2 + 1] = static_cast<uint8_t>(left_shift_signed(bestvy, 1));
 		if (bestchange) {
 			vectors[b * 2 + 0] |= 1;
-			AddXorBlock<P>(bestvx, bestvy, block);
+			used += AddXorBlock<P>(bestvx, bestvy, block, dest + used);
 		}
-		++b;
+	}
+	return used;
+}
+
+template <class P>
+void VideoCodec::AddXorFrame()
+{
+	auto vectors = &work[workUsed];
+
+	AlignWork(workUsed);
+
+	if (!workers) {
+		workUsed += AddXorBlocks<P>(0, blocks.size(), vectors, &work[workUsed]);
+		return;
+	}
+
+	// Search each band on its own thread, then join their XOR data in
+	// block order
+	workers->Run(static_cast<int>(bands.size()), [&](const int i) {
+		auto &band = bands[static_cast<size_t>(i)];
+		band.xor_used = AddXorBlocks<P>(band.first_block, band.end_block,
+		                                vectors, band.xor_data.data());
+	});
+	for (const auto &band : bands) {
+		memcpy(&work[workUsed], band.xor_data.data(), band.xor_used);
+		workUsed += band.xor_used;
 	}
 }
 
+// Splits the blocks into bands of whole block rows for the parallel search
+void VideoCodec::SetupBands(const int blockwidth, const int blockheight)
+{
+	bands.clear();
+	if (!workers)
+		return;
+
+	const auto xblocks = static_cast<size_t>((width + blockwidth - 1) / blockwidth);
+	const auto yblocks = static_cast<size_t>((height + blockheight - 1) / blockheight);
+
+	// A few bands per thread keeps them all busy when some bands have
+	// less motion to search than others
+	const auto num_bands = std::min(yblocks,
+	                                static_cast<size_t>(workers->NumThreads()) * 4);
+	bands.resize(num_bands);
+
+	const auto max_band_bytes = static_cast<size_t>(blockwidth * blockheight * pixelsize) *
+	                            xblocks * (yblocks / num_bands + 1);
+	for (size_t i = 0; i < num_bands; ++i) {
+		auto &band = bands[i];
+		band.first_block = (yblocks * i / num_bands) * xblocks;
+		band.end_block = (yblocks * (i + 1) / num_bands) * xblocks;
+		band.xor_data.resize(max_band_bytes);
+	}
+}
+
+void VideoCodec::SetThreads(const int threads)
+{
+	num_threads = std::max(threads, 1);
+}
+
 bool VideoCodec::SetupCompress(const int _width, const int _height)
 {
 	width  = _width;
 	height = _height;
 	pitch  = _width + 2 * MAX_VECTOR;
 	format = ZMBV_FORMAT::NONE;
-	if (deflateInit2(&zstream, ZLIB_COMPRESSION_LEVEL, ZLIB_COMPRESSION_METHOD, ZLIB_MEM_LEVEL, ZLIB_MEM_LEVEL, ZLIB_STRATEGY) !=
+	if (deflateInit2(&zstream, ZLIB_COMPRESSION_LEVEL, ZLIB_COMPRESSION_METHOD, ZLIB_WINDOW_BITS, ZLIB_MEM_LEVEL, ZLIB_STRATEGY) !=
 	    Z_OK)
 		return false;
+
+	if (num_threads > 1) {
+		workers = std::make_unique<WorkerPool>(num_threads);
+		chunks.clear();
+		for (auto i = 0; i < num_threads; ++i) {
+			auto chunk = std::make_unique<Chunk>();
+			// Raw deflate, the chunks are stitched into the zlib stream
+			if (deflateInit2(&chunk->zstream, ZLIB_COMPRESSION_LEVEL,
+			                 ZLIB_COMPRESSION_METHOD, -ZLIB_WINDOW_BITS,
+			                 ZLIB_MEM_LEVEL, ZLIB_STRATEGY) != Z_OK)
+				return false;
+			chunks.emplace_back(std::move(chunk));
+		}
+	}
 	return true;
 }
 
@@ -386,6 +724,9 @@ int VideoCodec::FinishCompressFrame()
 		default: break;
 		}
 	}
+	if (workers)
+		return DeflateChunks(firstByte & Mask_KeyFrame);
+
 	/* Create the actual frame with compression */
 	zstream.next_in  = work.data();
 	zstream.avail_in = check_cast<uint32_t>(workUsed);
@@ -399,10 +740,95 @@ int VideoCodec::FinishCompressFrame()
 	return bytes_processed;
 }
 
+// Compresses the work buffer in chunks on the worker threads. Each chunk is
+// primed with the data that precedes it and ends with a sync flush, so their
+// concatenation is the same kind of continuous stream that the serial path
+// produces and stock decoders can inflate it unchanged (the same technique
+// that pigz uses).
+int VideoCodec::DeflateChunks(const bool is_keyframe)
+{
+	constexpr size_t window_size = 1 << ZLIB_WINDOW_BITS;
+	constexpr size_t min_chunk_size = 64 * 1024;
+
+	auto out = compress.writeBuf + compress.writeDone;
+	const auto out_end = compress.writeBuf + compress.writeSize;
+
+	if (is_keyframe) {
+		// The zlib stream header (RFC 1950) as deflate would write it
+		constexpr uint32_t cmf = ZLIB_COMPRESSION_METHOD | ((ZLIB_WINDOW_BITS - 8) << 4);
+		constexpr uint32_t level_flags = 2; // levels 6 and up
+		auto header = (cmf << 8) | (level_flags << 6);
+		header += 31 - (header % 31);
+		*out++ = static_cast<uint8_t>(header >> 8);
+		*out++ = static_cast<uint8_t>(header & 0xff);
+		history.clear();
+	}
+
+	const auto num_chunks = std::clamp(workUsed / min_chunk_size,
+	                                   static_cast<size_t>(1), chunks.size());
+	const auto chunk_size = (workUsed + num_chunks - 1) / num_chunks;
+
+	workers->Run(static_cast<int>(num_chunks), [&](const int i) {
+		auto &chunk = *chunks[static_cast<size_t>(i)];
+		const auto start = std::min(static_cast<size_t>(i) * chunk_size, workUsed);
+		const auto end = std::min(start + chunk_size, workUsed);
+
+		// Prime the window with the input that came before this chunk
+		auto &dict = chunk.dictionary;
+		dict.clear();
+		if (start < window_size) {
+			const auto from_history = std::min(window_size - start, history.size());
+			dict.insert(dict.end(), history.end() - static_cast<ptrdiff_t>(from_history),
+			            history.end());
+		}
+		const auto from_work = std::min(start, window_size);
+		dict.insert(dict.end(), work.begin() + static_cast<ptrdiff_t>(start - from_work),
+		            work.begin() + static_cast<ptrdiff_t>(start));
+
+		auto &zs = chunk.zstream;
+		deflateReset(&zs);
+		if (!dict.empty())
+			deflateSetDictionary(&zs, dict.data(), static_cast<uInt>(dict.size()));
+
+		chunk.output.resize(deflateBound(&zs, static_cast<uLong>(end - start)) + 64);
+		zs.next_in   = work.data() + start;
+		zs.avail_in  = static_cast<uInt>(end - start);
+		zs.next_out  = chunk.output.data();
+		zs.avail_out = static_cast<uInt>(chunk.output.size());
+		deflate(&zs, Z_SYNC_FLUSH);
+		chunk.output_used = chunk.output.size() - zs.avail_out;
+	});
+
+	for (size_t i = 0; i < num_chunks; ++i) {
+		const auto &chunk = *chunks[i];
+		if (chunk.output_used > static_cast<size_t>(out_end - out))
+			return -1;
+		memcpy(out, chunk.output.data(), chunk.output_used);
+		out += chunk.output_used;
+	}
+
+	// Keep the tail of this frame's input for the next frame's dictionary
+	if (workUsed >= window_size) {
+		history.assign(work.begin() + static_cast<ptrdiff_t>(workUsed - window_size),
+		               work.begin() + static_cast<ptrdiff_t>(workUsed));
+	} else {
+		history.insert(history.end(), work.begin(),
+		               work.begin() + static_cast<ptrdiff_t>(workUsed));
+		if (history.size() > window_size)
+			history.erase(history.begin(),
+			              history.end() - static_cast<ptrdiff_t>(window_size));
+	}
+	return static_cast<int>(out - compress.writeBuf);
+}
+
 void VideoCodec::FinishVideo()
 {
 	// end the deflation stream
 	deflateEnd(&zstream);
+	for (auto &chunk : chunks)
+		deflateEnd(&chunk->zstream);
+	chunks.clear();
+	workers.reset();
 }
 
 template <class P>
@@ -596,3 +1022,5 @@ VideoCodec::VideoCodec()
 	CreateVectorTable();
 	memset(&zstream, 0, sizeof(zstream));
 }
+
+VideoCodec::~VideoCodec() = default;
@@ -20,6 +20,7 @@
 #define DOSBOX_ZMBV_H
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 #include <zlib.h>
@@ -40,6 +41,8 @@ enum class ZMBV_FORMAT : uint8_t {
 
 void Msg(const char fmt[], ...);
 
+class WorkerPool;
+
 class VideoCodec {
 private:
 	struct FrameBlock {
@@ -96,9 +99,39 @@ private:
 	Compress compress = {};
 	z_stream zstream = {};
 
+	// SIMD kernels for whole 16-pixel block rows, selected for the host
+	// CPU and pixel size; nullptr when only the scalar loops can be used
+	using row_diff_f = uint32_t (*)(const uint8_t *pold, const uint8_t *pnew);
+	using row_xor_f = void (*)(const uint8_t *pold, const uint8_t *pnew, uint8_t *dest);
+	row_diff_f row_diff = nullptr;
+	row_xor_f row_xor = nullptr;
+	bool simd_enabled = true;
+
+	// Parallel encoding: the motion search runs on bands of block rows
+	// and the deflate input is split into chunks that are compressed as
+	// consecutive pieces of the one deflate stream decoders expect.
+	struct Band {
+		size_t first_block = 0;
+		size_t end_block = 0;
+		std::vector<uint8_t> xor_data = {};
+		size_t xor_used = 0;
+	};
+	struct Chunk {
+		z_stream zstream = {};
+		std::vector<uint8_t> dictionary = {};
+		std::vector<uint8_t> output = {};
+		size_t output_used = 0;
+	};
+	int num_threads = 1;
+	std::unique_ptr<WorkerPool> workers;
+	std::vector<Band> bands = {};
+	std::vector<std::unique_ptr<Chunk>> chunks = {};
+	std::vector<uint8_t> history = {}; // tail of the previous deflate input
+
 	// methods
 	void CreateVectorTable();
 	bool SetupBuffers(ZMBV_FORMAT format, int blockwidth, int blockheight);
+	void SelectKernels();
 
 	template <class P>
 	void AddXorFrame();
@@ -109,16 +142,21 @@ private:
 	template <class P>
 	int CompareBlock(int vx, int vy, const FrameBlock & block);
 	template <class P>
-	void AddXorBlock(int vx, int vy, const FrameBlock & block);
+	size_t AddXorBlock(int vx, int vy, const FrameBlock & block, uint8_t *dest);
+	template <class P>
+	size_t AddXorBlocks(size_t first, size_t end, uint8_t *vectors, uint8_t *dest);
 	template <class P>
 	void UnXorBlock(int vx, int vy, const FrameBlock & block);
 	template <class P>
 	void CopyBlock(int vx, int vy, const FrameBlock & block);
 
 	void AlignWork(size_t & offset);
+	void SetupBands(int blockwidth, int blockheight);
+	int DeflateChunks(bool is_keyframe);
 
 public:
 	VideoCodec();
+	~VideoCodec();
 
 	VideoCodec(const VideoCodec &) = delete;            // prevent copy
 	VideoCodec &operator=(const VideoCodec &) = delete; // prevent assignment
@@ -128,6 +166,13 @@ public:
 	ZMBV_FORMAT BPPFormat(int bpp);
 	int NeededSize(int _width, int _height, ZMBV_FORMAT _format);
 
+	// SIMD kernels are used by default when the host supports them
+	void EnableSimd(bool enable);
+
+	// Spread the compression of each frame over this many threads; must be
+	// called before SetupCompress
+	void SetThreads(int threads);
+
 	void CompressLines(int lineCount, uint8_t *lineData[]);
 	bool PrepareCompressFrame(int flags, ZMBV_FORMAT _format, uint8_t *pal, uint8_t *writeBuf, uint32_t writeSize);
 	int FinishCompressFrame();
@@ -24,6 +24,7 @@
 
 #if C_FLUIDSYNTH
 
+#include <algorithm>
 #include <cassert>
 #include <deque>
 #include <string>
@@ -205,7 +206,8 @@ static std::string find_sf_file(const std::string &name)
 }
 
 MidiHandlerFluidsynth::MidiHandlerFluidsynth()
-        : soft_limiter("FSYNTH"),
+        : audio_ring(num_buffers * FRAMES_PER_BUFFER * 2),
+          soft_limiter("FSYNTH"),
           keep_rendering(false)
 {}
 
@@ -406,10 +408,10 @@ bool MidiHandlerFluidsynth::Open([[maybe_unused]] const char *conf)
 
 	// Start rendering audio
 	keep_rendering = true;
+	audio_ring.Start();
 	const auto render = std::bind(&MidiHandlerFluidsynth::Render, this);
 	renderer = std::thread(render);
 	set_thread_name(renderer, "dosbox:fsynth");
-	play_buffer = playable.Dequeue(); // populate the first play buffer
 
 	// Start playback
 	channel->Enable(true);
@@ -431,16 +433,15 @@ void MidiHandlerFluidsynth::Close()
 	if (channel)
 		channel->Enable(false);
 
-	// Stop rendering and drain the rings
+	// Stop rendering and release the render thread if it's waiting
 	keep_rendering = false;
-	if (!backstock.Size())
-		backstock.Enqueue(std::move(play_buffer));
-	while (playable.Size())
-		play_buffer = playable.Dequeue();
+	audio_ring.Stop();
 
-	// Wait for the rendering thread to finish
+	// Wait for the rendering thread to finish, then drain the queues
 	if (renderer.joinable())
 		renderer.join();
+	audio_ring.Clear();
+	work_queue.Clear();
 
 	soft_limiter.PrintStats();
 
@@ -449,14 +450,57 @@ void MidiHandlerFluidsynth::Close()
 	synth.reset();
 	settings.reset();
 	soft_limiter.Reset();
-	last_played_frame = 0;
 	selected_font = "";
 
 	is_open = false;
 }
 
+// Hands a message over to the render thread, which applies it between
+// rendered buffers. If the queue is full we can't wait for the render thread,
+// as it may itself be waiting for this thread's mixer callback to make room
+// in the audio ring, so the backlog and the message are applied here instead.
+void MidiHandlerFluidsynth::QueueMidiWork(MidiWork &&work)
+{
+	if (work_queue.TryEnqueue(std::move(work)))
+		return;
+
+	const std::lock_guard<std::mutex> lock(work_mutex);
+	ApplyQueuedWork();
+	ApplyMidiWork(work);
+}
+
+// Applies the queued messages in order; the caller holds the work mutex
+void MidiHandlerFluidsynth::ApplyQueuedWork()
+{
+	MidiWork work = {};
+	while (work_queue.TryDequeue(work))
+		ApplyMidiWork(work);
+}
+
 void MidiHandlerFluidsynth::PlayMsg(const uint8_t *msg)
 {
+	MidiWork work = {};
+	std::copy_n(msg, 3, work.message.begin());
+	QueueMidiWork(std::move(work));
+}
+
+void MidiHandlerFluidsynth::PlaySysex(uint8_t *sysex, size_t len)
+{
+	MidiWork work = {};
+	work.sysex.assign(sysex, sysex + len);
+	QueueMidiWork(std::move(work));
+}
+
+void MidiHandlerFluidsynth::ApplyMidiWork(const MidiWork &work)
+{
+	if (!work.sysex.empty()) {
+		const char *data = reinterpret_cast<const char *>(work.sysex.data());
+		const auto n = static_cast<int>(work.sysex.size());
+		fluid_synth_sysex(synth.get(), data, n, nullptr, nullptr, nullptr, false);
+		return;
+	}
+
+	const auto msg = work.message.data();
 	const int chanID = msg[0] & 0b1111;
 
 	switch (msg[0] & 0b1111'0000) {
@@ -482,53 +526,24 @@ void MidiHandlerFluidsynth::PlayMsg(const uint8_t *msg)
 		fluid_synth_pitch_bend(synth.get(), chanID, msg[1] + (msg[2] << 7));
 		break;
 	default: {
-		uint64_t tmp;
+		uint32_t tmp;
 		memcpy(&tmp, msg, sizeof(tmp));
-		LOG_MSG("MIDI: unknown MIDI command: %0" PRIx64, tmp);
+		LOG_MSG("MIDI: unknown MIDI command: %0" PRIx32, tmp);
 		break;
 	}
 	}
 }
 
-void MidiHandlerFluidsynth::PlaySysex(uint8_t *sysex, size_t len)
-{
-	const char *data = reinterpret_cast<const char *>(sysex);
-	const auto n = static_cast<int>(len);
-	fluid_synth_sysex(synth.get(), data, n, nullptr, nullptr, nullptr, false);
-}
-
 void MidiHandlerFluidsynth::MixerCallBack(uint16_t requested_frames)
 {
-	while (requested_frames) {
-		const auto frames_to_be_played = std::min(GetRemainingFrames(),
-		                                          requested_frames);
-		const auto sample_offset_in_buffer = play_buffer.data() +
-		                                     last_played_frame * 2;
-
-		assert(frames_to_be_played <= play_buffer.size());
-		channel->AddSamples_s16(frames_to_be_played, sample_offset_in_buffer);
-
-		requested_frames -= frames_to_be_played;
-		last_played_frame += frames_to_be_played;
-	}
+	// Wait for the render thread if it hasn't caught up yet
+	play_buffer.resize(requested_frames * 2);
+	const auto frames = audio_ring.Read(play_buffer.data(), play_buffer.size()) / 2;
+	if (frames)
+		channel->AddSamples_s16(check_cast<uint16_t>(frames), play_buffer.data());
 }
 
-// Returns the number of frames left to play in the buffer.
-uint16_t MidiHandlerFluidsynth::GetRemainingFrames()
-{
-	// If the current buffer has some frames left, then return those ...
-	if (last_played_frame < FRAMES_PER_BUFFER)
-		return FRAMES_PER_BUFFER - last_played_frame;
-
-	// Otherwise put the spent buffer in backstock and get the next buffer
-	backstock.Enqueue(std::move(play_buffer));
-	play_buffer = playable.Dequeue();
-	last_played_frame = 0; // reset the frame counter to the beginning
-
-	return FRAMES_PER_BUFFER;
-}
-
-// Populates the playable queue with freshly rendered buffers
+// Keeps the audio ring filled with freshly rendered frames
 void MidiHandlerFluidsynth::Render()
 {
 	// Allocate our buffers once and reuse for the duration.
@@ -536,23 +551,22 @@ void MidiHandlerFluidsynth::Render()
 	std::vector<float> render_buffer(SAMPLES_PER_BUFFER);
 	std::vector<int16_t> playable_buffer(SAMPLES_PER_BUFFER);
 
-	// Populate the backstock using copies of the current buffer.
-	while (backstock.Size() < backstock.MaxCapacity() - 1)
-		backstock.Enqueue(playable_buffer);
-	backstock.Enqueue(std::move(playable_buffer));
-	assert(backstock.Size() == backstock.MaxCapacity());
-
 	while (keep_rendering.load()) {
+		// Apply the messages received since the last buffer
+		{
+			const std::lock_guard<std::mutex> lock(work_mutex);
+			ApplyQueuedWork();
+		}
+
 		fluid_synth_write_float(synth.get(), FRAMES_PER_BUFFER,
 		                        render_buffer.data(), 0, 2,
 		                        render_buffer.data(), 1, 2);
 
-		// Grab the next buffer from backstock and populate it ...
-		playable_buffer = backstock.Dequeue();
 		soft_limiter.Process(render_buffer, FRAMES_PER_BUFFER,
 		                     playable_buffer);
-		// and then move it into the playable queue
-		playable.Enqueue(std::move(playable_buffer));
+
+		// Wait for room in the ring, unless we're closing
+		audio_ring.Write(playable_buffer.data(), playable_buffer.size());
 	}
 }
 
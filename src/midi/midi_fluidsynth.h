@@ -29,13 +29,14 @@
 
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <fluidsynth.h>
 #include <thread>
 
 #include "mixer.h"
-#include "rwqueue.h"
 #include "soft_limiter.h"
+#include "spsc_queue.h"
 
 class MidiHandlerFluidsynth final : public MidiHandler {
 public:
@@ -50,9 +51,11 @@ public:
 	MIDI_RC ListAll(Program *caller) override;
 
 private:
+	void ApplyMidiWork(const MidiWork &work);
+	void ApplyQueuedWork();
 	void MixerCallBack(uint16_t requested_frames);
 	void SetMixerLevel(const AudioFrame &levels) noexcept;
-	uint16_t GetRemainingFrames();
+	void QueueMidiWork(MidiWork &&work);
 	void Render();
 
 	using fluid_settings_ptr_t =
@@ -64,15 +67,20 @@ private:
 	mixer_channel_t channel = nullptr;
 	std::string selected_font = "";
 
+	// Rendered audio and MIDI messages are passed between the emulation and
+	// the render thread without locking, unless the work queue fills up
 	std::vector<int16_t> play_buffer = {};
 	static constexpr auto num_buffers = 8;
-	RWQueue<std::vector<int16_t>> playable{num_buffers};
-	RWQueue<std::vector<int16_t>> backstock{num_buffers};
+	SpscQueue<int16_t> audio_ring;
+	SpscQueue<MidiWork> work_queue{1024};
+
+	// Held while taking messages off the work queue, which the emulation
+	// thread also does when the queue is full
+	std::mutex work_mutex = {};
 
 	std::thread renderer = {};
 	SoftLimiter soft_limiter;
 
-	uint16_t last_played_frame = 0; // relative frame-offset in the play buffer
 	std::atomic_bool keep_rendering = {};
 	bool is_open = false;
 };
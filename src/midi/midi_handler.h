@@ -24,7 +24,9 @@
 
 #include "midi.h"
 
+#include <array>
 #include <cstdint>
+#include <vector>
 
 enum class MIDI_RC : int {
 	OK = 0,
@@ -32,6 +34,14 @@ enum class MIDI_RC : int {
 	ERR_DEVICE_LIST_NOT_SUPPORTED = -2,
 };
 
+// A MIDI message or SysEx handed to a synth that renders on its own thread.
+// Channel messages carry no heap allocation; only SysEx data does.
+struct MidiWork {
+	std::array<uint8_t, 4> message = {};
+	std::vector<uint8_t> sysex = {};
+	uint32_t frame = 0; // played frames when the message arrived
+};
+
 class MidiHandler {
 public:
 	MidiHandler();
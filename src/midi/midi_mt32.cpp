@@ -24,7 +24,9 @@
 
 #if C_MT32EMU
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <deque>
 #include <functional>
 #include <map>
@@ -364,7 +366,8 @@ static mt32emu_report_handler_i get_report_handler_interface()
 }
 
 MidiHandler_mt32::MidiHandler_mt32()
-        : soft_limiter("MT32"),
+        : audio_ring(num_buffers * FRAMES_PER_BUFFER * 2),
+          soft_limiter("MT32"),
           keep_rendering(false)
 {}
 
@@ -563,10 +566,10 @@ bool MidiHandler_mt32::Open([[maybe_unused]] const char *conf)
 
 	// Start rendering audio
 	keep_rendering = true;
+	audio_ring.Start();
 	const auto render = std::bind(&MidiHandler_mt32::Render, this);
 	renderer = std::thread(render);
 	set_thread_name(renderer, "dosbox:mt32");
-	play_buffer = playable.Dequeue(); // populate the first play buffer
 
 	// Start playback
 	channel->Enable(true);
@@ -613,16 +616,15 @@ void MidiHandler_mt32::Close()
 	if (channel)
 		channel->Enable(false);
 
-	// Stop rendering and drain the rings
+	// Stop rendering and release the render thread if it's waiting
 	keep_rendering = false;
-	if (!backstock.Size())
-		backstock.Enqueue(std::move(play_buffer));
-	while (playable.Size())
-		play_buffer = playable.Dequeue();
+	audio_ring.Stop();
 
-	// Wait for the rendering thread to finish
+	// Wait for the rendering thread to finish, then drain the queues
 	if (renderer.joinable())
 		renderer.join();
+	audio_ring.Clear();
+	work_queue.Clear();
 
 	// Stop the synthesizer
 	if (service) {
@@ -636,66 +638,77 @@ void MidiHandler_mt32::Close()
 	channel.reset();
 	service.reset();
 	soft_limiter.Reset();
-	total_buffers_played = 0;
-	last_played_frame = 0;
+	total_played_frames = 0;
 
 	is_open = false;
 }
 
-uint32_t MidiHandler_mt32::GetMidiEventTimestamp() const
+// Hands a message over to the render thread, stamped with the number of
+// frames played so far. If the queue is full we can't wait for the render
+// thread, as it may itself be waiting for this thread's mixer callback to
+// make room in the audio ring, so the backlog and the message are played
+// here instead.
+void MidiHandler_mt32::QueueMidiWork(MidiWork &&work)
 {
-	const uint32_t played_frames = total_buffers_played * FRAMES_PER_BUFFER;
-	return service->convertOutputToSynthTimestamp(played_frames +
-	                                              last_played_frame);
-}
+	work.frame = total_played_frames;
+	if (work_queue.TryEnqueue(std::move(work)))
+		return;
 
-void MidiHandler_mt32::PlayMsg(const uint8_t *msg)
-{
-	const auto msg_words = reinterpret_cast<const uint32_t *>(msg);
 	const std::lock_guard<std::mutex> lock(service_mutex);
-	service->playMsgAt(SDL_SwapLE32(*msg_words), GetMidiEventTimestamp());
+	PlayQueuedWork();
+	PlayMidiWork(work);
 }
 
-void MidiHandler_mt32::PlaySysex(uint8_t *sysex, size_t len)
+// Plays the message at the synth time matching its frame stamp; the caller
+// holds the service mutex
+void MidiHandler_mt32::PlayMidiWork(const MidiWork &work)
 {
-	assert(len <= UINT32_MAX);
-	const auto msg_len = static_cast<uint32_t>(len);
-	const std::lock_guard<std::mutex> lock(service_mutex);
-	service->playSysexAt(sysex, msg_len, GetMidiEventTimestamp());
+	const auto timestamp = service->convertOutputToSynthTimestamp(work.frame);
+	if (work.sysex.empty()) {
+		uint32_t msg_word = 0;
+		memcpy(&msg_word, work.message.data(), sizeof(msg_word));
+		service->playMsgAt(SDL_SwapLE32(msg_word), timestamp);
+	} else {
+		const auto msg_len = static_cast<uint32_t>(work.sysex.size());
+		service->playSysexAt(work.sysex.data(), msg_len, timestamp);
+	}
 }
 
-// The callback operates at the frame-level, steadily adding samples to the
-// mixer until the requested numbers of frames is met.
-void MidiHandler_mt32::MixerCallBack(uint16_t requested_frames)
+// Plays the queued messages in order; the caller holds the service mutex
+void MidiHandler_mt32::PlayQueuedWork()
 {
-	while (requested_frames) {
-		const auto frames_to_be_played = std::min(GetRemainingFrames(),
-		                                          requested_frames);
-		const auto sample_offset_in_buffer = play_buffer.data() +
-		                                     last_played_frame * 2;
-		channel->AddSamples_s16(frames_to_be_played, sample_offset_in_buffer);
-		requested_frames -= frames_to_be_played;
-		last_played_frame += frames_to_be_played;
-	}
+	MidiWork work = {};
+	while (work_queue.TryDequeue(work))
+		PlayMidiWork(work);
 }
 
-// Returns the number of frames left to play in the buffer.
-uint16_t MidiHandler_mt32::GetRemainingFrames()
+void MidiHandler_mt32::PlayMsg(const uint8_t *msg)
 {
-	// If the current buffer has some frames left, then return those ...
-	if (last_played_frame < FRAMES_PER_BUFFER)
-		return FRAMES_PER_BUFFER - last_played_frame;
+	MidiWork work = {};
+	std::copy_n(msg, 3, work.message.begin());
+	QueueMidiWork(std::move(work));
+}
 
-	// Otherwise put the spent buffer in backstock and get the next buffer
-	backstock.Enqueue(std::move(play_buffer));
-	play_buffer = playable.Dequeue();
-	total_buffers_played++;
-	last_played_frame = 0; // reset the frame counter to the beginning
+void MidiHandler_mt32::PlaySysex(uint8_t *sysex, size_t len)
+{
+	assert(len <= UINT32_MAX);
+	MidiWork work = {};
+	work.sysex.assign(sysex, sysex + len);
+	QueueMidiWork(std::move(work));
+}
 
-	return FRAMES_PER_BUFFER;
+// The callback takes the requested frames from the ring, waiting for the
+// render thread if it hasn't caught up yet.
+void MidiHandler_mt32::MixerCallBack(uint16_t requested_frames)
+{
+	play_buffer.resize(requested_frames * 2);
+	const auto frames = audio_ring.Read(play_buffer.data(), play_buffer.size()) / 2;
+	if (frames)
+		channel->AddSamples_s16(check_cast<uint16_t>(frames), play_buffer.data());
+	total_played_frames += check_cast<uint32_t>(frames);
 }
 
-// Keep the playable queue populated with freshly rendered buffers
+// Keep the audio ring filled with freshly rendered frames
 void MidiHandler_mt32::Render()
 {
 	// Allocate our buffers once and reuse for the duration.
@@ -703,23 +716,18 @@ void MidiHandler_mt32::Render()
 	std::vector<float> render_buffer(SAMPLES_PER_BUFFER);
 	std::vector<int16_t> playable_buffer(SAMPLES_PER_BUFFER);
 
-	// Populate the backstock using copies of the current buffer.
-	while (backstock.Size() < backstock.MaxCapacity() - 1)
-		backstock.Enqueue(playable_buffer);
-	backstock.Enqueue(std::move(playable_buffer));
-	assert(backstock.Size() == backstock.MaxCapacity());
-
 	while (keep_rendering.load()) {
 		{
 			const std::lock_guard<std::mutex> lock(service_mutex);
+
+			// Play the messages received since the last buffer
+			PlayQueuedWork();
 			service->renderFloat(render_buffer.data(), FRAMES_PER_BUFFER);
 		}
-		// Grab the next buffer from backstock and populate it ...
-		playable_buffer = backstock.Dequeue();
 		soft_limiter.Process(render_buffer, FRAMES_PER_BUFFER, playable_buffer);
 
-		// and then move it into the playable queue
-		playable.Enqueue(std::move(playable_buffer));
+		// Wait for room in the ring, unless we're closing
+		audio_ring.Write(playable_buffer.data(), playable_buffer.size());
 	}
 }
 
@@ -36,8 +36,8 @@
 #include <mt32emu/mt32emu.h>
 
 #include "mixer.h"
-#include "rwqueue.h"
 #include "soft_limiter.h"
+#include "spsc_queue.h"
 
 static_assert(MT32EMU_VERSION_MAJOR > 2 ||
                       (MT32EMU_VERSION_MAJOR == 2 && MT32EMU_VERSION_MINOR >= 5),
@@ -58,31 +58,34 @@ public:
 	void PrintStats();
 
 private:
-	uint32_t GetMidiEventTimestamp() const;
 	service_t GetService();
 	void MixerCallBack(uint16_t len);
 	void SetMixerLevel(const AudioFrame &desired) noexcept;
-	uint16_t GetRemainingFrames();
+	void QueueMidiWork(MidiWork &&work);
+	void PlayMidiWork(const MidiWork &work);
+	void PlayQueuedWork();
 	void Render();
 
 	// Managed objects
 	mixer_channel_t channel = nullptr;
 
+	// Rendered audio and MIDI messages are passed between the emulation and
+	// the render thread without locking, unless the work queue fills up
 	std::vector<int16_t> play_buffer = {};
 	static constexpr auto num_buffers = 4;
-	RWQueue<std::vector<int16_t>> playable{num_buffers};
-	RWQueue<std::vector<int16_t>> backstock{num_buffers};
+	SpscQueue<int16_t> audio_ring;
+	SpscQueue<MidiWork> work_queue{1024};
 
+	// Guards the service, and the work queue's consumer side, which the
+	// emulation thread also drains when the queue is full
 	std::mutex service_mutex = {};
 	service_t service = {};
 	std::thread renderer = {};
 	SoftLimiter soft_limiter;
 
-	// The following two members let us determine the total number of played
-	// frames, which is used by GetMidiEventTimestamp() to calculate a total
-	// time offset.
-	uint32_t total_buffers_played = 0;
-	uint16_t last_played_frame = 0; // relative frame-offset in the play buffer
+	// The total number of played frames, which the render thread converts
+	// into a synth timestamp for each MIDI message.
+	std::atomic<uint32_t> total_played_frames = {0};
 
 	std::atomic_bool keep_rendering = {};
 	bool is_open = false;
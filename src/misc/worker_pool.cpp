@@ -0,0 +1,113 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "worker_pool.h"
+
+#include <cassert>
+
+#include "support.h"
+
+WorkerPool::WorkerPool(const int num_threads)
+{
+	assert(num_threads > 0);
+	for (auto i = 1; i < num_threads; ++i) {
+		workers.emplace_back(&WorkerPool::WorkerLoop, this);
+		set_thread_name(workers.back(), "dosbox:worker");
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		is_stopping = true;
+	}
+	has_work.notify_all();
+	for (auto &worker : workers)
+		worker.join();
+}
+
+// Claims and runs jobs from the current batch until none are left. The job
+// and its count are passed in, as the next Run() may overwrite the members.
+void WorkerPool::RunJobs(const job_f &job, const int jobs)
+{
+	while (true) {
+		const auto i = next_job.fetch_add(1);
+		if (i >= jobs)
+			return;
+		job(i);
+	}
+}
+
+void WorkerPool::WorkerLoop()
+{
+	uint64_t seen_generation = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		has_work.wait(lock, [&] {
+			return is_stopping || generation != seen_generation;
+		});
+		if (is_stopping)
+			return;
+		seen_generation = generation;
+
+		// Woke too late: Run() already finished the batch without us
+		if (!current_job)
+			continue;
+
+		const auto &job = *current_job;
+		const auto jobs = num_jobs;
+		++busy_workers;
+		lock.unlock();
+		RunJobs(job, jobs);
+		lock.lock();
+		if (--busy_workers == 0)
+			work_done.notify_one();
+	}
+}
+
+void WorkerPool::Run(const int jobs, const job_f &job)
+{
+	if (jobs <= 0)
+		return;
+
+	if (workers.empty() || jobs == 1) {
+		for (auto i = 0; i < jobs; ++i)
+			job(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		current_job = &job;
+		num_jobs = jobs;
+		next_job = 0;
+		++generation;
+	}
+	has_work.notify_all();
+
+	RunJobs(job, jobs);
+
+	// Wait for the workers that picked up jobs from this batch
+	std::unique_lock<std::mutex> lock(mutex);
+	work_done.wait(lock, [&] { return busy_workers == 0; });
+	current_job = nullptr;
+	num_jobs = 0;
+}
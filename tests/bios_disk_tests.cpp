@@ -0,0 +1,161 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "bios_disk.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t heads = 16;
+constexpr uint32_t sectors = 63;
+constexpr uint32_t cylinders = 20;
+constexpr uint32_t total_sectors = heads * sectors * cylinders;
+
+// Creates a hard disk image in a temporary file filled with random data
+std::unique_ptr<imageDisk> make_disk(const std::vector<uint8_t> &contents)
+{
+	FILE *file = tmpfile();
+	EXPECT_NE(file, nullptr);
+	fwrite(contents.data(), 1, contents.size(), file);
+	fflush(file);
+	auto disk = std::make_unique<imageDisk>(file, "test.img",
+	                                        check_cast<uint32_t>(contents.size() / 1024),
+	                                        true);
+	disk->Set_Geometry(heads, cylinders, sectors, 512);
+	return disk;
+}
+
+std::vector<uint8_t> random_contents(const size_t bytes)
+{
+	std::mt19937 rng(42);
+	std::vector<uint8_t> contents(bytes);
+	for (auto &byte : contents)
+		byte = static_cast<uint8_t>(rng());
+	return contents;
+}
+
+std::vector<uint8_t> file_contents(imageDisk &disk)
+{
+	disk.Flush();
+	fseek(disk.diskimg, 0, SEEK_END);
+	std::vector<uint8_t> contents(static_cast<size_t>(ftell(disk.diskimg)));
+	fseek(disk.diskimg, 0, SEEK_SET);
+	EXPECT_EQ(fread(contents.data(), 1, contents.size(), disk.diskimg),
+	          contents.size());
+	return contents;
+}
+
+TEST(ImageDiskCache, MatchesUncachedAccess)
+{
+	const auto contents = random_contents(total_sectors * 512);
+	auto uncached = make_disk(contents);
+	auto cached = make_disk(contents);
+	uncached->SetCache(0, false);
+	cached->SetCache(64, false); // small enough to keep evicting
+
+	std::mt19937 rng(1234);
+	uint8_t expected[512];
+	uint8_t actual[512];
+	uint8_t written[512];
+	for (auto i = 0; i < 20000; ++i) {
+		// Mostly short sequential runs, as file systems tend to do
+		const auto sector = (rng() % 8 == 0) ? rng() % total_sectors
+		                                     : (i * 3) % total_sectors;
+		if (rng() % 4 == 0) {
+			for (auto &byte : written)
+				byte = static_cast<uint8_t>(rng());
+			EXPECT_EQ(uncached->Write_AbsoluteSector(sector, written), 0);
+			EXPECT_EQ(cached->Write_AbsoluteSector(sector, written), 0);
+		} else {
+			EXPECT_EQ(uncached->Read_AbsoluteSector(sector, expected), 0);
+			EXPECT_EQ(cached->Read_AbsoluteSector(sector, actual), 0);
+			ASSERT_EQ(memcmp(expected, actual, sizeof(actual)), 0)
+			        << "sector " << sector;
+		}
+	}
+	EXPECT_TRUE(file_contents(*cached) == file_contents(*uncached));
+	EXPECT_GT(cached->GetCacheStats().hits, cached->GetCacheStats().misses);
+}
+
+TEST(ImageDiskCache, WritesPastTheEndGrowTheImage)
+{
+	auto disk = make_disk(std::vector<uint8_t>(4 * 512, 0x11));
+	disk->SetCache(1024, false);
+
+	std::vector<uint8_t> sector(512, 0x22);
+	EXPECT_EQ(disk->Write_AbsoluteSector(6, sector.data()), 0);
+
+	std::vector<uint8_t> expected(7 * 512, 0x11);
+	std::fill(expected.begin() + 4 * 512, expected.end(), 0);
+	std::fill(expected.begin() + 6 * 512, expected.end(), 0x22);
+	EXPECT_TRUE(file_contents(*disk) == expected);
+}
+
+// Replays the sector reads of booting a hard disk image through INT 13h:
+// the partition table and boot sector, scattered FAT and directory
+// sectors, and then files being loaded one sector at a time.
+void replay_boot(imageDisk &disk, const int seed)
+{
+	uint8_t buffer[512];
+	disk.Read_Sector(0, 0, 1, buffer);
+	disk.Read_Sector(1, 0, 1, buffer);
+	std::mt19937 rng(seed);
+	for (auto file = 0; file < 40; ++file) {
+		for (auto i = 0; i < 4; ++i)
+			disk.Read_AbsoluteSector(64 + rng() % 256, buffer);
+		const auto start = 512 + rng() % (total_sectors - 1024);
+		const auto length = 16 + rng() % 512;
+		for (uint32_t s = start; s < start + length && s < total_sectors; ++s)
+			disk.Read_AbsoluteSector(s, buffer);
+	}
+}
+
+TEST(ImageDiskCache, DISABLED_BenchmarkBootSequence)
+{
+	const auto contents = random_contents(total_sectors * 512);
+	constexpr int repeats = 20;
+
+	for (const auto cache_kb : {0, 2048}) {
+		auto disk = make_disk(contents);
+		disk->SetCache(cache_kb, false);
+		const auto start = std::chrono::steady_clock::now();
+		for (auto i = 0; i < repeats; ++i)
+			replay_boot(*disk, i);
+		const std::chrono::duration<double, std::milli> elapsed =
+		        std::chrono::steady_clock::now() - start;
+
+		const auto &stats = disk->GetCacheStats();
+		const auto accesses = stats.hits + stats.misses;
+		printf("Boot replay with %4d KiB cache: %7.2f ms per boot, "
+		       "%5.1f%% hits, %6.0f KiB read from the host per boot\n",
+		       cache_kb, elapsed.count() / repeats,
+		       accesses ? 100.0 * stats.hits / accesses : 0.0,
+		       stats.host_bytes_read / 1024.0 / repeats);
+	}
+}
+
+} // namespace
@@ -0,0 +1,199 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cycle_controller.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+// Samples a window on a host where every cycle costs the same time, and
+// which falls behind real time when the cycles cost more than it has
+CycleSample run_window(const int32_t cycle_max,
+                       const double host_ms_per_cycle,
+                       const int window_ms,
+                       const double removed_share = 0.0)
+{
+	CycleSample sample = {};
+	const auto executed = cycle_max * (1.0 - removed_share);
+	const auto usage = executed * host_ms_per_cycle;
+	if (usage < 1.0) {
+		sample.ticks_scheduled = window_ms;
+		sample.ticks_done = static_cast<int>(std::lround(usage * window_ms));
+		sample.ticks_added = 1;
+	} else {
+		sample.ticks_scheduled = static_cast<int>(std::lround(window_ms / usage));
+		sample.ticks_done = window_ms;
+		sample.ticks_added = 20;
+	}
+	sample.io_delay_removed = static_cast<int64_t>(
+	        cycle_max * removed_share * sample.ticks_scheduled);
+	return sample;
+}
+
+// Cycles at which the simulated host spends the target share emulating
+constexpr double cost = 1.0 / 100000; // 100k cycles fill the host
+constexpr int32_t ideal_cycles = 90000;
+
+int32_t settle(CycleController &controller, int32_t cycles,
+               const double host_ms_per_cycle, const int windows,
+               const double removed_share = 0.0)
+{
+	for (int i = 0; i < windows; ++i)
+		controller.Update(run_window(cycles, host_ms_per_cycle, 100, removed_share),
+		                  cycles);
+	return cycles;
+}
+
+TEST(PidCycleController, WaitsForAFullWindow)
+{
+	PidCycleController pid(90);
+	int32_t cycles = 3000;
+	EXPECT_FALSE(pid.Update(run_window(cycles, cost, 50), cycles));
+	EXPECT_EQ(cycles, 3000);
+	EXPECT_TRUE(pid.Update(run_window(cycles, cost, 100), cycles));
+	EXPECT_GT(cycles, 3000);
+}
+
+TEST(PidCycleController, ConvergesToTheTarget)
+{
+	PidCycleController pid(90);
+	const auto cycles = settle(pid, 3000, cost, 40);
+	EXPECT_NEAR(cycles, ideal_cycles, ideal_cycles * 0.05);
+}
+
+TEST(PidCycleController, StaysSteadyOnceSettled)
+{
+	PidCycleController pid(90);
+	auto cycles = settle(pid, 3000, cost, 40);
+	for (int i = 0; i < 20; ++i) {
+		cycles = settle(pid, cycles, cost, 1);
+		EXPECT_NEAR(cycles, ideal_cycles, ideal_cycles * 0.05);
+	}
+}
+
+TEST(PidCycleController, FollowsHostLoad)
+{
+	PidCycleController pid(90);
+	auto cycles = settle(pid, 3000, cost, 40);
+
+	// Another process takes half the host
+	cycles = settle(pid, cycles, cost * 2, 30);
+	EXPECT_NEAR(cycles, ideal_cycles / 2, ideal_cycles * 0.05);
+
+	cycles = settle(pid, cycles, cost, 30);
+	EXPECT_NEAR(cycles, ideal_cycles, ideal_cycles * 0.05);
+}
+
+TEST(PidCycleController, IgnoresRemovedCycles)
+{
+	// The guest idles half the time, so the host looks half as busy as
+	// it would be running every cycle
+	PidCycleController pid(90);
+	const auto cycles = settle(pid, 3000, cost, 40, 0.5);
+	EXPECT_NEAR(cycles, ideal_cycles, ideal_cycles * 0.05);
+}
+
+TEST(PidCycleController, ScalesTargetWithPercentage)
+{
+	PidCycleController pid(90);
+	int32_t cycles = 3000;
+	for (int i = 0; i < 40; ++i) {
+		auto sample = run_window(cycles, cost, 100);
+		sample.percent_used = 50;
+		pid.Update(sample, cycles);
+	}
+	EXPECT_NEAR(cycles, ideal_cycles / 2, ideal_cycles * 0.05);
+}
+
+TEST(PidCycleController, LimitsEachStep)
+{
+	PidCycleController pid(90);
+	int32_t cycles = 1000;
+	pid.Update(run_window(cycles, cost, 100), cycles);
+	EXPECT_LE(cycles, 2000);
+
+	// Hopelessly behind
+	cycles = 1000000;
+	pid.Update(run_window(cycles, cost, 100), cycles);
+	EXPECT_GE(cycles, 1000000 / 3);
+}
+
+TEST(LegacyCycleController, RaisesCyclesOnAnIdleHost)
+{
+	LegacyCycleController legacy;
+	int32_t cycles = 3000;
+	EXPECT_FALSE(legacy.Update(run_window(cycles, cost, 100), cycles));
+	EXPECT_EQ(cycles, 3000);
+	EXPECT_TRUE(legacy.Update(run_window(cycles, cost, 250), cycles));
+	EXPECT_GT(cycles, 3000);
+}
+
+TEST(LegacyCycleController, CutsCyclesWhenFallingBehind)
+{
+	LegacyCycleController legacy;
+	int32_t cycles = 300000;
+	CycleSample sample = {};
+	sample.ticks_added = 20;
+	sample.ticks_scheduled = 2;
+	sample.ticks_done = 20;
+	EXPECT_FALSE(legacy.Update(sample, cycles));
+	EXPECT_EQ(cycles, 100000);
+}
+
+TEST(CycleControllerFactory, SelectsPolicy)
+{
+	EXPECT_STREQ(CYCLES_CreateController("pid", 90)->GetName(), "pid");
+	EXPECT_STREQ(CYCLES_CreateController("legacy", 90)->GetName(), "legacy");
+}
+
+TEST(CycleTelemetry, WritesCsv)
+{
+	CycleTelemetry telemetry;
+	CycleSample sample = {};
+	sample.ticks_done = 80;
+	sample.ticks_scheduled = 100;
+	sample.ticks_added = 1;
+	sample.io_delay_removed = 12345;
+	telemetry.Record(1000, 3000, sample);
+	telemetry.Record(1100, 3300, sample);
+	ASSERT_EQ(telemetry.GetEntries().size(), 2u);
+
+	const std::string path = "cycle_controller_tests.csv";
+	ASSERT_TRUE(telemetry.WriteCsv(path));
+	std::ifstream file(path);
+	std::stringstream contents;
+	contents << file.rdbuf();
+	file.close();
+	std::remove(path.c_str());
+
+	EXPECT_EQ(contents.str(),
+	          "time_ms,cycle_max,ticks_done,ticks_scheduled,ticks_added,io_delay_removed\n"
+	          "1000,3000,80,100,1,12345\n"
+	          "1100,3300,80,100,1,12345\n");
+}
+
+} // namespace
@@ -0,0 +1,126 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dma.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "mem.h"
+
+namespace {
+
+// Above the first megabyte, so the DMA page isn't remapped by EMS
+constexpr uint8_t dma_page = 0x20;
+constexpr PhysPt dma_base = 0x200000;
+
+// Sets up an auto-initialising transfer of the given number of words
+void setup_channel(DmaChannel &chan, const uint16_t start_word, const uint16_t words)
+{
+	chan.SetPage(dma_page);
+	chan.baseaddr = start_word;
+	chan.curraddr = start_word;
+	chan.basecnt = static_cast<uint16_t>(words - 1);
+	chan.currcnt = chan.basecnt;
+	chan.autoinit = true;
+	chan.masked = false;
+}
+
+void fill_memory(const size_t bytes)
+{
+	for (size_t i = 0; i < bytes; ++i)
+		MemBase[dma_base + i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+}
+
+TEST(DmaChannel, ReadAcrossPagesAndWrapAround)
+{
+	for (const auto is_dma16 : {false, true}) {
+		DmaChannel chan(is_dma16 ? 5 : 1, is_dma16);
+		const auto word_bytes = is_dma16 ? 2u : 1u;
+		// Starts a bit before a 4K page boundary and wraps back to the
+		// start address
+		constexpr uint16_t start = 0x0ff0;
+		constexpr uint16_t words = 0x2000;
+		fill_memory(0x20000);
+		setup_channel(chan, start, words);
+
+		std::vector<uint8_t> buffer((words + 100) * word_bytes);
+		EXPECT_EQ(chan.Read(words + 100, buffer.data()), words + 100u);
+
+		for (size_t i = 0; i < buffer.size(); ++i) {
+			const auto offset = start * word_bytes + i % (words * word_bytes);
+			ASSERT_EQ(buffer[i], MemBase[dma_base + offset]) << "byte " << i;
+		}
+	}
+}
+
+TEST(DmaChannel, WriteMatchesRead)
+{
+	for (const auto is_dma16 : {false, true}) {
+		DmaChannel chan(is_dma16 ? 5 : 1, is_dma16);
+		constexpr uint16_t words = 5000;
+		std::vector<uint8_t> data(words * (is_dma16 ? 2 : 1));
+		for (size_t i = 0; i < data.size(); ++i)
+			data[i] = static_cast<uint8_t>(i ^ (i >> 5));
+
+		setup_channel(chan, 0x123, words);
+		chan.Write(words, data.data());
+
+		std::vector<uint8_t> readback(data.size());
+		setup_channel(chan, 0x123, words);
+		chan.Read(words, readback.data());
+		EXPECT_EQ(data, readback);
+	}
+}
+
+// Reports the throughput of streaming reads, as a sound card does with an
+// auto-initialising 16 KiB buffer
+TEST(DmaChannel, DISABLED_BenchmarkRead)
+{
+	constexpr uint16_t buffer_words = 16 * 1024;
+	constexpr size_t chunk_words = 512;
+	constexpr int repeats = 40000;
+
+	for (const auto is_dma16 : {false, true}) {
+		DmaChannel chan(is_dma16 ? 5 : 1, is_dma16);
+		const auto bytes = buffer_words * (is_dma16 ? 2u : 1u);
+		fill_memory(bytes);
+		setup_channel(chan, 0, buffer_words);
+
+		std::vector<uint8_t> buffer(chunk_words * 2);
+		size_t checksum = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for (auto i = 0; i < repeats; ++i) {
+			chan.Read(chunk_words, buffer.data());
+			checksum += buffer[i % buffer.size()];
+		}
+		const std::chrono::duration<double> elapsed =
+		        std::chrono::steady_clock::now() - start;
+		const auto total_bytes = static_cast<double>(repeats) * chunk_words *
+		                         (is_dma16 ? 2 : 1);
+		printf("DMA %2d-bit channel reads: %8.1f MB/s (%zu)\n",
+		       is_dma16 ? 16 : 8, total_bytes / elapsed.count() / 1e6, checksum);
+	}
+}
+
+} // namespace
@@ -21,7 +21,10 @@
 #include "../src/hardware/iohandler_containers.cpp"
 
 #include <cassert>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <unordered_map>
 
 #include <gtest/gtest.h>
 
@@ -195,4 +198,65 @@ TEST(iohandler_containers, adjacent_dword_write)
 	EXPECT_EQ(read_word_from_port(word_port_start), val >> 16);
 }
 
+TEST(iohandler_containers, reregister_and_free)
+{
+	constexpr io_port_t port = 0x3da;
+	IO_RegisterReadHandler(port, [](io_port_t, io_width_t) { return 1u; },
+	                       io_width_t::byte, 4);
+	IO_RegisterReadHandler(port + 2, [](io_port_t, io_width_t) { return 2u; },
+	                       io_width_t::byte);
+	EXPECT_EQ(read_byte_from_port(port), 1);
+	EXPECT_EQ(read_byte_from_port(port + 2), 2);
+	EXPECT_EQ(read_byte_from_port(port + 3), 1);
+
+	IO_FreeReadHandler(port, io_width_t::byte, 4);
+	for (io_port_t p = port; p < port + 4; ++p)
+		EXPECT_EQ(read_byte_from_port(p), 0xff);
+}
+
+// The hash map dispatch the IO handlers used before, for comparison
+std::unordered_map<io_port_t, io_read_f> map_read_handlers = {};
+
+uint8_t map_read_byte_from_port(const io_port_t port)
+{
+	const auto [it, was_blocked] = map_read_handlers.emplace(port, blocked_read);
+	return it->second(port, io_width_t::byte) & 0xff;
+}
+
+// Reports the port reads per second of a status-polling loop, as games do
+// with the VGA retrace, SB DSP status and joystick ports.
+TEST(iohandler_containers, DISABLED_BenchmarkPortReads)
+{
+	constexpr io_port_t ports[] = {0x3da, 0x22e, 0x201, 0x3c9};
+	constexpr int repeats = 5'000'000;
+
+	uint8_t status = 0;
+	const auto poll = [&status](io_port_t, io_width_t) -> io_val_t {
+		return status ^= 0x08;
+	};
+	for (const auto port : ports) {
+		IO_RegisterReadHandler(port, poll, io_width_t::byte);
+		map_read_handlers[port] = poll;
+	}
+	// Some other registered ports, so the map has its usual load
+	for (io_port_t port = 0x100; port < 0x400; port += 3)
+		map_read_handlers.emplace(port, blocked_read);
+
+	auto run = [&](const char *name, auto read_port) {
+		size_t checksum = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for (auto i = 0; i < repeats; ++i)
+			checksum += read_port(ports[i & 3]);
+		const std::chrono::duration<double> elapsed =
+		        std::chrono::steady_clock::now() - start;
+		printf("Port reads %-13s: %8.2f Mreads/s (%zu)\n", name,
+		       repeats / elapsed.count() / 1e6, checksum);
+	};
+	run("hash map", map_read_byte_from_port);
+	run("flat table", read_byte_from_port);
+
+	for (const auto port : ports)
+		IO_FreeReadHandler(port, io_width_t::byte);
+}
+
 } // namespace
@@ -0,0 +1,165 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "pic.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "timer.h"
+
+namespace {
+
+std::vector<uint32_t> ran = {};
+
+void record_event(uint32_t val)
+{
+	ran.push_back(val);
+}
+
+void other_event(uint32_t val)
+{
+	ran.push_back(1000 + val);
+}
+
+void rescheduling_event(uint32_t val)
+{
+	ran.push_back(val);
+	if (val < 5)
+		PIC_AddEvent(rescheduling_event, 0.25, val + 1);
+}
+
+class PicQueue : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		ran.clear();
+		PIC_RemoveEvents(record_event);
+		PIC_RemoveEvents(other_event);
+		PIC_RemoveEvents(rescheduling_event);
+		CPU_CycleMax = 1000;
+		CPU_CycleLeft = 0;
+		CPU_Cycles = 0;
+		TIMER_AddTick();
+	}
+
+	// Runs the queue as if the emulated CPU executed the given number of
+	// milliseconds, splitting each one at the next scheduled event.
+	void run_ms(const int ms)
+	{
+		for (auto i = 0; i < ms; ++i) {
+			while (PIC_RunQueue())
+				CPU_Cycles = 0; // executed the slice
+			TIMER_AddTick();
+		}
+	}
+};
+
+TEST_F(PicQueue, RunsInTimeOrder)
+{
+	PIC_AddEvent(record_event, 2.5, 3);
+	PIC_AddEvent(record_event, 0.5, 1);
+	PIC_AddEvent(record_event, 1.5, 2);
+	run_ms(1);
+	EXPECT_EQ(ran, std::vector<uint32_t>({1}));
+	run_ms(3);
+	EXPECT_EQ(ran, std::vector<uint32_t>({1, 2, 3}));
+}
+
+TEST_F(PicQueue, SameTimeRunsInAddOrder)
+{
+	for (uint32_t i = 0; i < 20; ++i)
+		PIC_AddEvent(record_event, 0.5, i);
+	run_ms(1);
+	ASSERT_EQ(ran.size(), 20u);
+	for (uint32_t i = 0; i < 20; ++i)
+		EXPECT_EQ(ran[i], i);
+}
+
+TEST_F(PicQueue, RemoveByHandlerAndValue)
+{
+	PIC_AddEvent(record_event, 0.5, 1);
+	PIC_AddEvent(record_event, 0.5, 2);
+	PIC_AddEvent(other_event, 0.5, 1);
+	PIC_RemoveSpecificEvents(record_event, 1);
+	run_ms(1);
+	EXPECT_EQ(ran, std::vector<uint32_t>({2, 1001}));
+
+	ran.clear();
+	PIC_AddEvent(record_event, 0.5, 1);
+	PIC_AddEvent(other_event, 0.5, 2);
+	PIC_RemoveEvents(record_event);
+	run_ms(1);
+	EXPECT_EQ(ran, std::vector<uint32_t>({1002}));
+}
+
+TEST_F(PicQueue, RemoveByHandle)
+{
+	const auto first = PIC_AddEvent(record_event, 0.5, 1);
+	PIC_AddEvent(record_event, 0.5, 2);
+	PIC_RemoveEvent(first);
+	run_ms(1);
+	EXPECT_EQ(ran, std::vector<uint32_t>({2}));
+
+	// The handle of an event that already ran must not remove the event
+	// that reuses its queue entry
+	const auto done = PIC_AddEvent(record_event, 0.5, 3);
+	run_ms(1);
+	PIC_AddEvent(record_event, 0.5, 4);
+	PIC_RemoveEvent(done);
+	run_ms(1);
+	EXPECT_EQ(ran, std::vector<uint32_t>({2, 3, 4}));
+}
+
+TEST_F(PicQueue, HandlersCanReschedule)
+{
+	PIC_AddEvent(rescheduling_event, 0.25, 0);
+	run_ms(2);
+	EXPECT_EQ(ran, std::vector<uint32_t>({0, 1, 2, 3, 4, 5}));
+}
+
+TEST_F(PicQueue, GrowsPastInitialPool)
+{
+	constexpr uint32_t num_events = 5000;
+	for (uint32_t i = 0; i < num_events; ++i)
+		PIC_AddEvent(record_event, 0.5 + i * 0.001, i);
+	run_ms(6);
+	ASSERT_EQ(ran.size(), num_events);
+	for (uint32_t i = 0; i < num_events; ++i)
+		EXPECT_EQ(ran[i], i);
+}
+
+TEST_F(PicQueue, ManyCancellationsKeepOrder)
+{
+	// Keep rescheduling a timeout, as devices do, while others run
+	for (uint32_t i = 0; i < 1000; ++i) {
+		PIC_RemoveEvents(other_event);
+		PIC_AddEvent(other_event, 100.0, i);
+		PIC_AddEvent(record_event, 0.5, i);
+	}
+	run_ms(1);
+	EXPECT_EQ(ran.size(), 1000u);
+	run_ms(100);
+	ASSERT_EQ(ran.size(), 1001u);
+	EXPECT_EQ(ran.back(), 1999u);
+}
+
+} // namespace
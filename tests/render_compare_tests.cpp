@@ -0,0 +1,124 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "../src/gui/render_compare.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+TEST(RenderCompare, EqualLines)
+{
+	std::vector<uint8_t> src(1000, 0x5a);
+	const auto cache = src;
+	for (size_t len = 0; len <= src.size(); ++len) {
+		const auto expected = len / RENDER_COMPARE_BLOCK * RENDER_COMPARE_BLOCK;
+		EXPECT_EQ(RENDER_CountUnchangedBytes(src.data(), cache.data(), len),
+		          expected);
+	}
+}
+
+TEST(RenderCompare, StopsAtFirstChangedBlock)
+{
+	constexpr size_t len = 300;
+	const std::vector<uint8_t> cache(len, 0);
+	for (size_t changed = 0; changed < len; ++changed) {
+		auto src = cache;
+		src[changed] = 1;
+		// A later change must not hide an earlier one
+		src[len - 1] = 1;
+		const auto expected = changed / RENDER_COMPARE_BLOCK * RENDER_COMPARE_BLOCK;
+		EXPECT_EQ(RENDER_CountUnchangedBytes(src.data(), cache.data(), len),
+		          expected)
+		        << "changed byte " << changed;
+	}
+}
+
+TEST(RenderCompare, UnalignedBuffers)
+{
+	std::vector<uint8_t> src(260, 7);
+	std::vector<uint8_t> cache(260, 7);
+	for (size_t offset = 0; offset < 4; ++offset) {
+		src[offset + 100] = 8;
+		EXPECT_EQ(RENDER_CountUnchangedBytes(src.data() + offset,
+		                                     cache.data() + offset, 256),
+		          96u);
+		src[offset + 100] = 7;
+	}
+}
+
+// The word-at-a-time compare the scalers used before, for comparison
+size_t count_unchanged_words(const uint8_t *src, const uint8_t *cache, size_t num_bytes)
+{
+	size_t i = 0;
+	for (; i + sizeof(size_t) <= num_bytes; i += sizeof(size_t))
+		if (read_unaligned_size_t(src + i) != read_unaligned_size_t(cache + i))
+			break;
+	return i;
+}
+
+// Reports lines/sec for a mostly static 640x480 frame: nine in ten lines are
+// unchanged and the rest change at a random point along the line.
+TEST(RenderCompare, DISABLED_BenchmarkLines)
+{
+	constexpr int width = 640;
+	constexpr int height = 480;
+	constexpr int repeats = 200;
+
+	std::mt19937 rng(1234);
+	for (const auto bytes_per_pixel : {1, 2, 4}) {
+		const size_t pitch = width * bytes_per_pixel;
+		std::vector<uint8_t> cache(pitch * height);
+		for (auto &b : cache)
+			b = static_cast<uint8_t>(rng());
+		auto frame = cache;
+		for (auto y = 0; y < height; y += 10)
+			frame[y * pitch + rng() % pitch] ^= 0xff;
+
+		auto run = [&](const char *name, auto compare) {
+			size_t checksum = 0;
+			const auto start = std::chrono::steady_clock::now();
+			for (auto r = 0; r < repeats; ++r)
+				for (auto y = 0; y < height; ++y)
+					checksum += compare(&frame[y * pitch], &cache[y * pitch], pitch);
+			const std::chrono::duration<double> elapsed =
+			        std::chrono::steady_clock::now() - start;
+			printf("Render compare %2d bpp %-13s: %8.2f Mlines/s (%zu)\n",
+			       bytes_per_pixel * 8, name,
+			       repeats * height / elapsed.count() / 1e6, checksum);
+		};
+		run("word loop", count_unchanged_words);
+		run("vector skip", RENDER_CountUnchangedBytes);
+		run("memcmp+vector", [](const uint8_t *src, const uint8_t *cache,
+		                        const size_t num_bytes) -> size_t {
+			if (memcmp(src, cache, num_bytes) == 0)
+				return num_bytes;
+			return RENDER_CountUnchangedBytes(src, cache, num_bytes);
+		});
+	}
+}
+
+} // namespace
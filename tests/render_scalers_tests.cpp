@@ -0,0 +1,160 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+#include "render.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "worker_pool.h"
+
+namespace {
+
+constexpr int width = 320;
+constexpr int height = 200;
+constexpr int num_frames = 4;
+
+struct ScaledFrames {
+	std::vector<std::vector<uint8_t>> pixels = {};
+	std::vector<std::vector<uint16_t>> changed_lines = {};
+};
+
+// Runs a few 32 bpp frames through a complex scaler the way the renderer
+// does, changing random parts of the source image between frames.
+ScaledFrames scale_frames(const ScalerComplexBlock_t &scaler,
+                          const bool linear, const int num_threads)
+{
+	std::unique_ptr<WorkerPool> workers = {};
+	if (num_threads > 1)
+		workers = std::make_unique<WorkerPool>(num_threads);
+
+	render.src.width = width;
+	render.src.height = height;
+	render.src.bpp = 32;
+	render.scale.inMode = scalerMode32;
+	render.scale.outMode = scalerMode32;
+	render.scale.blocks = width / SCALER_BLOCKSIZE;
+	render.scale.lastBlock = 0;
+	render.scale.inHeight = height;
+	render.scale.cachePitch = width * 4;
+	render.scale.lineHandler = ScalerCache[4][scalerMode32];
+	render.scale.complexHandler = linear ? scaler.Linear[scalerMode32]
+	                                     : scaler.Random[scalerMode32];
+	render.scale.parallel = (workers != nullptr);
+
+	// The first line is skipped by the complex scalers. Stretch some lines
+	// further, as aspect correction does in random access mode.
+	int out_height = 0;
+	Scaler_Aspect[0] = 0;
+	for (auto y = 1; y <= height; ++y) {
+		const auto extra = (!linear && y % 5 == 0) ? 1 : 0;
+		Scaler_Aspect[y] = static_cast<uint8_t>(scaler.yscale + extra);
+		out_height += Scaler_Aspect[y];
+	}
+	const auto out_pitch = static_cast<int>(width * scaler.xscale * 4);
+	std::vector<uint8_t> out(out_pitch * (out_height + 4));
+
+	memset(&scalerSourceCache, 0, sizeof(scalerSourceCache));
+	memset(&scalerChangeCache, 0, sizeof(scalerChangeCache));
+
+	std::mt19937 rng(1234);
+	std::vector<uint32_t> src(width * height);
+	for (auto &pixel : src)
+		pixel = rng() & 0x00e0e0e0;
+
+	ScaledFrames frames = {};
+	for (auto f = 0; f < num_frames; ++f) {
+		render.scale.cacheRead = reinterpret_cast<uint8_t *>(&scalerSourceCache);
+		render.scale.outWrite = out.data();
+		render.scale.outPitch = out_pitch;
+		render.scale.inLine = 0;
+		render.scale.outLine = 0;
+		Scaler_ChangedLines[0] = 0;
+		Scaler_ChangedLineIndex = 0;
+
+		for (auto y = 0; y < height; ++y)
+			render.scale.lineHandler(&src[y * width]);
+		Scaler_RenderQueuedLines(workers.get());
+
+		frames.pixels.push_back(out);
+		frames.changed_lines.emplace_back(Scaler_ChangedLines,
+		                                  Scaler_ChangedLines +
+		                                          Scaler_ChangedLineIndex + 1);
+
+		// Change a handful of rectangles for the next frame
+		for (auto i = 0; i < 20; ++i) {
+			const auto x0 = rng() % (width - 16);
+			const auto y0 = rng() % (height - 16);
+			const auto colour = rng() & 0x00e0e0e0;
+			for (auto y = y0; y < y0 + 16; ++y)
+				for (auto x = x0; x < x0 + 16; ++x)
+					src[y * width + x] = colour;
+		}
+	}
+	render.scale.parallel = false;
+	return frames;
+}
+
+void expect_parallel_matches_serial(const ScalerComplexBlock_t &scaler)
+{
+	for (const auto linear : {true, false}) {
+		const auto serial = scale_frames(scaler, linear, 1);
+		const auto parallel = scale_frames(scaler, linear, 4);
+		for (auto f = 0; f < num_frames; ++f) {
+			EXPECT_EQ(serial.changed_lines[f], parallel.changed_lines[f])
+			        << scaler.name << " frame " << f;
+			EXPECT_TRUE(serial.pixels[f] == parallel.pixels[f])
+			        << scaler.name << (linear ? " linear" : " random")
+			        << " frame " << f;
+		}
+	}
+}
+
+TEST(RenderScalers, ParallelHQ2xMatchesSerial)
+{
+	expect_parallel_matches_serial(ScaleHQ2x);
+}
+
+TEST(RenderScalers, ParallelHQ3xMatchesSerial)
+{
+	expect_parallel_matches_serial(ScaleHQ3x);
+}
+
+TEST(RenderScalers, ParallelSuper2xSaIMatchesSerial)
+{
+	expect_parallel_matches_serial(ScaleSuper2xSaI);
+}
+
+TEST(RenderScalers, ParallelSuperEagleMatchesSerial)
+{
+	expect_parallel_matches_serial(ScaleSuperEagle);
+}
+
+TEST(RenderScalers, ParallelAdvMame3xMatchesSerial)
+{
+	expect_parallel_matches_serial(ScaleAdvMame3x);
+}
+
+} // namespace
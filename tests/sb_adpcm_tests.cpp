@@ -0,0 +1,260 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "sb_adpcm.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <initializer_list>
+#include <random>
+#include <vector>
+
+namespace {
+
+// The per-sample decoder the Sound Blaster used before block decoding, kept
+// here as the reference the table-driven decoder must match bit for bit
+template <size_t N>
+uint8_t reference_sample(AdpcmState &state, const int code,
+                         const int8_t (&scale_map)[N], const uint8_t (&adjust_map)[N])
+{
+	auto &scale = state.stepsize;
+	const auto i = std::min(code + scale, static_cast<int>(N - 1));
+	scale = (scale + adjust_map[i]) & 0xff;
+
+	auto &ref = state.reference;
+	ref = static_cast<uint8_t>(std::clamp(ref + scale_map[i], 0, 255));
+	return ref;
+}
+
+uint8_t reference_2_sample(AdpcmState &state, const int code)
+{
+	constexpr int8_t scale_map[24] = {
+		0,  1,  0,  -1, 1,  3,  -1,  -3,
+		2,  6, -2,  -6, 4, 12,  -4, -12,
+		8, 24, -8, -24, 6, 48, -16, -48
+	};
+	constexpr uint8_t adjust_map[24] = {
+		  0, 4,   0, 4,
+		252, 4, 252, 4, 252, 4, 252, 4,
+		252, 4, 252, 4, 252, 4, 252, 4,
+		252, 0, 252, 0
+	};
+	return reference_sample(state, code, scale_map, adjust_map);
+}
+
+uint8_t reference_3_sample(AdpcmState &state, const int code)
+{
+	constexpr int8_t scale_map[40] = {
+		0,  1,  2,  3,  0,  -1,  -2,  -3,
+		1,  3,  5,  7, -1,  -3,  -5,  -7,
+		2,  6, 10, 14, -2,  -6, -10, -14,
+		4, 12, 20, 28, -4, -12, -20, -28,
+		5, 15, 25, 35, -5, -15, -25, -35
+	};
+	constexpr uint8_t adjust_map[40] = {
+		  0, 0, 0, 8,   0, 0, 0, 8,
+		248, 0, 0, 8, 248, 0, 0, 8,
+		248, 0, 0, 8, 248, 0, 0, 8,
+		248, 0, 0, 8, 248, 0, 0, 8,
+		248, 0, 0, 0, 248, 0, 0, 0
+	};
+	return reference_sample(state, code, scale_map, adjust_map);
+}
+
+uint8_t reference_4_sample(AdpcmState &state, const int code)
+{
+	constexpr int8_t scale_map[64] = {
+		0,  1,  2,  3,  4,  5,  6,  7,  0,  -1,  -2,  -3,  -4,  -5,  -6,  -7,
+		1,  3,  5,  7,  9, 11, 13, 15, -1,  -3,  -5,  -7,  -9, -11, -13, -15,
+		2,  6, 10, 14, 18, 22, 26, 30, -2,  -6, -10, -14, -18, -22, -26, -30,
+		4, 12, 20, 28, 36, 44, 52, 60, -4, -12, -20, -28, -36, -44, -52, -60
+	};
+	constexpr uint8_t adjust_map[64] = {
+		  0, 0, 0, 0, 0, 16, 16, 16,
+		  0, 0, 0, 0, 0, 16, 16, 16,
+		240, 0, 0, 0, 0, 16, 16, 16,
+		240, 0, 0, 0, 0, 16, 16, 16,
+		240, 0, 0, 0, 0, 16, 16, 16,
+		240, 0, 0, 0, 0, 16, 16, 16,
+		240, 0, 0, 0, 0,  0,  0,  0,
+		240, 0, 0, 0, 0,  0,  0,  0
+	};
+	return reference_sample(state, code, scale_map, adjust_map);
+}
+
+uint32_t reference_decode(const AdpcmFormat format, AdpcmState &state,
+                          const uint8_t *in, const uint32_t num_bytes, uint8_t *out)
+{
+	uint32_t samples = 0;
+	for (uint32_t i = 0; i < num_bytes; ++i) {
+		const auto b = in[i];
+		switch (format) {
+		case AdpcmFormat::TwoBit:
+			out[samples++] = reference_2_sample(state, (b >> 6) & 0x3);
+			out[samples++] = reference_2_sample(state, (b >> 4) & 0x3);
+			out[samples++] = reference_2_sample(state, (b >> 2) & 0x3);
+			out[samples++] = reference_2_sample(state, (b >> 0) & 0x3);
+			break;
+		case AdpcmFormat::ThreeBit:
+			out[samples++] = reference_3_sample(state, (b >> 5) & 0x7);
+			out[samples++] = reference_3_sample(state, (b >> 2) & 0x7);
+			out[samples++] = reference_3_sample(state, (b & 0x3) << 1);
+			break;
+		case AdpcmFormat::FourBit:
+			out[samples++] = reference_4_sample(state, b >> 4);
+			out[samples++] = reference_4_sample(state, b & 0xf);
+			break;
+		}
+	}
+	return samples;
+}
+
+constexpr AdpcmFormat formats[] = {AdpcmFormat::TwoBit,
+                                   AdpcmFormat::ThreeBit,
+                                   AdpcmFormat::FourBit};
+
+std::vector<uint8_t> random_bytes(std::mt19937 &rng, const size_t count)
+{
+	std::uniform_int_distribution<int> dist(0, 255);
+	std::vector<uint8_t> bytes(count);
+	for (auto &b : bytes)
+		b = static_cast<uint8_t>(dist(rng));
+	return bytes;
+}
+
+TEST(SbAdpcm, MatchesReferenceDecoder)
+{
+	std::mt19937 rng(2022);
+	std::uniform_int_distribution<int> byte_dist(0, 255);
+
+	for (const auto format : formats) {
+		const auto per_byte = ADPCM_SamplesPerByte(format);
+		for (int round = 0; round < 500; ++round) {
+			const auto encoded = random_bytes(rng, 1 + round % 97);
+			const auto num_bytes = static_cast<uint32_t>(encoded.size());
+
+			AdpcmState expected_state = {};
+			expected_state.reference = static_cast<uint8_t>(byte_dist(rng));
+			expected_state.stepsize = static_cast<uint16_t>(byte_dist(rng) % 80);
+			auto state = expected_state;
+
+			std::vector<uint8_t> expected(num_bytes * per_byte);
+			std::vector<uint8_t> actual(num_bytes * per_byte);
+			EXPECT_EQ(reference_decode(format, expected_state, encoded.data(),
+			                           num_bytes, expected.data()),
+			          ADPCM_Decode(format, state, encoded.data(),
+			                       num_bytes, actual.data()));
+			EXPECT_EQ(expected, actual);
+			EXPECT_EQ(expected_state.reference, state.reference);
+			EXPECT_EQ(expected_state.stepsize, state.stepsize);
+		}
+	}
+}
+
+TEST(SbAdpcm, ExtremeInputsMatchReference)
+{
+	for (const auto format : formats) {
+		const auto per_byte = ADPCM_SamplesPerByte(format);
+		const std::initializer_list<uint8_t> fills = {0x00, 0x77, 0x88, 0xff};
+		for (const auto fill : fills) {
+			for (uint16_t stepsize = 0; stepsize < 256; ++stepsize) {
+				const std::vector<uint8_t> encoded(64, fill);
+				AdpcmState expected_state = {0x80, stepsize};
+				auto state = expected_state;
+
+				std::vector<uint8_t> expected(encoded.size() * per_byte);
+				std::vector<uint8_t> actual(encoded.size() * per_byte);
+				reference_decode(format, expected_state, encoded.data(), 64,
+				                 expected.data());
+				ADPCM_Decode(format, state, encoded.data(), 64, actual.data());
+				EXPECT_EQ(expected, actual);
+				EXPECT_EQ(expected_state.stepsize, state.stepsize);
+			}
+		}
+	}
+}
+
+TEST(SbAdpcm, ChunkedDecodeMatchesWholeBuffer)
+{
+	std::mt19937 rng(1991);
+	const auto encoded = random_bytes(rng, 4096);
+
+	for (const auto format : formats) {
+		const auto per_byte = ADPCM_SamplesPerByte(format);
+		std::vector<uint8_t> whole(encoded.size() * per_byte);
+		AdpcmState whole_state = {};
+		ADPCM_Decode(format, whole_state, encoded.data(),
+		             static_cast<uint32_t>(encoded.size()), whole.data());
+
+		std::vector<uint8_t> chunked(encoded.size() * per_byte);
+		AdpcmState chunked_state = {};
+		size_t pos = 0;
+		std::uniform_int_distribution<size_t> chunk_dist(1, 300);
+		while (pos < encoded.size()) {
+			const auto chunk = std::min(chunk_dist(rng), encoded.size() - pos);
+			ADPCM_Decode(format, chunked_state, encoded.data() + pos,
+			             static_cast<uint32_t>(chunk),
+			             chunked.data() + pos * per_byte);
+			pos += chunk;
+		}
+		EXPECT_EQ(whole, chunked);
+		EXPECT_EQ(whole_state.reference, chunked_state.reference);
+		EXPECT_EQ(whole_state.stepsize, chunked_state.stepsize);
+	}
+}
+
+TEST(SbAdpcm, DISABLED_BenchmarkDecode)
+{
+	constexpr uint32_t chunk_bytes = 2048;
+	constexpr int repeats = 5000;
+
+	std::mt19937 rng(0);
+	const auto encoded = random_bytes(rng, chunk_bytes);
+	std::vector<uint8_t> out(chunk_bytes * 4);
+
+	const char *names[] = {"2-bit", "3-bit", "4-bit"};
+	for (const auto format : formats) {
+		const auto name = names[static_cast<int>(format)];
+		for (const auto use_reference : {true, false}) {
+			AdpcmState state = {};
+			size_t checksum = 0;
+			const auto start = std::chrono::steady_clock::now();
+			for (auto i = 0; i < repeats; ++i) {
+				const auto samples = use_reference
+				        ? reference_decode(format, state, encoded.data(),
+				                           chunk_bytes, out.data())
+				        : ADPCM_Decode(format, state, encoded.data(),
+				                       chunk_bytes, out.data());
+				checksum += out[i % samples];
+			}
+			const std::chrono::duration<double> elapsed =
+			        std::chrono::steady_clock::now() - start;
+			const auto total_bytes = static_cast<double>(repeats) * chunk_bytes;
+			printf("ADPCM %s %s decode: %8.1f MB/s (%zu)\n", name,
+			       use_reference ? "per-sample" : "table     ",
+			       total_bytes / elapsed.count() / 1e6, checksum);
+		}
+	}
+}
+
+} // namespace
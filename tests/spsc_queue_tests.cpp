@@ -0,0 +1,292 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "spsc_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "rwqueue.h"
+
+namespace {
+
+constexpr auto iterations = 100000;
+
+using clock_type = std::chrono::steady_clock;
+
+TEST(SpscQueue, TrivialSerial)
+{
+	SpscQueue<int> q(65);
+	for (int iteration = 0; iteration != 128; ++iteration) {
+		// The ring is larger than the nominal capacity
+		EXPECT_EQ(q.MaxCapacity(), 65);
+		EXPECT_TRUE(q.IsEmpty());
+		for (int i = 0; i != 65; ++i)
+			EXPECT_TRUE(q.TryEnqueue(std::move(i)));
+		EXPECT_EQ(q.Size(), 65);
+		EXPECT_FALSE(q.TryEnqueue(65));
+
+		int item = -1;
+		for (int i = 0; i != 65; ++i) {
+			EXPECT_TRUE(q.TryDequeue(item));
+			EXPECT_EQ(item, i);
+		}
+		EXPECT_FALSE(q.TryDequeue(item));
+		EXPECT_TRUE(q.IsEmpty());
+	}
+}
+
+TEST(SpscQueue, ZeroCapacity)
+{
+	EXPECT_DEBUG_DEATH({ SpscQueue<int> q(0); }, "");
+}
+
+TEST(SpscQueue, BulkWrapsAround)
+{
+	SpscQueue<int16_t> q(100);
+	std::vector<int16_t> stream(100 * 50);
+	for (size_t i = 0; i < stream.size(); ++i)
+		stream[i] = static_cast<int16_t>(i);
+
+	std::vector<int16_t> out(70);
+	size_t written = 0;
+	size_t read = 0;
+	while (read < stream.size()) {
+		// Writes are cut short once the ring is full
+		const auto num = std::min<size_t>(70, stream.size() - written);
+		const auto accepted = q.TryWrite(stream.data() + written, num);
+		EXPECT_EQ(accepted, std::min(num, 100 - q.Size() + accepted));
+		written += accepted;
+		EXPECT_LE(q.Size(), 100u);
+
+		const auto got = q.TryRead(out.data(), out.size());
+		for (size_t i = 0; i < got; ++i)
+			ASSERT_EQ(out[i], stream[read++]);
+	}
+	EXPECT_TRUE(q.IsEmpty());
+}
+
+TEST(SpscQueue, ContainersAreMoved)
+{
+	SpscQueue<std::vector<int16_t>> q(4);
+	std::vector<int16_t> v(100, 7);
+	const auto data = v.data();
+	EXPECT_TRUE(q.TryEnqueue(std::move(v)));
+	EXPECT_TRUE(v.empty());
+
+	std::vector<int16_t> out;
+	EXPECT_TRUE(q.TryDequeue(out));
+	EXPECT_EQ(out.data(), data);
+	EXPECT_EQ(out.size(), 100u);
+}
+
+TEST(SpscQueue, AsyncBlockingReadWrite)
+{
+	SpscQueue<int> q(64);
+	std::thread writer([&q] {
+		std::vector<int> chunk(37);
+		for (int i = 0; i < iterations; i += 37) {
+			for (int j = 0; j < 37; ++j)
+				chunk[j] = i + j;
+			q.Write(chunk.data(), chunk.size());
+		}
+	});
+	std::vector<int> chunk(53);
+	int expected = 0;
+	const int total = (iterations + 36) / 37 * 37;
+	while (expected < total) {
+		const auto num = std::min<size_t>(chunk.size(), total - expected);
+		EXPECT_EQ(q.Read(chunk.data(), num), num);
+		for (size_t j = 0; j < num; ++j)
+			ASSERT_EQ(chunk[j], expected++);
+	}
+	writer.join();
+	EXPECT_TRUE(q.IsEmpty());
+}
+
+TEST(SpscQueue, StopReleasesWaiters)
+{
+	SpscQueue<int> q(8);
+	std::thread reader([&q] {
+		int items[4];
+		EXPECT_EQ(q.Read(items, 4), 1u);
+	});
+	q.TryEnqueue(1);
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	q.Stop();
+	reader.join();
+
+	// Stopped queues don't wait for room either
+	const std::vector<int> items(20);
+	EXPECT_EQ(q.Write(items.data(), items.size()), 8u);
+
+	q.Clear();
+	q.Start();
+	EXPECT_TRUE(q.IsEmpty());
+	EXPECT_TRUE(q.IsRunning());
+}
+
+// Streams 512-frame stereo buffers from a render thread to a consumer taking
+// 48 frames at a time, as the mixer does every millisecond, and reports the
+// time the consumer spends per call. The RWQueue version moves buffers
+// through a pair of queues, as the MIDI synths used to.
+TEST(SpscQueue, DISABLED_BenchmarkAudioThroughput)
+{
+	constexpr size_t frames_per_buffer = 512;
+	constexpr size_t frames_per_call = 48;
+	constexpr int calls = 200000;
+	using buffer_t = std::vector<int16_t>;
+
+	auto report = [](const char *name, const clock_type::duration &elapsed,
+	                 const int64_t checksum) {
+		const auto ns = std::chrono::duration<double, std::nano>(elapsed).count();
+		printf("%-14s %6.1f ns per mixer call (%lld)\n", name, ns / calls,
+		       static_cast<long long>(checksum));
+	};
+
+	{
+		RWQueue<buffer_t> playable(4);
+		RWQueue<buffer_t> backstock(4);
+		for (int i = 0; i < 4; ++i)
+			backstock.Enqueue(buffer_t(frames_per_buffer * 2));
+		std::atomic_bool keep_rendering = {true};
+		std::thread renderer([&] {
+			for (int16_t i = 0; keep_rendering; ++i) {
+				auto buffer = backstock.Dequeue();
+				std::fill(buffer.begin(), buffer.end(), i);
+				playable.Enqueue(std::move(buffer));
+			}
+		});
+		auto play_buffer = playable.Dequeue();
+		size_t last_played_frame = 0;
+		int64_t checksum = 0;
+		const auto start = clock_type::now();
+		for (int i = 0; i < calls; ++i) {
+			auto requested_frames = frames_per_call;
+			while (requested_frames) {
+				if (last_played_frame == frames_per_buffer) {
+					backstock.Enqueue(std::move(play_buffer));
+					play_buffer = playable.Dequeue();
+					last_played_frame = 0;
+				}
+				const auto frames = std::min(requested_frames,
+				                             frames_per_buffer - last_played_frame);
+				checksum += play_buffer[last_played_frame * 2];
+				requested_frames -= frames;
+				last_played_frame += frames;
+			}
+		}
+		report("RWQueue pair", clock_type::now() - start, checksum);
+		keep_rendering = false;
+		backstock.Enqueue(std::move(play_buffer));
+		while (playable.Size())
+			backstock.Enqueue(playable.Dequeue());
+		renderer.join();
+	}
+	{
+		SpscQueue<int16_t> ring(4 * frames_per_buffer * 2);
+		std::thread renderer([&] {
+			buffer_t buffer(frames_per_buffer * 2);
+			for (int16_t i = 0; ring.IsRunning(); ++i) {
+				std::fill(buffer.begin(), buffer.end(), i);
+				ring.Write(buffer.data(), buffer.size());
+			}
+		});
+		buffer_t play_buffer(frames_per_call * 2);
+		int64_t checksum = 0;
+		const auto start = clock_type::now();
+		for (int i = 0; i < calls; ++i) {
+			ring.Read(play_buffer.data(), play_buffer.size());
+			checksum += play_buffer[0];
+		}
+		report("SpscQueue", clock_type::now() - start, checksum);
+		ring.Stop();
+		renderer.join();
+	}
+}
+
+// Measures how long the emulation thread spends handing over a MIDI message
+// while the render thread drains the queue, and how long messages wait
+// before the render thread picks them up.
+TEST(SpscQueue, DISABLED_BenchmarkMidiLatency)
+{
+	constexpr int messages = 200000;
+	std::vector<clock_type::time_point> sent(messages);
+
+	// Runs the producer on this thread and the consumer on another, with
+	// messages identified by their index into the sent times
+	auto measure = [&](const char *name, auto &&enqueue, auto &&dequeue) {
+		double total_latency_ns = 0.0;
+		std::thread renderer([&] {
+			for (int received = 0; received < messages; ++received) {
+				const auto i = dequeue();
+				total_latency_ns += std::chrono::duration<double, std::nano>(
+				                            clock_type::now() - sent[i])
+				                            .count();
+			}
+		});
+		double total_enqueue_ns = 0.0;
+		double worst_enqueue_ns = 0.0;
+		for (int i = 0; i < messages; ++i) {
+			sent[i] = clock_type::now();
+			enqueue(i);
+			const auto ns = std::chrono::duration<double, std::nano>(
+			                        clock_type::now() - sent[i])
+			                        .count();
+			total_enqueue_ns += ns;
+			worst_enqueue_ns = std::max(worst_enqueue_ns, ns);
+			if (i % 64 == 0)
+				std::this_thread::yield();
+		}
+		renderer.join();
+		printf("%-9s enqueue %7.1f ns (worst %9.0f ns), "
+		       "delivery latency %9.0f ns\n",
+		       name, total_enqueue_ns / messages, worst_enqueue_ns,
+		       total_latency_ns / messages);
+	};
+
+	RWQueue<int> rw_queue(1024);
+	measure(
+	        "RWQueue",
+	        [&](int i) { rw_queue.Enqueue(std::move(i)); },
+	        [&] { return rw_queue.Dequeue(); });
+
+	SpscQueue<int> spsc_queue(1024);
+	measure(
+	        "SpscQueue",
+	        [&](int i) {
+		        while (!spsc_queue.TryEnqueue(std::move(i)))
+			        std::this_thread::yield();
+	        },
+	        [&] {
+		        int i = 0;
+		        while (!spsc_queue.TryDequeue(i))
+			        std::this_thread::yield();
+		        return i;
+	        });
+}
+
+} // namespace
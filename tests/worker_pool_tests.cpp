@@ -0,0 +1,71 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "worker_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+namespace {
+
+TEST(WorkerPool, SingleThreadRunsEveryJob)
+{
+	WorkerPool pool(1);
+	EXPECT_EQ(pool.NumThreads(), 1);
+
+	std::vector<int> ran(100, 0);
+	pool.Run(100, [&](const int i) { ++ran[i]; });
+	for (const auto count : ran)
+		EXPECT_EQ(count, 1);
+}
+
+TEST(WorkerPool, EveryJobRunsOnce)
+{
+	WorkerPool pool(4);
+	EXPECT_EQ(pool.NumThreads(), 4);
+
+	std::vector<std::atomic<int>> ran(1000);
+	for (auto batch = 0; batch < 50; ++batch)
+		pool.Run(1000, [&](const int i) { ++ran[i]; });
+	for (const auto &count : ran)
+		EXPECT_EQ(count, 50);
+}
+
+TEST(WorkerPool, RunWaitsForAllJobs)
+{
+	WorkerPool pool(3);
+	for (auto batch = 0; batch < 100; ++batch) {
+		std::atomic<int> finished = 0;
+		pool.Run(7, [&](const int) { ++finished; });
+		EXPECT_EQ(finished, 7);
+	}
+}
+
+TEST(WorkerPool, EmptyBatch)
+{
+	WorkerPool pool(2);
+	auto called = false;
+	pool.Run(0, [&](const int) { called = true; });
+	EXPECT_FALSE(called);
+}
+
+} // namespace
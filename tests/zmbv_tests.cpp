@@ -0,0 +1,235 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "../src/libs/zmbv/zmbv.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+constexpr int width = 640;
+constexpr int height = 480;
+constexpr int keyframe_interval = 300;
+
+int pixel_size(const ZMBV_FORMAT format)
+{
+	switch (format) {
+	case ZMBV_FORMAT::BPP_8: return 1;
+	case ZMBV_FORMAT::BPP_15:
+	case ZMBV_FORMAT::BPP_16: return 2;
+	default: return 4;
+	}
+}
+
+// Generates frames that scroll a tiled image around by a few pixels in all
+// directions and then scribble over part of it, so the encoder has to use
+// both motion vectors and XOR blocks.
+class FrameSource {
+public:
+	FrameSource(const ZMBV_FORMAT format)
+	        : bytes_per_pixel(pixel_size(format)),
+	          image((width + 64) * (height + 64) * bytes_per_pixel),
+	          frame(width * height * bytes_per_pixel)
+	{
+		// 4x4 pixel tiles of random colour
+		const auto image_pitch = (width + 64) * bytes_per_pixel;
+		for (auto y = 0; y < height + 64; y += 4)
+			for (auto x = 0; x < image_pitch; x += 4 * bytes_per_pixel) {
+				const auto colour = rng();
+				for (auto ty = 0; ty < 4; ++ty)
+					for (auto tx = 0; tx < 4 * bytes_per_pixel; ++tx)
+						image[(y + ty) * image_pitch + x + tx] = static_cast<uint8_t>(
+						        colour >> (8 * (tx % bytes_per_pixel)));
+			}
+		for (auto &b : palette)
+			b = static_cast<uint8_t>(rng());
+	}
+
+	uint8_t *Next()
+	{
+		const int dx = 32 + (frame_num % 7) - 3;
+		const int dy = 32 + ((frame_num / 7) % 5) - 2;
+		const auto image_pitch = (width + 64) * bytes_per_pixel;
+		const auto frame_pitch = width * bytes_per_pixel;
+		for (auto y = 0; y < height; ++y)
+			std::copy_n(&image[(y + dy) * image_pitch + dx * bytes_per_pixel],
+			            frame_pitch, &frame[y * frame_pitch]);
+		for (auto i = 0; i < 500; ++i)
+			frame[rng() % frame.size()] = static_cast<uint8_t>(rng());
+		++frame_num;
+		return frame.data();
+	}
+
+	uint8_t *Palette() { return palette; }
+
+	const int bytes_per_pixel;
+
+private:
+	std::mt19937 rng{1234};
+	std::vector<uint8_t> image;
+	std::vector<uint8_t> frame;
+	uint8_t palette[256 * 4] = {};
+	int frame_num = 0;
+};
+
+std::vector<std::vector<uint8_t>> encode(const ZMBV_FORMAT format,
+                                         const bool use_simd,
+                                         const int num_frames,
+                                         const int num_threads = 1)
+{
+	VideoCodec codec;
+	codec.EnableSimd(use_simd);
+	codec.SetThreads(num_threads);
+	EXPECT_TRUE(codec.SetupCompress(width, height));
+
+	std::vector<uint8_t> buf(codec.NeededSize(width, height, format));
+	FrameSource source(format);
+	std::vector<std::vector<uint8_t>> encoded = {};
+
+	for (auto f = 0; f < num_frames; ++f) {
+		const int flags = (f % keyframe_interval == 0) ? 1 : 0;
+		EXPECT_TRUE(codec.PrepareCompressFrame(flags, format, source.Palette(),
+		                                       buf.data(),
+		                                       static_cast<uint32_t>(buf.size())));
+		auto row = source.Next();
+		for (auto y = 0; y < height; ++y) {
+			codec.CompressLines(1, &row);
+			row += width * source.bytes_per_pixel;
+		}
+		const auto written = codec.FinishCompressFrame();
+		EXPECT_GT(written, 0);
+		encoded.emplace_back(buf.begin(), buf.begin() + written);
+	}
+	codec.FinishVideo();
+	return encoded;
+}
+
+void expect_simd_matches_scalar(const ZMBV_FORMAT format)
+{
+	constexpr int num_frames = 8;
+	const auto scalar = encode(format, false, num_frames);
+	const auto simd = encode(format, true, num_frames);
+	ASSERT_EQ(scalar.size(), simd.size());
+	for (size_t f = 0; f < scalar.size(); ++f)
+		EXPECT_EQ(scalar[f], simd[f]) << "frame " << f;
+}
+
+TEST(ZMBV, SimdMatchesScalar8bpp)
+{
+	expect_simd_matches_scalar(ZMBV_FORMAT::BPP_8);
+}
+
+TEST(ZMBV, SimdMatchesScalar16bpp)
+{
+	expect_simd_matches_scalar(ZMBV_FORMAT::BPP_16);
+}
+
+TEST(ZMBV, SimdMatchesScalar32bpp)
+{
+	expect_simd_matches_scalar(ZMBV_FORMAT::BPP_32);
+}
+
+// Inflates each frame of an encoded stream, the way ZMBV decoders do
+std::vector<std::vector<uint8_t>> inflate_frames(std::vector<std::vector<uint8_t>> &frames)
+{
+	constexpr uint8_t keyframe_flag = 0x01;
+	constexpr size_t keyframe_header_bytes = 6;
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	EXPECT_EQ(inflateInit(&zs), Z_OK);
+
+	std::vector<std::vector<uint8_t>> inflated = {};
+	std::vector<uint8_t> out(width * height * 4 * 2);
+	for (auto &frame : frames) {
+		size_t offset = 1;
+		if (frame[0] & keyframe_flag) {
+			offset += keyframe_header_bytes;
+			inflateReset(&zs);
+		}
+		zs.next_in = frame.data() + offset;
+		zs.avail_in = static_cast<uInt>(frame.size() - offset);
+		zs.next_out = out.data();
+		zs.avail_out = static_cast<uInt>(out.size());
+		const auto result = inflate(&zs, Z_SYNC_FLUSH);
+		EXPECT_TRUE(result == Z_OK || result == Z_BUF_ERROR);
+		EXPECT_EQ(zs.avail_in, 0u);
+		inflated.emplace_back(out.data(), zs.next_out);
+	}
+	inflateEnd(&zs);
+	return inflated;
+}
+
+void expect_parallel_matches_serial(const ZMBV_FORMAT format)
+{
+	constexpr int num_frames = 8;
+	auto serial = encode(format, true, num_frames);
+	auto parallel = encode(format, true, num_frames, 4);
+	const auto serial_data = inflate_frames(serial);
+	const auto parallel_data = inflate_frames(parallel);
+	ASSERT_EQ(serial_data.size(), parallel_data.size());
+	for (size_t f = 0; f < serial_data.size(); ++f)
+		EXPECT_EQ(serial_data[f], parallel_data[f]) << "frame " << f;
+}
+
+TEST(ZMBV, ParallelMatchesSerial8bpp)
+{
+	expect_parallel_matches_serial(ZMBV_FORMAT::BPP_8);
+}
+
+TEST(ZMBV, ParallelMatchesSerial32bpp)
+{
+	expect_parallel_matches_serial(ZMBV_FORMAT::BPP_32);
+}
+
+// Reports the per-frame encode time of the scalar, SIMD and threaded paths
+TEST(ZMBV, DISABLED_BenchmarkEncode)
+{
+	constexpr int num_frames = 20;
+	const std::pair<ZMBV_FORMAT, const char *> formats[] = {
+	        {ZMBV_FORMAT::BPP_8, "8"},
+	        {ZMBV_FORMAT::BPP_16, "16"},
+	        {ZMBV_FORMAT::BPP_32, "32"},
+	};
+	const std::tuple<bool, int, const char *> modes[] = {
+	        {false, 1, "scalar"},
+	        {true, 1, "simd"},
+	        {true, 4, "simd, 4 threads"},
+	};
+	for (const auto &[format, name] : formats) {
+		for (const auto &[use_simd, threads, mode] : modes) {
+			const auto start = std::chrono::steady_clock::now();
+			encode(format, use_simd, num_frames, threads);
+			const std::chrono::duration<double, std::milli> elapsed =
+			        std::chrono::steady_clock::now() - start;
+			printf("ZMBV %dx%d %2s bpp %-15s: %6.2f ms/frame\n", width,
+			       height, name, mode, elapsed.count() / num_frames);
+		}
+	}
+}
+
+} // namespace